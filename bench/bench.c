@@ -0,0 +1,750 @@
+// Benchmarks of virtual machine: instructions of every opcode,
+// dispatch of interpreter, scaled examples, batches of small
+// inputs and throughput of assembler. Result is JSON with time
+// per instruction (per input for batches, per line for assembler),
+// names select benchmarks by prefix. Mode run is cvm_ctx_run
+// (native code, or loops of interpreter in -DCVM_KERNEL_NO_JIT
+// build), mode run_for is interpreter of cvm_ctx_run_for.
+// $ make bench
+// $ ./bench/bench op/ caesar
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../cvmkernel.h"
+
+// native code is built as in cvmkernel.c
+#if defined(CVM_KERNEL_JIT) && (defined(CVM_KERNEL_NO_JIT) || \
+	!(defined(__GNUC__) && defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))))
+	#undef CVM_KERNEL_JIT
+#endif
+
+#define BENCH_RUNS   5
+#define BENCH_INSNS  (1 << 24) // instructions of one run of loops
+#define BENCH_UNROLL 16        // bodies in one iteration of loops
+#define BENCH_BLOCKS 100000    // blocks of source of assembler
+#define BENCH_CAESAR 1000000   // elements of caesar
+#define BENCH_BATCH  1000000   // inputs of batches
+#define BENCH_ASIZE  6         // elements of caesar in batch
+
+// Program of benchmark: source is made by gen, it runs insns
+// instructions for input; stack is limit of stack of context.
+typedef struct bench_t {
+	const char *name;
+	char *source;
+	int64_t insns;
+	int32_t *input;
+	int32_t stack;
+	int32_t result; // top of stack after run
+} bench_t;
+
+// Body of loop for opcode: it leaves stack as it was, extra is
+// number of instructions which it runs out of body (in tail).
+typedef struct bench_op_t {
+	const char *name;
+	const char *body;
+	const char *tail;
+	int extra;
+} bench_op_t;
+
+// loop of n iterations: counter is on top of stack
+#define LOOP_HEAD \
+	"\tpush %d\n" \
+	"labl loop\n"
+#define LOOP_TAIL \
+	"\tdec\n" \
+	"\tpush -1\n" \
+	"\tload\n" \
+	"\tpush 0\n" \
+	"\tpush loop\n" \
+	"\tjg\n" \
+	"\thlt\n"
+
+// examples/fact10.asm: A <- fact(A)
+#define FACT_HEAD \
+	"labl fact\n" \
+	"\tpush -2\n" \
+	"\tload\n"
+#define FACT_CHECK \
+	"labl _fact_for\n" \
+	"\tpush 2\n" \
+	"\tpush -2\n" \
+	"\tload\n" \
+	"\tpush _fact_end\n" \
+	"\tjg\n"
+#define FACT_BODY \
+	"\tpush -1\n" \
+	"\tload\n" \
+	"\tdec\n" \
+	"\tpush -1\n" \
+	"\tpush -2\n" \
+	"\tstor\n" \
+	"\tpop\n" \
+	"\tpush -3\n" \
+	"\tload\n" \
+	"\tpush -2\n" \
+	"\tload\n" \
+	"\tmul\n" \
+	"\tpush -1\n" \
+	"\tpush -4\n" \
+	"\tstor\n" \
+	"\tpop\n" \
+	"\tpush _fact_for\n" \
+	"\tjmp\n"
+#define FACT_END \
+	"labl _fact_end\n" \
+	"\tpop\n" \
+	"\tjmp\n"
+#define FACT_CALL \
+	"\tpush 12\n" \
+	"\tpush fact\n" \
+	"\tcall\n" \
+	"\tpop\n"
+
+// examples/caesar.asm: A[i] <- (K + A[i]) mod 26 for A, K, S
+#define CAESAR_MAIN \
+	"\tpush caesar\n" \
+	"\tcall\n" \
+	"\thlt\n"
+#define CAESAR_HEAD \
+	"labl caesar\n" \
+	"\tpush 0\n"
+#define CAESAR_CHECK \
+	"labl caesar_iter\n" \
+	"\tpush -1\n" \
+	"\tload\n" \
+	"\tpush -4\n" \
+	"\tload\n" \
+	"\tpush caesar_exit\n" \
+	"\tjge\n"
+#define CAESAR_BODY \
+	"\tpush -4\n" \
+	"\tload\n" \
+	"\tpush -6\n" \
+	"\tpush -3\n" \
+	"\tload\n" \
+	"\tsub\n" \
+	"\tload\n" \
+	"\tadd\n" \
+	"\tpush 26\n" \
+	"\tmod\n" \
+	"\tpush -1\n" \
+	"\tpush -6\n" \
+	"\tpush -4\n" \
+	"\tload\n" \
+	"\tsub\n" \
+	"\tstor\n" \
+	"\tpop\n" \
+	"\tpush -1\n" \
+	"\tload\n" \
+	"\tpush 1\n" \
+	"\tadd\n" \
+	"\tpush -1\n" \
+	"\tpush -2\n" \
+	"\tstor\n" \
+	"\tpop\n" \
+	"\tpush caesar_iter\n" \
+	"\tjmp\n"
+#define CAESAR_END \
+	"labl caesar_exit\n" \
+	"\tpop\n" \
+	"\tjmp\n"
+
+// examples/mul5.asm: x <- x * 5
+#define MUL5_FUNC \
+	"labl mul5\n" \
+	"\tpush -2\n" \
+	"\tload\n" \
+	"\tpush 5\n" \
+	"\tmul\n" \
+	"\tpush -1\n" \
+	"\tpush -3\n" \
+	"\tstor\n" \
+	"\tpop\n" \
+	"\tjmp\n"
+#define MUL5_CALL \
+	"\tpush 10\n" \
+	"\tpush mul5\n" \
+	"\tcall\n" \
+	"\tpop\n"
+
+// program of batch/mul5: x <- x * 5 for input x
+#define MUL5_MAIN \
+	"\tpush mul5\n" \
+	"\tcall\n" \
+	"\thlt\n"
+
+// bodies may have labels with number of body (%d twice)
+static const bench_op_t bench_ops[] = {
+	{"op/push,pop",  "\tpush 1\n\tpop\n", "", 0},
+	{"op/inc,dec",   "\tinc\n\tdec\n", "", 0},
+	{"op/load",      "\tpush -1\n\tload\n\tpop\n", "", 0},
+	{"op/stor",      "\tpush -1\n\tpush -1\n\tstor\n", "", 0},
+	{"op/add",       "\tpush 7\n\tpush 3\n\tadd\n\tpop\n", "", 0},
+	{"op/sub",       "\tpush 7\n\tpush 3\n\tsub\n\tpop\n", "", 0},
+	{"op/mul",       "\tpush 7\n\tpush 3\n\tmul\n\tpop\n", "", 0},
+	{"op/div",       "\tpush 7\n\tpush 3\n\tdiv\n\tpop\n", "", 0},
+	{"op/mod",       "\tpush 7\n\tpush 3\n\tmod\n\tpop\n", "", 0},
+	{"op/shr",       "\tpush 7\n\tpush 3\n\tshr\n\tpop\n", "", 0},
+	{"op/shl",       "\tpush 7\n\tpush 3\n\tshl\n\tpop\n", "", 0},
+	{"op/xor",       "\tpush 7\n\tpush 3\n\txor\n\tpop\n", "", 0},
+	{"op/and",       "\tpush 7\n\tpush 3\n\tand\n\tpop\n", "", 0},
+	{"op/or",        "\tpush 7\n\tpush 3\n\tor\n\tpop\n", "", 0},
+	{"op/not",       "\tpush 7\n\tnot\n\tpop\n", "", 0},
+	{"op/allc",      "\tpush 1\n\tallc\n\tpop\n", "", 0},
+	{"op/jmp",       "\tpush j_%d\n\tjmp\nlabl j_%d\n", "", 0},
+	{"op/jg",        "\tpush 1\n\tpush 0\n\tpush j_%d\n\tjg\nlabl j_%d\n", "", 0},
+	{"op/je",        "\tpush 1\n\tpush 1\n\tpush j_%d\n\tje\nlabl j_%d\n", "", 0},
+	{"op/jne",       "\tpush 1\n\tpush 0\n\tpush j_%d\n\tjne\nlabl j_%d\n", "", 0},
+	{"op/jl",        "\tpush 0\n\tpush 1\n\tpush j_%d\n\tjl\nlabl j_%d\n", "", 0},
+	{"op/jle",       "\tpush 1\n\tpush 1\n\tpush j_%d\n\tjle\nlabl j_%d\n", "", 0},
+	{"op/jge",       "\tpush 1\n\tpush 1\n\tpush j_%d\n\tjge\nlabl j_%d\n", "", 0},
+	{"op/call,jmp",  "\tpush ret\n\tcall\n", "labl ret\n\tjmp\n", 1},
+	{"op/fcal,ret",  "\tpush proc\n\tfcal\n", "labl proc\n\tret\n", 1},
+	// dispatch: loop without body and sequence of different opcodes
+	{"dispatch/loop",  "", "", 0},
+	{"dispatch/mixed", "\tpush -1\n\tload\n\tinc\n\tpush 3\n\txor\n\tpush -1\n\tpush -1\n\tstor\n\tpop\n\tpush 1\n\tallc\n\tnot\n\tpop\n", "", 0},
+};
+
+static int gen_op(bench_t *bench, const bench_op_t *op);
+static int gen_fact(bench_t *bench);
+static int gen_caesar(bench_t *bench);
+static int gen_mul5(bench_t *bench);
+static int run_bench(bench_t *bench, int native, int *first);
+static int run_batch(const char *name, const char *source, int32_t size, int *first);
+static int run_batches(const char *name, cvm_ctx_t *ctx, int32_t **inputs, int32_t *tops, int threads, int *first);
+static int run_asm(int *first);
+static char *gen_source(int blocks, size_t *size, int *lines);
+static int count_insns(const char *source);
+static char *concat(const char *format, ...);
+static int selected(const char *name, int argc, char *argv[]);
+static double now(void);
+
+int main(int argc, char *argv[]) {
+	bench_t bench;
+	int count, first, retcode;
+
+	count = sizeof(bench_ops) / sizeof(bench_ops[0]);
+	first = 1;
+	retcode = 0;
+
+	// begin object
+	printf("{\n");
+#ifdef CVM_KERNEL_JIT
+	printf("\t\"native\": true,\n");
+#else
+	printf("\t\"native\": false,\n");
+#endif
+	printf("\t\"runs\": %d,\n", BENCH_RUNS);
+	printf("\t\"benchmarks\": [\n");
+
+	for (int i = 0; i < count + 3 && retcode == 0; ++i) {
+		if (i < count) {
+			bench.name = bench_ops[i].name;
+		} else {
+			bench.name = (i == count) ? "example/fact12" :
+				(i == count+1) ? "example/caesar1m" : "example/mul5";
+		}
+		if (!selected(bench.name, argc, argv)) {
+			continue;
+		}
+
+		if (i < count) {
+			retcode = gen_op(&bench, &bench_ops[i]);
+		} else if (i == count) {
+			retcode = gen_fact(&bench);
+		} else if (i == count+1) {
+			retcode = gen_caesar(&bench);
+		} else {
+			retcode = gen_mul5(&bench);
+		}
+		if (retcode != 0) {
+			fprintf(stderr, "error: generate %s\n", bench.name);
+			break;
+		}
+
+		// cvm_ctx_run (native code if it is built) and run_for
+		retcode = run_bench(&bench, 1, &first);
+		if (retcode == 0) {
+			retcode = run_bench(&bench, 0, &first);
+		}
+		free(bench.source);
+		free(bench.input);
+	}
+
+	// one input of x or of caesar over BENCH_ASIZE elements
+	if (retcode == 0 && selected("batch/mul5", argc, argv)) {
+		retcode = run_batch("batch/mul5", MUL5_MAIN MUL5_FUNC, 1, &first);
+	}
+	if (retcode == 0 && selected("batch/caesar", argc, argv)) {
+		retcode = run_batch("batch/caesar", CAESAR_MAIN CAESAR_HEAD CAESAR_CHECK CAESAR_BODY CAESAR_END,
+			BENCH_ASIZE+2, &first);
+	}
+
+	if (retcode == 0 && selected("asm/generated", argc, argv)) {
+		retcode = run_asm(&first);
+	}
+
+	printf("\n\t]\n");
+	printf("}\n");
+	return retcode;
+}
+
+// loop of BENCH_UNROLL bodies of op
+static int gen_op(bench_t *bench, const bench_op_t *op) {
+	char body[256 * BENCH_UNROLL];
+	int64_t iter;
+	size_t len;
+	int n;
+
+	len = 0;
+	for (int i = 0; i < BENCH_UNROLL; ++i) {
+		n = snprintf(body + len, sizeof(body) - len, op->body, i, i);
+		if (n < 0 || (size_t)n >= sizeof(body) - len) {
+			return 1;
+		}
+		len += n;
+	}
+
+	iter = BENCH_UNROLL * (count_insns(op->body) + op->extra) + count_insns(LOOP_TAIL) - 1;
+	n = (int)(BENCH_INSNS / iter);
+
+	bench->source = concat(LOOP_HEAD "%s" LOOP_TAIL "%s", n, body, op->tail);
+	bench->insns = 1 + n * iter + 1;
+	bench->input = NULL;
+	bench->stack = CVM_KERNEL_SMEMORY;
+	bench->result = 0;
+	return bench->source == NULL;
+}
+
+// loop of calls of fact(12)
+static int gen_fact(bench_t *bench) {
+	int64_t call;
+	int n;
+
+	call = count_insns(FACT_CALL FACT_HEAD FACT_END) +
+		12 * count_insns(FACT_CHECK) + 11 * count_insns(FACT_BODY);
+	n = (int)(BENCH_INSNS / (call + count_insns(LOOP_TAIL) - 1));
+
+	bench->source = concat(LOOP_HEAD FACT_CALL LOOP_TAIL FACT_HEAD FACT_CHECK FACT_BODY FACT_END, n);
+	bench->insns = 1 + n * (call + count_insns(LOOP_TAIL) - 1) + 1;
+	bench->input = NULL;
+	bench->stack = CVM_KERNEL_SMEMORY;
+	bench->result = 0;
+	return bench->source == NULL;
+}
+
+// one call of caesar for BENCH_CAESAR elements given by input
+static int gen_caesar(bench_t *bench) {
+	int32_t *input;
+	int n;
+
+	n = BENCH_CAESAR;
+	input = (int32_t*)malloc(sizeof(int32_t)*(n+3));
+	if (input == NULL) {
+		return 1;
+	}
+
+	input[0] = n+2;
+	for (int i = 1; i <= n; ++i) {
+		input[i] = i % 26;
+	}
+	input[n+1] = 9;
+	input[n+2] = n;
+
+	bench->source = concat(CAESAR_MAIN CAESAR_HEAD CAESAR_CHECK CAESAR_BODY CAESAR_END);
+	bench->insns = count_insns(CAESAR_MAIN CAESAR_HEAD CAESAR_END) +
+		(int64_t)(n+1) * count_insns(CAESAR_CHECK) + (int64_t)n * count_insns(CAESAR_BODY);
+	bench->input = input;
+	bench->stack = 2 * n;
+	bench->result = n;
+	if (bench->source == NULL) {
+		free(input);
+		return 1;
+	}
+	return 0;
+}
+
+// loop of calls of mul5(10)
+static int gen_mul5(bench_t *bench) {
+	int64_t iter;
+	int n;
+
+	iter = count_insns(MUL5_CALL MUL5_FUNC LOOP_TAIL) - 1;
+	n = (int)(BENCH_INSNS / iter);
+
+	bench->source = concat(LOOP_HEAD MUL5_CALL LOOP_TAIL MUL5_FUNC, n);
+	bench->insns = 1 + n * iter + 1;
+	bench->input = NULL;
+	bench->stack = CVM_KERNEL_SMEMORY;
+	bench->result = 0;
+	return bench->source == NULL;
+}
+
+// best time of BENCH_RUNS runs by cvm_ctx_run (native = 1) or
+// by interpreter of cvm_ctx_run_for, result is checked
+static int run_bench(bench_t *bench, int native, int *first) {
+	int32_t empty[1] = {0};
+	int32_t output[2], *result;
+	double best, start, elapsed;
+	uint8_t *code;
+	size_t codelen;
+	cvm_ctx_t *ctx;
+	int retcode;
+
+	if (cvm_compile_mem(bench->source, strlen(bench->source), &code, &codelen) != 0) {
+		fprintf(stderr, "error: compile %s\n", bench->name);
+		return 2;
+	}
+
+	ctx = cvm_ctx_new();
+	if (ctx == NULL || cvm_ctx_limits(ctx, CVM_KERNEL_CMEMORY, bench->stack) != 0 ||
+		cvm_ctx_load(ctx, code, (int32_t)codelen) != 0) {
+		fprintf(stderr, "error: load %s\n", bench->name);
+		cvm_ctx_free(ctx);
+		free(code);
+		return 3;
+	}
+	free(code);
+
+	best = 0;
+	for (int i = 0; i < BENCH_RUNS; ++i) {
+		start = now();
+		if (native) {
+			retcode = cvm_ctx_run_buf(ctx, output, 1, bench->input ? bench->input : empty);
+		} else {
+			retcode = cvm_ctx_run_for(ctx, &result, bench->input ? bench->input : empty, INT64_MAX);
+		}
+		elapsed = now() - start;
+
+		if (retcode == 0 && !native) {
+			output[0] = result[0];
+			output[1] = result[1];
+			free(result);
+		}
+		if (retcode != 0 || output[0] < 1 || output[1] != bench->result) {
+			fprintf(stderr, "error: run %s (%d)\n", bench->name, retcode);
+			cvm_ctx_free(ctx);
+			return 4;
+		}
+
+		if (i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+	}
+	cvm_ctx_free(ctx);
+
+	printf("%s\t\t{\"name\": \"%s\", \"mode\": \"%s\", \"instructions\": %lld, \"seconds\": %.6f, "
+		"\"insns_per_sec\": %.0f, \"ns_per_insn\": %.3f}",
+		*first ? "" : ",\n",
+		bench->name,
+		native ? "run" : "run_for",
+		(long long)bench->insns,
+		best,
+		bench->insns / best,
+		best * 1e9 / bench->insns);
+	fflush(stdout);
+	*first = 0;
+	return 0;
+}
+
+// BENCH_BATCH inputs of size values (last two are key and size of
+// caesar) by cvm_ctx_run in loop, by cvm_ctx_run_batch on one thread
+// and on all processors, tops of stacks of batches are checked
+static int run_batch(const char *name, const char *source, int32_t size, int *first) {
+	int32_t **inputs, *tops, *output;
+	uint8_t *code;
+	size_t codelen;
+	cvm_ctx_t *ctx;
+	int retcode, threads;
+
+	if (cvm_compile_mem(source, strlen(source), &code, &codelen) != 0) {
+		fprintf(stderr, "error: compile %s\n", name);
+		return 2;
+	}
+
+	ctx = cvm_ctx_new();
+	if (ctx == NULL || cvm_ctx_load(ctx, code, (int32_t)codelen) != 0) {
+		fprintf(stderr, "error: load %s\n", name);
+		cvm_ctx_free(ctx);
+		free(code);
+		return 3;
+	}
+	free(code);
+
+	inputs = (int32_t**)calloc(BENCH_BATCH, sizeof(int32_t*));
+	tops = (int32_t*)malloc(sizeof(int32_t)*BENCH_BATCH);
+	retcode = (inputs == NULL || tops == NULL);
+	for (int32_t i = 0; retcode == 0 && i < BENCH_BATCH; ++i) {
+		inputs[i] = (int32_t*)malloc(sizeof(int32_t)*(size+1));
+		if (inputs[i] == NULL) {
+			retcode = 1;
+			break;
+		}
+		inputs[i][0] = size;
+		for (int32_t j = 1; j <= size; ++j) {
+			inputs[i][j] = (i + j) % 26;
+		}
+		if (size > 2) {
+			inputs[i][size-1] = i % 26;
+			inputs[i][size] = size-2;
+		}
+	}
+	if (retcode != 0) {
+		fprintf(stderr, "error: generate %s\n", name);
+		retcode = 1;
+	}
+
+	// tops of cvm_ctx_run are results of batches
+	for (int32_t i = 0; retcode == 0 && i < BENCH_BATCH; ++i) {
+		if (cvm_ctx_run(ctx, &output, inputs[i]) != 0 || output[0] < 1) {
+			fprintf(stderr, "error: run %s\n", name);
+			retcode = 4;
+			break;
+		}
+		tops[i] = output[output[0]];
+		free(output);
+	}
+
+	threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (retcode == 0) {
+		retcode = run_batches(name, ctx, inputs, tops, 0, first);
+	}
+	if (retcode == 0) {
+		retcode = run_batches(name, ctx, inputs, tops, 1, first);
+	}
+	if (retcode == 0 && threads > 1) {
+		retcode = run_batches(name, ctx, inputs, tops, threads, first);
+	}
+
+	for (int32_t i = 0; inputs != NULL && i < BENCH_BATCH; ++i) {
+		free(inputs[i]);
+	}
+	free(inputs);
+	free(tops);
+	cvm_ctx_free(ctx);
+	return retcode;
+}
+
+// best time of BENCH_RUNS runs of all inputs by cvm_ctx_run
+// in loop (threads = 0) or by cvm_ctx_run_batch on threads
+static int run_batches(const char *name, cvm_ctx_t *ctx, int32_t **inputs, int32_t *tops, int threads, int *first) {
+	int32_t **outputs, *retcodes;
+	double best, start, elapsed;
+	int failed;
+
+	outputs = (int32_t**)malloc(sizeof(int32_t*)*BENCH_BATCH);
+	retcodes = (int32_t*)malloc(sizeof(int32_t)*BENCH_BATCH);
+	if (outputs == NULL || retcodes == NULL) {
+		free(outputs);
+		free(retcodes);
+		return 1;
+	}
+
+	best = 0;
+	failed = 0;
+	for (int i = 0; i < BENCH_RUNS && !failed; ++i) {
+		start = now();
+		if (threads == 0) {
+			for (int32_t j = 0; j < BENCH_BATCH; ++j) {
+				retcodes[j] = cvm_ctx_run(ctx, &outputs[j], inputs[j]);
+			}
+		} else {
+			failed = cvm_ctx_run_batch(ctx, outputs, inputs, retcodes, BENCH_BATCH, threads);
+		}
+		elapsed = now() - start;
+
+		for (int32_t j = 0; j < BENCH_BATCH; ++j) {
+			if (retcodes[j] != 0 || outputs[j][0] < 1 || outputs[j][outputs[j][0]] != tops[j]) {
+				failed = 1;
+			}
+			if (retcodes[j] == 0) {
+				free(outputs[j]);
+			}
+		}
+
+		if (i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+	}
+	free(outputs);
+	free(retcodes);
+
+	if (failed) {
+		fprintf(stderr, "error: run %s (%d threads)\n", name, threads);
+		return 4;
+	}
+
+	printf("%s\t\t{\"name\": \"%s\", \"mode\": \"%s\", \"threads\": %d, \"inputs\": %d, \"seconds\": %.6f, "
+		"\"inputs_per_sec\": %.0f, \"ns_per_input\": %.1f}",
+		*first ? "" : ",\n",
+		name,
+		threads ? "batch" : "run",
+		threads ? threads : 1,
+		BENCH_BATCH,
+		best,
+		BENCH_BATCH / best,
+		best * 1e9 / BENCH_BATCH);
+	fflush(stdout);
+	*first = 0;
+	return 0;
+}
+
+// throughput of assembler: lines per second of cvm_compile_mem
+// on generated source with labels, forward jumps and comments
+static int run_asm(int *first) {
+	double best, start, elapsed;
+	size_t size, outlen;
+	uint8_t *output;
+	char *source;
+	int lines;
+
+	source = gen_source(BENCH_BLOCKS, &size, &lines);
+	if (source == NULL) {
+		fprintf(stderr, "error: generate source\n");
+		return 1;
+	}
+
+	best = 0;
+	for (int i = 0; i < BENCH_RUNS; ++i) {
+		start = now();
+		if (cvm_compile_mem(source, size, &output, &outlen) != 0) {
+			fprintf(stderr, "error: compile code\n");
+			free(source);
+			return 2;
+		}
+		elapsed = now() - start;
+		free(output);
+		if (i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	printf("%s\t\t{\"name\": \"asm/generated\", \"lines\": %d, \"bytes\": %zu, \"code\": %zu, "
+		"\"seconds\": %.6f, \"lines_per_sec\": %.0f, \"mb_per_sec\": %.1f}",
+		*first ? "" : ",\n",
+		lines,
+		size,
+		outlen,
+		best,
+		lines / best,
+		size / 1e6 / best);
+	*first = 0;
+
+	free(source);
+	return 0;
+}
+
+// every block has its label, jumps to its own label and to next block
+static char *gen_source(int blocks, size_t *size, int *lines) {
+	static const char *block =
+		"labl block_%d\n"
+		"\t; B <- B + %d\n"
+		"\tpush -1\n"
+		"\tload\n"
+		"\tpush %d\n"
+		"\tadd\n"
+		"\tpush -1\n"
+		"\tpush -2\n"
+		"\tstor\n"
+		"\tpop\n"
+		"\tpush -1\n"
+		"\tload\n"
+		"\tpush 100\n"
+		"\tpush block_%d\n"
+		"\tJG\n"
+		"\tpush block_%d\n"
+		"\tjmp\n";
+	size_t cap, len;
+	char *source;
+	int n;
+
+	cap = (size_t)blocks * 256;
+	source = (char*)malloc(cap);
+	if (source == NULL) {
+		return NULL;
+	}
+
+	len = 0;
+	for (int i = 0; i < blocks; ++i) {
+		n = snprintf(source + len, cap - len, block, i, i % 7, i % 7, i, (i + 1) % blocks);
+		if (n < 0 || (size_t)n >= cap - len) {
+			free(source);
+			return NULL;
+		}
+		len += n;
+	}
+
+	*size = len;
+	*lines = blocks * 17;
+	return source;
+}
+
+// lines of source which are not labels, comments or empty
+static int count_insns(const char *source) {
+	const char *line;
+	int count;
+
+	count = 0;
+	for (line = source; *line != '\0'; ) {
+		while (*line == '\t' || *line == ' ') {
+			++line;
+		}
+		if (*line != '\n' && *line != ';' && strncmp(line, "labl", 4) != 0) {
+			++count;
+		}
+		line = strchr(line, '\n');
+		if (line == NULL) {
+			break;
+		}
+		++line;
+	}
+
+	return count;
+}
+
+// string made by format in memory allocated by malloc
+static char *concat(const char *format, ...) {
+	va_list args;
+	char *string;
+	int n;
+
+	va_start(args, format);
+	n = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (n < 0) {
+		return NULL;
+	}
+
+	string = (char*)malloc(n+1);
+	if (string == NULL) {
+		return NULL;
+	}
+
+	va_start(args, format);
+	vsnprintf(string, n+1, format, args);
+	va_end(args);
+	return string;
+}
+
+// benchmark is run if there are no names or one of them is its prefix
+static int selected(const char *name, int argc, char *argv[]) {
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp(name, argv[i], strlen(argv[i])) == 0) {
+			return 1;
+		}
+	}
+	return argc < 2;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -1,13 +1,36 @@
+// sysconf for number of processors
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <dlfcn.h>
+#include <unistd.h>
 
 #include "cvmkernel.h"
 
-#define CVM_HELP    "help"
-#define CVM_RUN     "run"
-#define CVM_BUILD   "build"
-#define CVM_OUTFILE "main.bcd"
+#define CVM_HELP     "help"
+#define CVM_RUN      "run"
+#define CVM_BUILD    "build"
+#define CVM_INFO     "info"
+#define CVM_AOT      "aot"
+#define CVM_BATCH    "batch"
+#define CVM_PROFILE  "profile"
+#define CVM_THREADS  "-j"
+#define CVM_NATIVE   "--native"
+#define CVM_SNAPSHOT "--snapshot-after"
+#define CVM_RESTORE  "--from-snapshot"
+#define CVM_OPTIMIZE "-O"
+#define CVM_DEBUG    "-g"
+#define CVM_CODE     "--code"
+#define CVM_STACK    "--stack"
+#define CVM_OUTFILE  "main.bcd"
+#define CVM_AOTFILE  "main.c"
+#define CVM_SNAPFILE "main.snap"
+#define CVM_FOLDFILE "main.folded"
+#define CVM_HOTSPOTS 16
+#define CVM_STDIN    "-"
 
 enum {
     ERR_NONE    = 0x00,
@@ -18,6 +41,11 @@ enum {
     ERR_COMPILE = 0x05,
     ERR_MEMSIZ  = 0x06,
     ERR_RUN     = 0x07,
+    ERR_NATIVE  = 0x08,
+    ERR_RESTORE = 0x09,
+    ERR_LABEL   = 0x0A,
+    ERR_LIMIT   = 0x0B,
+    ERR_PROFILE = 0x0C,
 };
 
 static const char *errors[] = {
@@ -29,16 +57,52 @@ static const char *errors[] = {
     [ERR_COMPILE] = "compile code",
     [ERR_MEMSIZ]  = "memory size overflow",
     [ERR_RUN]     = "run byte code",
+    [ERR_NATIVE]  = "load native code",
+    [ERR_RESTORE] = "load snapshot",
+    [ERR_LABEL]   = "unknown label",
+    [ERR_LIMIT]   = "invalid value of --code or --stack",
+    [ERR_PROFILE] = "profiler is not built",
 };
 
-static int file_build(const char *outputf, const char *inputf);
+static int file_build(const char *outputf, const char *inputf, int optimize, int debug);
 static int file_run(const char *filename, int **output, int *input);
+static int file_info(const char *filename);
+static int file_aot(const char *outputf, const char *inputf);
+static int file_native(const char *filename, int **output, int *input);
+static int file_snapshot(const char *outputf, const char *inputf, const char *label, int **output, int *input);
+static int file_restore(const char *inputf, int **output, int *input);
+static int file_load(cvm_ctx_t *ctx, const char *inputf);
+static cvm_ctx_t *new_context(void);
+static int read_limits(int *argc, const char *argv[]);
+static int read_limit(const char *arg, int *limit);
+
+static int file_batch(const char *inputf, int threads);
+static int read_inputs(FILE *input, int ***inputs, int *count);
+
+#ifdef CVM_KERNEL_PROFILE
+static int file_profile(const char *outputf, const char *tracef, const char *inputf, int *input);
+static void write_stacks(FILE *output, cvm_ctx_t *ctx, cvm_profile_t *profile);
+static void write_trace(FILE *output, cvm_ctx_t *ctx, cvm_profile_t *profile);
+static void print_place(cvm_ctx_t *ctx, int mi, char *place, size_t size);
+static int sort_counts(const uint64_t *counts, int size, int *index, int n);
+static const char *opcode_name(int opcode);
+static void print_json_profile(cvm_ctx_t *ctx, cvm_profile_t *profile, const char *outputf, const char *tracef, int *output, int retcode);
+#endif
 
 static void print_json_failed(int retcode);
 static void print_json_success(int *array, int size);
+static void print_json_snapshot(const char *outputf);
+static void print_json_info(cvm_ctx_t *ctx);
+
+// limits of contexts by --code and --stack
+static int code_limit = CVM_KERNEL_CMEMORY;
+static int stack_limit = CVM_KERNEL_SMEMORY;
 
 int main(int argc, char const *argv[]) {
     const char *outfile;
+#ifdef CVM_KERNEL_PROFILE
+    const char *tracefile;
+#endif
 
     int input[argc];
     int *output;
@@ -46,16 +110,44 @@ int main(int argc, char const *argv[]) {
 
     int is_build;
     int is_run;
+    int is_info;
+    int is_aot;
+    int is_native;
+    int is_snapshot;
+    int is_restore;
+    int is_batch;
+    int is_profile;
+    int optimize;
+    int debug;
+    int threads;
+    int first;
 
     outfile = CVM_OUTFILE;
+    optimize = 0;
+    debug = 0;
     retcode = ERR_COMMAND;
 
     // cvm help
     if (argc == 2 && strcmp(argv[1], CVM_HELP) == 0) {
-        printf("help: \n\t$ cvm [build|run] <infile> {if build [-o <outfile>]}\n");
+        printf("help: \n\t$ cvm [build|run|info|aot] <infile> {if build|aot [-o <outfile>]}\n");
+        printf("\t$ cvm build <infile|-> [-O] [-g] [-o <outfile>]\n");
+        printf("\t$ cvm run --native <infile.so> [args]\n");
+        printf("\t$ cvm run --snapshot-after <label|addr> <infile> [-o <snapfile>] [args]\n");
+        printf("\t$ cvm run --from-snapshot <snapfile> [args]\n");
+        printf("\t$ cvm batch <infile> [-j <threads>] < <args lines>\n");
+        printf("\t$ cvm profile <infile> [-o <stacksfile>] [--trace <tracefile>] [args]\n");
+        printf("\t$ cvm <command> [--code <bytes>] [--stack <values>] ...\n");
         return ERR_NONE;
     }
 
+    // --code bytes, --stack values
+    retcode = read_limits(&argc, argv);
+    if (retcode != ERR_NONE) {
+        fprintf(stderr, "error: %s\n", errors[retcode]);
+        return retcode;
+    }
+    retcode = ERR_COMMAND;
+
     // cvm | cvm undefined
     if (argc < 3) {
         fprintf(stderr, "error: %s\n", errors[ERR_ARGLEN]);
@@ -64,34 +156,73 @@ int main(int argc, char const *argv[]) {
 
     is_build = strcmp(argv[1], CVM_BUILD) == 0;
     is_run = strcmp(argv[1], CVM_RUN) == 0;
+    is_info = strcmp(argv[1], CVM_INFO) == 0;
+    is_aot = strcmp(argv[1], CVM_AOT) == 0;
+    is_native = is_run && strcmp(argv[2], CVM_NATIVE) == 0;
+    is_snapshot = is_run && strcmp(argv[2], CVM_SNAPSHOT) == 0;
+    is_restore = is_run && strcmp(argv[2], CVM_RESTORE) == 0;
+    is_batch = strcmp(argv[1], CVM_BATCH) == 0;
+    is_profile = strcmp(argv[1], CVM_PROFILE) == 0;
 
     // cvm undefined x
-    if (!is_build && !is_run) {
+    if (!is_build && !is_run && !is_info && !is_aot && !is_batch && !is_profile) {
         fprintf(stderr, "error: %s\n", errors[ERR_COMMAND]);
         return ERR_COMMAND;
     }
 
-    // cvm build file [-o outfile]
+    // cvm build file [-O] [-g] [-o outfile]
     if (is_build) {
-        if (argc == 5 && strcmp(argv[3], "-o") == 0) {
-            outfile = argv[4];
+        for (int i = 3; i < argc; ++i) {
+            if (strcmp(argv[i], CVM_OPTIMIZE) == 0) {
+                optimize = 1;
+            } else if (strcmp(argv[i], CVM_DEBUG) == 0) {
+                debug = 1;
+            } else if (i+1 < argc && strcmp(argv[i], "-o") == 0) {
+                outfile = argv[++i];
+            }
         }
 
-        retcode = file_build(outfile, argv[2]);
+        retcode = file_build(outfile, argv[2], optimize, debug);
         if (retcode != ERR_NONE) {
             fprintf(stderr, "error: %s\n", errors[retcode]);
         }
     }
 
+    // cvm run --native file.so [args]
+    // cvm run --from-snapshot snapfile [args]
+    // cvm run --snapshot-after label file [-o snapfile] [args]
+    first = 3 + is_native + is_restore + 2*is_snapshot;
+    if (is_run && argc < first) {
+        fprintf(stderr, "error: %s\n", errors[ERR_ARGLEN]);
+        return ERR_ARGLEN;
+    }
+    if (is_snapshot) {
+        outfile = CVM_SNAPFILE;
+        if (first+1 < argc && strcmp(argv[first], "-o") == 0) {
+            outfile = argv[first+1];
+            first += 2;
+        }
+    }
+
     // cvm run file [args]
     if (is_run) {
-        input[0] = argc-3;
+        input[0] = argc-first;
         for (int i = 0; i < input[0]; ++i) {
-            input[i+1] = atoi(argv[i+3]);
+            input[i+1] = atoi(argv[i+first]);
         }
 
-    	retcode = file_run(argv[2], &output, input);
-    	if (retcode == ERR_NONE) {
+        if (is_native) {
+            retcode = file_native(argv[3], &output, input);
+        } else if (is_snapshot) {
+            retcode = file_snapshot(outfile, argv[4], argv[3], &output, input);
+        } else if (is_restore) {
+            retcode = file_restore(argv[3], &output, input);
+        } else {
+            retcode = file_run(argv[2], &output, input);
+        }
+        if (retcode == ERR_NONE && output == NULL) {
+            print_json_snapshot(outfile);
+        } else if (retcode == ERR_NONE) {
             print_json_success(output+1, output[0]);
             free(output);
     	} else {
@@ -99,27 +230,109 @@ int main(int argc, char const *argv[]) {
         }
     }
 
+    // cvm info file
+    if (is_info) {
+        retcode = file_info(argv[2]);
+        if (retcode != ERR_NONE) {
+            print_json_failed(retcode);
+        }
+    }
+
+    // cvm aot file [-o outfile]
+    if (is_aot) {
+        outfile = CVM_AOTFILE;
+        if (argc == 5 && strcmp(argv[3], "-o") == 0) {
+            outfile = argv[4];
+        }
+
+        retcode = file_aot(outfile, argv[2]);
+        if (retcode != ERR_NONE) {
+            fprintf(stderr, "error: %s\n", errors[retcode]);
+        }
+    }
+
+    // cvm batch file [-j threads] < args
+    if (is_batch) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (argc == 5 && strcmp(argv[3], CVM_THREADS) == 0) {
+            threads = atoi(argv[4]);
+        }
+
+        retcode = file_batch(argv[2], threads);
+        if (retcode != ERR_NONE) {
+            print_json_failed(retcode);
+        }
+    }
+
+    // cvm profile file [-o stacksfile] [--trace tracefile] [args]
+    if (is_profile) {
+    #ifdef CVM_KERNEL_PROFILE
+        outfile = CVM_FOLDFILE;
+        tracefile = NULL;
+        first = 3;
+        while (first+1 < argc) {
+            if (strcmp(argv[first], "-o") == 0) {
+                outfile = argv[first+1];
+            } else if (strcmp(argv[first], "--trace") == 0) {
+                tracefile = argv[first+1];
+            } else {
+                break;
+            }
+            first += 2;
+        }
+
+        input[0] = argc-first;
+        for (int i = 0; i < input[0]; ++i) {
+            input[i+1] = atoi(argv[i+first]);
+        }
+
+        // profile is printed also if program fails
+        retcode = file_profile(outfile, tracefile, argv[2], input);
+        if (retcode != ERR_NONE && retcode != ERR_RUN) {
+            print_json_failed(retcode);
+        }
+    #else
+        retcode = ERR_PROFILE;
+        print_json_failed(retcode);
+    #endif
+    }
+
     return retcode;
 }
 
-static int file_build(const char *outputf, const char *inputf) {
+static int file_build(const char *outputf, const char *inputf, int optimize, int debug) {
     FILE *output, *input;
     int retcode;
 
-    input = fopen(inputf, "r");
+    // "-" is standard input
+    if (strcmp(inputf, CVM_STDIN) == 0) {
+        input = stdin;
+    } else {
+        input = fopen(inputf, "r");
+    }
     if (input == NULL) {
         return ERR_INOPEN;
     }
 
     output = fopen(outputf, "wb");
     if (output == NULL) {
-        fclose(input);
+        if (input != stdin) {
+            fclose(input);
+        }
         return ERR_OUTOPEN;
     }
 
-    retcode = cvm_compile(output, input);
+    if (debug) {
+        retcode = cvm_compile_debug(output, input, optimize);
+    } else if (optimize) {
+        retcode = cvm_compile_opt(output, input);
+    } else {
+        retcode = cvm_compile(output, input);
+    }
 
-    fclose(input);
+    if (input != stdin) {
+        fclose(input);
+    }
     fclose(output);
     
     if (retcode != ERR_NONE) {
@@ -130,33 +343,23 @@ static int file_build(const char *outputf, const char *inputf) {
 }
 
 static int file_run(const char *inputf, int **output, int *input) {
-    unsigned char *memory;
-    int fsize, retcode;
-    FILE *reader;
+    cvm_ctx_t *ctx;
+    int retcode;
 
-    reader = fopen(inputf, "rb");
-    if (reader == NULL) {
-        return ERR_INOPEN;
+    ctx = new_context();
+    if (ctx == NULL) {
+        return ERR_MEMSIZ;
     }
 
-    // read size of code
-    fseek(reader, 0, SEEK_END);
-    fsize = ftell(reader);
-    fseek(reader, 0, SEEK_SET);
-    
-    // insert code into memory
-    memory = (unsigned char*)malloc(sizeof(char)*fsize);
-    fread(memory, fsize, sizeof(char), reader);
-    fclose(reader);
-    
-    fsize = cvm_load(memory, fsize);
-    free(memory);
-    if (fsize < 0) {
-        return ERR_MEMSIZ;
+    retcode = file_load(ctx, inputf);
+    if (retcode != ERR_NONE) {
+        cvm_ctx_free(ctx);
+        return retcode;
     }
     
     // run code in memory
-    retcode = cvm_run(output, input);
+    retcode = cvm_ctx_run(ctx, output, input);
+    cvm_ctx_free(ctx);
     if (retcode != ERR_NONE) {
         return ERR_RUN;
     }
@@ -164,6 +367,607 @@ static int file_run(const char *inputf, int **output, int *input) {
     return ERR_NONE;
 }
 
+static int file_info(const char *inputf) {
+    cvm_ctx_t *ctx;
+    int retcode;
+
+    ctx = new_context();
+    if (ctx == NULL) {
+        return ERR_MEMSIZ;
+    }
+
+    retcode = file_load(ctx, inputf);
+    if (retcode == ERR_NONE) {
+        print_json_info(ctx);
+    }
+
+    cvm_ctx_free(ctx);
+    return retcode;
+}
+
+static int file_aot(const char *outputf, const char *inputf) {
+    cvm_ctx_t *ctx;
+    FILE *output;
+    int retcode;
+
+    ctx = new_context();
+    if (ctx == NULL) {
+        return ERR_MEMSIZ;
+    }
+
+    retcode = file_load(ctx, inputf);
+    if (retcode != ERR_NONE) {
+        cvm_ctx_free(ctx);
+        return retcode;
+    }
+
+    output = fopen(outputf, "w");
+    if (output == NULL) {
+        cvm_ctx_free(ctx);
+        return ERR_OUTOPEN;
+    }
+
+    retcode = cvm_ctx_aot(ctx, output);
+
+    fclose(output);
+    cvm_ctx_free(ctx);
+
+    if (retcode != ERR_NONE) {
+        return ERR_OUTOPEN;
+    }
+
+    return ERR_NONE;
+}
+
+static int file_native(const char *inputf, int **output, int *input) {
+    int (*run)(int **output, int *input);
+    char path[FILENAME_MAX];
+    void *handle;
+    int retcode;
+
+    // dlopen searches name without '/' in system directories
+    snprintf(path, sizeof(path), "%s%s", strchr(inputf, '/') ? "" : "./", inputf);
+
+    handle = dlopen(path, RTLD_NOW);
+    if (handle == NULL) {
+        return ERR_NATIVE;
+    }
+
+    *(void**)&run = dlsym(handle, CVM_AOT_SYMBOL);
+    if (run == NULL) {
+        dlclose(handle);
+        return ERR_NATIVE;
+    }
+
+    retcode = run(output, input);
+    dlclose(handle);
+
+    if (retcode != ERR_NONE) {
+        return ERR_RUN;
+    }
+
+    return ERR_NONE;
+}
+
+// run program up to label (name or address) and save it to snapshot
+// (output is NULL) or give its result if program ends before
+static int file_snapshot(const char *outputf, const char *inputf, const char *label, int **output, int *input) {
+    cvm_ctx_t *ctx;
+    FILE *writer;
+    int retcode, mi;
+
+    ctx = new_context();
+    if (ctx == NULL) {
+        return ERR_MEMSIZ;
+    }
+
+    retcode = file_load(ctx, inputf);
+    if (retcode != ERR_NONE) {
+        cvm_ctx_free(ctx);
+        return retcode;
+    }
+
+    // names of labels are kept by container of cvm build
+    if (isdigit((unsigned char)label[0])) {
+        mi = atoi(label);
+    } else {
+        mi = cvm_ctx_symbol(ctx, label);
+    }
+    if (mi < 0) {
+        cvm_ctx_free(ctx);
+        return ERR_LABEL;
+    }
+
+    retcode = cvm_ctx_run_until(ctx, output, input, mi);
+    if (retcode != CVM_YIELD) {
+        cvm_ctx_free(ctx);
+        return (retcode == ERR_NONE) ? ERR_NONE : ERR_RUN;
+    }
+
+    writer = fopen(outputf, "wb");
+    if (writer == NULL) {
+        cvm_ctx_free(ctx);
+        return ERR_OUTOPEN;
+    }
+
+    retcode = cvm_ctx_snapshot(ctx, writer);
+    fclose(writer);
+    cvm_ctx_free(ctx);
+    if (retcode != ERR_NONE) {
+        return ERR_OUTOPEN;
+    }
+
+    *output = NULL;
+    return ERR_NONE;
+}
+
+// continue program of snapshot with arguments pushed on its stack,
+// they shift values addressed from top of the restored stack
+static int file_restore(const char *inputf, int **output, int *input) {
+    cvm_ctx_t *ctx;
+    int retcode;
+
+    ctx = new_context();
+    if (ctx == NULL) {
+        return ERR_MEMSIZ;
+    }
+
+    retcode = cvm_ctx_restore_file(ctx, inputf, input);
+    if (retcode != ERR_NONE) {
+        cvm_ctx_free(ctx);
+        return (retcode == 2) ? ERR_INOPEN : ERR_RESTORE;
+    }
+
+    retcode = cvm_ctx_resume(ctx, output, INT64_MAX);
+    cvm_ctx_free(ctx);
+    if (retcode != ERR_NONE) {
+        return ERR_RUN;
+    }
+
+    return ERR_NONE;
+}
+
+// run program for every line of standard input (numbers
+// of line are its arguments) and print results in order of lines
+static int file_batch(const char *inputf, int threads) {
+    cvm_ctx_t *ctx;
+    int **inputs, **outputs;
+    int *retcodes;
+    int count, retcode;
+
+    ctx = new_context();
+    if (ctx == NULL) {
+        return ERR_MEMSIZ;
+    }
+
+    retcode = file_load(ctx, inputf);
+    if (retcode != ERR_NONE) {
+        cvm_ctx_free(ctx);
+        return retcode;
+    }
+
+    retcode = read_inputs(stdin, &inputs, &count);
+    if (retcode != ERR_NONE) {
+        cvm_ctx_free(ctx);
+        return retcode;
+    }
+
+    outputs = (int**)malloc(sizeof(int*)*(count+1));
+    retcodes = (int*)malloc(sizeof(int)*(count+1));
+    if (outputs == NULL || retcodes == NULL) {
+        retcode = ERR_MEMSIZ;
+    } else if (cvm_ctx_run_batch(ctx, outputs, inputs, retcodes, count, threads) != 0) {
+        retcode = ERR_RUN;
+    }
+    cvm_ctx_free(ctx);
+
+    if (retcode == ERR_NONE) {
+        // begin object
+        printf("{\n");
+
+        // results:array
+        printf("\t\"results\": [\n");
+        for (int i = 0; i < count; ++i) {
+            printf("\t\t{");
+            if (retcodes[i] == ERR_NONE) {
+                printf("\"result\": [");
+                for (int j = 1; j <= outputs[i][0]; ++j) {
+                    printf("%d%s", outputs[i][j], (j == outputs[i][0]) ? "" : ",");
+                }
+                printf("], \"return\": 0");
+                free(outputs[i]);
+            } else {
+                printf("\"error\": \"%s\", \"return\": %d", errors[ERR_RUN], ERR_RUN);
+            }
+            printf("}%s\n", (i == count-1) ? "" : ",");
+        }
+        printf("\t],\n");
+
+        // return:int
+        printf("\t\"return\": 0\n");
+
+        // end object
+        printf("}\n");
+    }
+
+    for (int i = 0; i < count; ++i) {
+        free(inputs[i]);
+    }
+    free(inputs);
+    free(outputs);
+    free(retcodes);
+
+    return retcode;
+}
+
+// read lines of numbers as inputs of cvm_run: {count, numbers...}
+static int read_inputs(FILE *input, int ***inputs, int *count) {
+    char number[32];
+    int **lines, *line;
+    void *temp;
+    int nlines, caplines, size, cap, len, ch;
+
+    lines = NULL;
+    nlines = caplines = 0;
+    line = NULL;
+    size = cap = len = 0;
+
+    while ((ch = getc(input)) != EOF || line != NULL) {
+        // begin of line
+        if (line == NULL) {
+            size = 0;
+            cap = 8;
+            line = (int*)malloc(sizeof(int)*cap);
+            if (line == NULL) {
+                break;
+            }
+        }
+
+        // end of number
+        if (len > 0 && (ch == EOF || isspace(ch))) {
+            number[len] = '\0';
+            len = 0;
+            if (size+1 == cap) {
+                temp = realloc(line, sizeof(int)*cap*2);
+                if (temp == NULL) {
+                    break;
+                }
+                line = (int*)temp;
+                cap *= 2;
+            }
+            line[++size] = atoi(number);
+        } else if (ch != EOF && !isspace(ch) && len < (int)sizeof(number)-1) {
+            number[len++] = (char)ch;
+        }
+
+        // end of line
+        if (ch == EOF || ch == '\n') {
+            if (nlines == caplines) {
+                caplines = caplines ? caplines * 2 : 64;
+                temp = realloc(lines, sizeof(int*)*caplines);
+                if (temp == NULL) {
+                    break;
+                }
+                lines = (int**)temp;
+            }
+            line[0] = size;
+            lines[nlines++] = line;
+            line = NULL;
+        }
+    }
+
+    // out of memory
+    if (line != NULL || ch != EOF) {
+        free(line);
+        for (int i = 0; i < nlines; ++i) {
+            free(lines[i]);
+        }
+        free(lines);
+        return ERR_MEMSIZ;
+    }
+
+    *inputs = lines;
+    *count = nlines;
+    return ERR_NONE;
+}
+
+// context with limits of command line
+static cvm_ctx_t *new_context(void) {
+    cvm_ctx_t *ctx;
+
+    ctx = cvm_ctx_new();
+    if (ctx != NULL && cvm_ctx_limits(ctx, code_limit, stack_limit) != 0) {
+        cvm_ctx_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+// take options of limits out of arguments
+static int read_limits(int *argc, const char *argv[]) {
+    int size, retcode;
+
+    size = 1;
+    retcode = ERR_NONE;
+    for (int i = 1; i < *argc; ++i) {
+        if (i+1 < *argc && strcmp(argv[i], CVM_CODE) == 0) {
+            retcode |= read_limit(argv[++i], &code_limit);
+        } else if (i+1 < *argc && strcmp(argv[i], CVM_STACK) == 0) {
+            retcode |= read_limit(argv[++i], &stack_limit);
+        } else {
+            argv[size++] = argv[i];
+        }
+    }
+    *argc = size;
+
+    return (retcode != ERR_NONE) ? ERR_LIMIT : ERR_NONE;
+}
+
+// limit is decimal number in 1 .. CVM_KERNEL_LIMIT
+static int read_limit(const char *arg, int *limit) {
+    char *end;
+    long value;
+
+    value = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || value <= 0 || value > CVM_KERNEL_LIMIT) {
+        return ERR_LIMIT;
+    }
+
+    *limit = (int)value;
+    return ERR_NONE;
+}
+
+// program is run from mapped file without copy of its bytes
+static int file_load(cvm_ctx_t *ctx, const char *inputf) {
+    int retcode;
+
+    retcode = cvm_ctx_load_file(ctx, inputf);
+    if (retcode == 2) {
+        return ERR_INOPEN;
+    }
+    if (retcode != ERR_NONE) {
+        return ERR_MEMSIZ;
+    }
+
+    return ERR_NONE;
+}
+
+#ifdef CVM_KERNEL_PROFILE
+// run program with profiler, print hot spots and write
+// calls in collapsed format of flame graphs to outputf,
+// timeline of calls is written to tracef if it is not NULL
+static int file_profile(const char *outputf, const char *tracef, const char *inputf, int *input) {
+    cvm_profile_t profile;
+    cvm_ctx_t *ctx;
+    FILE *writer, *tracer;
+    int *output;
+    int retcode;
+
+    ctx = new_context();
+    if (ctx == NULL) {
+        return ERR_MEMSIZ;
+    }
+
+    retcode = file_load(ctx, inputf);
+    if (retcode != ERR_NONE) {
+        cvm_ctx_free(ctx);
+        return retcode;
+    }
+
+    if (tracef != NULL) {
+        retcode = cvm_ctx_trace(ctx, &profile, &output, input);
+    } else {
+        retcode = cvm_ctx_profile(ctx, &profile, &output, input);
+    }
+    if (profile.addrs == NULL) {
+        cvm_ctx_free(ctx);
+        return ERR_MEMSIZ;
+    }
+    retcode = (retcode == ERR_NONE) ? ERR_NONE : ERR_RUN;
+
+    writer = fopen(outputf, "w");
+    tracer = (tracef != NULL) ? fopen(tracef, "w") : NULL;
+    if (writer == NULL || (tracef != NULL && tracer == NULL)) {
+        if (writer != NULL) {
+            fclose(writer);
+        }
+        if (tracer != NULL) {
+            fclose(tracer);
+        }
+        if (retcode == ERR_NONE) {
+            free(output);
+        }
+        cvm_profile_free(&profile);
+        cvm_ctx_free(ctx);
+        return ERR_OUTOPEN;
+    }
+    write_stacks(writer, ctx, &profile);
+    fclose(writer);
+    if (tracer != NULL) {
+        write_trace(tracer, ctx, &profile);
+        fclose(tracer);
+    }
+
+    print_json_profile(ctx, &profile, outputf, tracef, (retcode == ERR_NONE) ? output : NULL, retcode);
+
+    if (retcode == ERR_NONE) {
+        free(output);
+    }
+    cvm_profile_free(&profile);
+    cvm_ctx_free(ctx);
+    return retcode;
+}
+
+// one line for every frame: names of functions from program
+// to frame separated by ';' and instructions done in frame
+static void write_stacks(FILE *output, cvm_ctx_t *ctx, cvm_profile_t *profile) {
+    int path[profile->nframes];
+    char name[64];
+    int depth;
+
+    for (int i = 0; i < profile->nframes; ++i) {
+        if (profile->frames[i].count == 0) {
+            continue;
+        }
+
+        depth = 0;
+        for (int fi = i; fi >= 0; fi = profile->frames[fi].parent) {
+            path[depth++] = fi;
+        }
+
+        for (int j = depth-1; j >= 0; --j) {
+            print_place(ctx, profile->frames[path[j]].addr, name, sizeof(name));
+            fprintf(output, "%s%c", name, (j == 0) ? ' ' : ';');
+        }
+        fprintf(output, "%llu\n", (unsigned long long)profile->frames[i].count);
+    }
+}
+
+// events of trace in Chrome trace event format: function is
+// begun (B) and ended (E) at time in microseconds
+static void write_trace(FILE *output, cvm_ctx_t *ctx, cvm_profile_t *profile) {
+    cvm_event_t *event;
+    char name[64];
+
+    fprintf(output, "{\"traceEvents\": [\n");
+    for (int i = 0; i < profile->nevents; ++i) {
+        event = &profile->events[i];
+        print_place(ctx, event->addr, name, sizeof(name));
+        fprintf(output, "\t{\"name\": \"%s\", \"ph\": \"%s\", \"ts\": %llu.%03u, \"pid\": 1, \"tid\": 1}%s\n",
+            name,
+            event->enter ? "B" : "E",
+            (unsigned long long)(event->time / 1000),
+            (unsigned)(event->time % 1000),
+            (i == profile->nevents-1) ? "" : ",");
+    }
+    fprintf(output, "], \"displayTimeUnit\": \"ns\"}\n");
+}
+
+// byte of code as label, label+offset or number
+static void print_place(cvm_ctx_t *ctx, int mi, char *place, size_t size) {
+    char name[48];
+    int addr;
+
+    addr = cvm_ctx_label(ctx, mi, name, sizeof(name));
+    if (addr < 0) {
+        snprintf(place, size, "%d", mi);
+    } else if (addr == mi) {
+        snprintf(place, size, "%s", name);
+    } else {
+        snprintf(place, size, "%s+%d", name, mi - addr);
+    }
+}
+
+// indexes of the n largest counts in decreasing order, return their number
+static int sort_counts(const uint64_t *counts, int size, int *index, int n) {
+    int k, count;
+
+    count = 0;
+    for (int i = 0; i < size; ++i) {
+        if (counts[i] == 0 || (count == n && counts[index[n-1]] >= counts[i])) {
+            continue;
+        }
+
+        // insert i after indexes with larger counts
+        k = (count < n) ? count++ : n-1;
+        for (; k > 0 && counts[index[k-1]] < counts[i]; --k) {
+            index[k] = index[k-1];
+        }
+        index[k] = i;
+    }
+
+    return count;
+}
+
+// mnemonic of opcode of profile
+static const char *opcode_name(int opcode) {
+    const char *name;
+
+    name = cvm_opcode_name((uint8_t)opcode);
+    return (name != NULL) ? name : "undefined";
+}
+
+static void print_json_profile(cvm_ctx_t *ctx, cvm_profile_t *profile, const char *outputf, const char *tracef, int *output, int retcode) {
+    int index[256], hot[CVM_HOTSPOTS];
+    uint64_t total;
+    char place[64];
+    int count;
+
+    total = 0;
+    for (int i = 0; i < 256; ++i) {
+        total += profile->insns[i];
+    }
+
+    // begin object
+    printf("{\n");
+
+    // result:array or error:string
+    if (output != NULL) {
+        printf("\t\"result\": [");
+        for (int i = 1; i <= output[0]; ++i) {
+            printf("%d%s", output[i], (i == output[0]) ? "" : ",");
+        }
+        printf("],\n");
+    } else {
+        printf("\t\"error\": \"%s\",\n", errors[retcode]);
+    }
+
+    // instructions:int
+    printf("\t\"instructions\": %llu,\n", (unsigned long long)total);
+
+    // handlers:array by time
+    count = sort_counts(profile->ticks, 256, index, 256);
+    printf("\t\"handlers\": [\n");
+    for (int i = 0; i < count; ++i) {
+        printf("\t\t{\"handler\": \"%s\", \"runs\": %llu, \"%s\": %llu}%s\n",
+            opcode_name(index[i]),
+            (unsigned long long)profile->execs[index[i]],
+            profile->tsc ? "cycles" : "ns",
+            (unsigned long long)profile->ticks[index[i]],
+            (i == count-1) ? "" : ",");
+    }
+    printf("\t],\n");
+
+    // opcodes:array by instructions
+    count = sort_counts(profile->insns, 256, index, 256);
+    printf("\t\"opcodes\": [\n");
+    for (int i = 0; i < count; ++i) {
+        printf("\t\t{\"opcode\": \"%s\", \"count\": %llu}%s\n",
+            opcode_name(index[i]),
+            (unsigned long long)profile->insns[index[i]],
+            (i == count-1) ? "" : ",");
+    }
+    printf("\t],\n");
+
+    // hotspots:array by instructions at byte
+    count = sort_counts(profile->addrs, profile->size+1, hot, CVM_HOTSPOTS);
+    printf("\t\"hotspots\": [\n");
+    for (int i = 0; i < count; ++i) {
+        print_place(ctx, hot[i], place, sizeof(place));
+        printf("\t\t{\"addr\": %d, \"place\": \"%s\", \"line\": %d, \"count\": %llu}%s\n",
+            hot[i], place, cvm_ctx_line(ctx, hot[i]),
+            (unsigned long long)profile->addrs[hot[i]],
+            (i == count-1) ? "" : ",");
+    }
+    printf("\t],\n");
+
+    // stacks:string
+    printf("\t\"stacks\": \"%s\",\n", outputf);
+
+    // trace:string
+    if (tracef != NULL) {
+        printf("\t\"trace\": \"%s\",\n", tracef);
+    }
+
+    // return:int
+    printf("\t\"return\": %d\n", retcode);
+
+    // end object
+    printf("}\n");
+}
+#endif
+
 static void print_json_failed(int retcode) {
     // begin object
     printf("{\n");
@@ -195,3 +999,58 @@ static void print_json_success(int *array, int size) {
     // end object
     printf("}\n");
 }
+
+static void print_json_snapshot(const char *outputf) {
+    // begin object
+    printf("{\n");
+
+    // snapshot:string
+    printf("\t\"snapshot\": \"%s\",\n", outputf);
+
+    // return:int
+    printf("\t\"return\": 0\n");
+
+    // end object
+    printf("}\n");
+}
+
+static void print_json_info(cvm_ctx_t *ctx) {
+    static const char *names[CVM_FUSE_COUNT] = {
+        [CVM_FUSE_LOAD]  = "push,load",
+        [CVM_FUSE_STOR]  = "push,push,stor",
+        [CVM_FUSE_STORP] = "push,push,stor,pop",
+        [CVM_FUSE_JMP]   = "push,jmp",
+        [CVM_FUSE_CALL]  = "push,call",
+        [CVM_FUSE_JCC]   = "push,jcc",
+        [CVM_FUSE_FCAL]  = "push,fcal",
+    };
+    int32_t fused[CVM_FUSE_COUNT];
+    int32_t minargs, maxdepth;
+    int verified;
+
+    cvm_ctx_fused(ctx, fused);
+    verified = cvm_ctx_verified(ctx, &minargs, &maxdepth);
+
+    // begin object
+    printf("{\n");
+
+    // fused:object
+    printf("\t\"fused\": {\n");
+    for (int i = 0; i < CVM_FUSE_COUNT; ++i) {
+        printf("\t\t\"%s\": %d%s\n", names[i], fused[i], (i == CVM_FUSE_COUNT-1) ? "" : ",");
+    }
+    printf("\t},\n");
+
+    // verified:object
+    printf("\t\"verified\": {\n");
+    printf("\t\t\"status\": %s,\n", verified ? "true" : "false");
+    printf("\t\t\"min_args\": %d,\n", minargs);
+    printf("\t\t\"max_depth\": %d\n", maxdepth);
+    printf("\t},\n");
+
+    // return:int
+    printf("\t\"return\": 0\n");
+
+    // end object
+    printf("}\n");
+}
@@ -1,3 +1,6 @@
+// mmap and MAP_ANON for JIT and cvm_load_file
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -6,16 +9,124 @@
 
 #include "cvmkernel.h"
 
-#include "typeslib/hashtab.h"
-#include "typeslib/stack.h"
+// JIT needs x86-64 host with mmap (-DCVM_KERNEL_NO_JIT turns it off).
+#if defined(CVM_KERNEL_JIT) && (defined(CVM_KERNEL_NO_JIT) || \
+	!(defined(__GNUC__) && defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))))
+	#undef CVM_KERNEL_JIT
+#endif
 
-// Number of all instructions.
-#ifdef CVM_KERNEL_IAPPEND
-	#define CVM_KERNEL_ISIZE 31
+#ifdef CVM_KERNEL_JIT
+	#include <stdarg.h>
+	#include <stddef.h>
+	#include <sys/mman.h>
+#endif
+
+// Pool of threads of cvm_run_batch needs POSIX threads.
+#if defined(CVM_KERNEL_THREADS) && !(defined(__unix__) || defined(__APPLE__))
+	#undef CVM_KERNEL_THREADS
+#endif
+
+#ifdef CVM_KERNEL_THREADS
+	#include <pthread.h>
+#endif
+
+// Mapping of files by cvm_load_file needs POSIX.
+#if defined(CVM_KERNEL_MMAP) && !(defined(__unix__) || defined(__APPLE__))
+	#undef CVM_KERNEL_MMAP
+#endif
+
+#ifdef CVM_KERNEL_PROFILE
+	#include <time.h>
+#endif
+
+#ifdef CVM_KERNEL_MMAP
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+#include "typeslib/symtab.h"
+
+// Handlers of cvm_ctx_run are inlined, so that
+// the operand stack of the virtual machine stays in registers.
+#ifdef __GNUC__
+	#define VM_INLINE static inline __attribute__((always_inline))
 #else
-	#define CVM_KERNEL_ISIZE 14
+	#define VM_INLINE static inline
 #endif
 
+// Threaded dispatch needs labels as values (GNU C extension),
+// -DCVM_KERNEL_NO_THREADED gives switch dispatch.
+#if defined(CVM_KERNEL_THREADED) && (defined(CVM_KERNEL_NO_THREADED) || !defined(__GNUC__))
+	#undef CVM_KERNEL_THREADED
+#endif
+
+// Size of table of mnemonics, see MNEM_SLOT.
+#define CVM_KERNEL_MSIZE 64
+
+// Jobs of cvm_ctx_run_batch taken by worker at once.
+#define CVM_KERNEL_BCHUNK 16
+
+// Depth of tree of calls of profiler, deeper calls
+// are counted in frame of their caller.
+#define CVM_KERNEL_PDEPTH 64
+
+// Events of trace, calls after them are not traced.
+#define CVM_KERNEL_PEVENTS (1 << 22)
+
+// Time of profiler is read by rdtsc on x86-64.
+#if defined(__GNUC__) && defined(__x86_64__)
+	#define CVM_KERNEL_PTSC 1
+#else
+	#define CVM_KERNEL_PTSC 0
+#endif
+
+// Container of cvm_compile: magic, version, flags, then sections
+// (id, big-endian size, data) and FNV-1a checksum of all bytes before it.
+#define CVM_KERNEL_BMAGIC   "CVMB"
+#define CVM_KERNEL_FNVBASIS 2166136261u
+#define CVM_KERNEL_BVERSION 1
+#define CVM_KERNEL_BHEADER  6
+// flag of code with additional instructions (CVM_KERNEL_IAPPEND)
+#define CVM_KERNEL_BAPPEND  0x01
+// sections: byte code, result of verifier, states of verifier
+// before jump targets, addresses of labels and lines of source
+#define CVM_KERNEL_BCODE    1
+#define CVM_KERNEL_BINFO    2
+#define CVM_KERNEL_BSTATES  3
+#define CVM_KERNEL_BSYMBOLS 4
+#define CVM_KERNEL_BLINES   5
+
+// Snapshot of stopped program: magic, version, then big-endian
+// cmused, mi, size, code memory and values of stack from the bottom,
+// depth and frames of fcal (return address, base) from version 2,
+// FNV-1a checksum of all bytes before it from version 3.
+#define CVM_KERNEL_SMAGIC   "CVMS"
+#define CVM_KERNEL_SVERSION 3
+#define CVM_KERNEL_SHEADER  17
+
+// Result of native code which stopped at jump inside of instruction,
+// of native code which needs more stack and more frames of fcal.
+#define CVM_KERNEL_JEXIT  (-1)
+#define CVM_KERNEL_JGROW  (-2)
+#define CVM_KERNEL_JFRAME (-3)
+
+// First capacity of stack, it is doubled when stack is full.
+#define CVM_KERNEL_SGROW 256
+
+// Instructions decoded from one instruction of byte code at most
+// (compact instructions are decoded to push and next instructions).
+#define CVM_KERNEL_DECODE 3
+
+// Instructions of the longest superinstruction (push; push; stor; pop).
+#define CVM_KERNEL_FUSED 4
+
+// Number of known values of stack tracked by verifier
+// and position of value which depends on inputs.
+#define CVM_KERNEL_VCONST 16
+#define CVM_KERNEL_VNPOS  INT32_MIN
+
 // N - number
 // C - char
 enum {
@@ -39,9 +150,17 @@ enum {
 	C_LOAD = 0x1B, // 1 byte
 	C_CALL = 0x1C, // 1 byte
 	C_HLT  = 0x1D, // 1 byte
+	// 0xNC
+	// COMPACT INSTRUCTIONS (6)
+	C_PSH8 = 0x1E, // 2 bytes: push int8
+	C_PS16 = 0x1F, // 3 bytes: push int16
+	C_LODI = 0x2A, // 2 bytes: push int8; load
+	C_STRI = 0x2B, // 3 bytes: push int8; push int8; stor
+	C_JMPI = 0x2C, // 3 bytes: push int16; jmp
+	C_JGI  = 0x2D, // 3 bytes: push int16; jg
 #ifdef CVM_KERNEL_IAPPEND
 	// 0xCN 
-	// ADD INSTRUCTIONS (17)
+	// ADD INSTRUCTIONS (21)
 	C_ADD  = 0xA0, // 1 byte
 	C_SUB  = 0xB0, // 1 byte
 	C_MUL  = 0xC0, // 1 byte
@@ -59,502 +178,5630 @@ enum {
 	C_JLE  = 0xC2, // 1 byte
 	C_JGE  = 0xD2, // 1 byte
 	C_ALLC = 0xE2, // 1 byte
+	C_FCAL = 0xF2, // 1 byte
+	C_RET  = 0xA3, // 1 byte
+	C_FLD  = 0xB3, // 1 byte
+	C_FST  = 0xC3, // 1 byte
+	// 0xCN
+	// COMPACT ADD INSTRUCTIONS (5)
+	C_JEI  = 0xD3, // 3 bytes: push int16; je
+	C_JLI  = 0xE3, // 3 bytes: push int16; jl
+	C_JNEI = 0xF3, // 3 bytes: push int16; jne
+	C_JLEI = 0xA4, // 3 bytes: push int16; jle
+	C_JGEI = 0xB4, // 3 bytes: push int16; jge
+#endif
+	// 0x3N
+	// INTERNAL INSTRUCTIONS (decoded code only)
+	C_SYNC = 0x30, // continue at byte offset
+	C_PLOD = 0x31, // push; load
+	C_PSTR = 0x32, // push; push; stor
+	C_PSTP = 0x33, // push; push; stor; pop
+	C_PJMP = 0x34, // push; jmp
+	C_PCAL = 0x35, // push; call
+	C_PJG  = 0x36, // push; jg
+#ifdef CVM_KERNEL_IAPPEND
+	C_PJE  = 0x37, // push; je
+	C_PJL  = 0x38, // push; jl
+	C_PJNE = 0x39, // push; jne
+	C_PJLE = 0x3A, // push; jle
+	C_PJGE = 0x3B, // push; jge
+	C_PFCL = 0x3C, // push; fcal
+#endif
+};
+
+// instruction read by cvm_compile: label is pseudo instruction
+// with arg = number of label, push of label has label >= 0,
+// width is 1 or 2 bytes of argument of push8/push16 (0 for push),
+// line of source is counted from 1
+typedef struct asminsn_t {
+	uint8_t opcode;
+	uint8_t width;
+	int32_t arg;
+	int32_t label;
+	int32_t line;
+} asminsn_t;
+
+// label of cvm_compile, push of name without labl
+// is push of number num = atoi(name), name is len
+// chars of names of code, addr is set by compile_emit
+typedef struct asmlabel_t {
+	int defined;
+	int32_t num;
+	int32_t name;
+	int32_t len;
+	int32_t addr;
+} asmlabel_t;
+
+typedef struct asmcode_t {
+	asminsn_t *insn;
+	int32_t size;
+	int32_t cap;
+	asmlabel_t *labels;
+	int32_t nlabels;
+	int32_t caplabels;
+	char *names;
+	int32_t nnames;
+	int32_t capnames;
+} asmcode_t;
+
+// word of line of source: len chars from ptr
+typedef struct asmword_t {
+	const char *ptr;
+	int len;
+} asmword_t;
+
+// source of cvm_compile: file or memory
+typedef struct asmsrc_t {
+	FILE *input;
+	const char *data;
+	size_t size;
+	size_t pos;
+} asmsrc_t;
+
+// bytes of container: next byte at ptr and left bytes after it
+typedef struct bcdbuf_t {
+	uint8_t *ptr;
+	uint32_t left;
+} bcdbuf_t;
+
+// sections of container found by bcd_parse, ptr = NULL if there is no section
+typedef struct bcdfile_t {
+	uint8_t flags;
+	bcdbuf_t code;
+	bcdbuf_t info;
+	bcdbuf_t states;
+	bcdbuf_t symbols;
+	bcdbuf_t lines;
+} bcdfile_t;
+
+// instruction decoded by cvm_ctx_load
+typedef struct cvm_insn_t {
+	uint8_t opcode;
+	int32_t arg;
+} cvm_insn_t;
+
+// frame of fcal: return address and size of stack after call
+typedef struct vmframe_t {
+	int32_t ret;
+	int32_t base;
+} vmframe_t;
+
+// memory of stack: values[0] is written by push into empty
+// stack, values[1] ... values[cap] hold values, cap grows up to max;
+// frames[0] ... frames[capframes-1] are frames of fcal (at most max)
+typedef struct vmmemory_t {
+	int32_t *values;
+	int32_t cap;
+	int32_t max;
+	vmframe_t *frames;
+	int32_t capframes;
+} vmmemory_t;
+
+// operand stack of cvm_ctx_run: last value is cached in tos,
+// other values are base[0] ... base[size-2], size <= cap
+// (cap and base are changed when stack grows in memory);
+// depth frames of fcal are in memory, fld/fst address values
+// from base[frame] (size of stack after the last fcal or 0)
+typedef struct vmstack_t {
+	int32_t *base;
+	int32_t size;
+	int32_t tos;
+	int32_t cap;
+	int32_t frame;
+	int32_t depth;
+	vmmemory_t *memory;
+} vmstack_t;
+
+// instructions left for cvm_ctx_run_for, instruction where
+// cvm_ctx_run_until stops (or NULL) and byte where program stopped
+typedef struct vmfuel_t {
+	int64_t left;
+	const cvm_insn_t *stop;
+	int32_t mi;
+} vmfuel_t;
+
+#ifdef CVM_KERNEL_PROFILE
+// call followed by profiler: frame of caller, return address,
+// called address and 1 if its entry is in trace
+typedef struct vmcall_t {
+	int32_t frame;
+	int32_t ret;
+	int32_t addr;
+	int traced;
+} vmcall_t;
+
+// state of profiler of vm_loop_profile: calls[ncalls-1] is the last
+// call, frame is frame of current function, ret is return address if
+// the last instruction is call (or -1), last is time when handler
+// of opcode started;
+// trace has events of cvm_ctx_trace, leaves of open calls are not
+// in trace yet, start is time of start of program
+typedef struct vmprofile_t {
+	cvm_profile_t *out;
+	vmcall_t *calls;
+	int32_t ncalls;
+	int32_t capcalls;
+	int32_t capframes;
+	int trace;
+	int32_t capevents;
+	int32_t nopen;
+	uint64_t start;
+	int32_t frame;
+	int32_t ret;
+	uint8_t opcode;
+	uint64_t last;
+} vmprofile_t;
+#endif
+
+typedef struct cvm_ctx_t {
+	// code memory holds at most cmax bytes
+	int32_t cmax;
+	int32_t cmused;
+	int32_t ncode;
+	// code memory is copy of program or its bytes in file
+	// mapped by cvm_ctx_load_file (then map != NULL)
+	uint8_t *memory;
+	uint8_t *map;
+	size_t mapsize;
+	// code[slots[mi]] is instruction at byte mi or slots[mi] = -1,
+	// bytes[ci] is byte of instruction which holds instruction ci
+	cvm_insn_t *code;
+	int32_t *slots;
+	int32_t *bytes;
+	int32_t fused[CVM_FUSE_COUNT];
+	// program passed verify_code and runs without checks
+	// for input of minargs ... stack.max-maxdepth values
+	int verified;
+	int32_t minargs;
+	int32_t maxdepth;
+	// native code made by jit_code or NULL
+	uint8_t *jit;
+	size_t jitsize;
+	// program stopped by cvm_ctx_run_for continues at byte runmi
+	// with runsize values in stack and rundepth frames of fcal
+	// (runmi = -1 if there is no program)
+	int32_t runmi;
+	int32_t runsize;
+	int32_t rundepth;
+	int runverified;
+	// sections of labels and lines of container or NULL
+	uint8_t *symbols;
+	uint32_t nsymbols;
+	uint8_t *lines;
+	uint32_t nlines;
+	vmmemory_t stack;
+#ifdef CVM_KERNEL_PROFILE
+	// profiler of running vm_loop_profile
+	vmprofile_t *profile;
+#endif
+} cvm_ctx_t;
+
+// state of stack before instruction for verifier:
+// depth is counted over inputs of program (they are at -n ... -1)
+// or over frame of procedure of fcal which starts at instruction
+// proc (0 for program), consts are values of positions known
+// at load time
+typedef struct vstate_t {
+	int8_t seen;
+	int8_t queued;
+	// instruction is reached by jump
+	int8_t target;
+	int32_t proc;
+	int32_t depth;
+	int32_t nconst;
+	struct {
+		int32_t pos;
+		int32_t num;
+	} consts[CVM_KERNEL_VCONST];
+} vstate_t;
+
+// procedure which starts at instruction of verifier: values under
+// its frame which it takes, depth over frame after its ret (or
+// CVM_KERNEL_VNPOS) and the last fcal of it (previous are in
+// calls[] of verifier), fcal is checked again when they change
+typedef struct vproc_t {
+	int32_t minargs;
+	int32_t ret;
+	int32_t calls;
+} vproc_t;
+
+// table = 1 if states of jump targets are given by container,
+// ci is instruction which passes its state to next instructions,
+// procs[0] is program, maxdepth is depth of all frames
+typedef struct verifier_t {
+	cvm_ctx_t *ctx;
+	vstate_t *states;
+	vproc_t *procs;
+	int32_t *calls;
+	int table;
+	int32_t ci;
+	int32_t *work;
+	int32_t nwork;
+	int32_t maxdepth;
+} verifier_t;
+
+// jobs of cvm_ctx_run_batch, next is first job not taken by workers
+typedef struct batch_t {
+	cvm_ctx_t *ctx;
+	int32_t **outputs;
+	int32_t **inputs;
+	int32_t *retcodes;
+	int32_t njobs;
+	int32_t next;
+#ifdef CVM_KERNEL_THREADS
+	pthread_mutex_t lock;
+#endif
+} batch_t;
+
+#ifdef CVM_KERNEL_JIT
+	// jump to instruction ci at offset at of native code
+	typedef struct jitfix_t {
+		int32_t at;
+		int32_t ci;
+	} jitfix_t;
+
+	// native code of jit_code before it is copied to executable memory,
+	// native[ci] is offset of code of instruction ci, bytes[ci] is its
+	// byte in code memory and mi is byte of translated instruction
+	typedef struct jitbuf_t {
+		cvm_ctx_t *ctx;
+		uint8_t *data;
+		int32_t size;
+		int32_t cap;
+		int failed;
+		int32_t *native;
+		int32_t *bytes;
+		int32_t mi;
+		int32_t *cold;
+		int32_t ncold;
+		jitfix_t *fix;
+		int32_t nfix;
+		int32_t capfix;
+		// offsets of address of jump table, exits and error
+		int32_t table;
+		int32_t lhalt;
+		int32_t lerror;
+		int32_t lexit;
+		int32_t lgrow;
+		int32_t lframe;
+	} jitbuf_t;
+#endif
+
+// code of context without program
+static cvm_insn_t EMPTY = { .opcode = C_HLT };
+static int32_t EMPTYBYTES[1];
+
+// context used by cvm_load/cvm_run
+static cvm_ctx_t VM = {
+	.cmax = CVM_KERNEL_CMEMORY,
+	.code = &EMPTY,
+	.bytes = EMPTYBYTES,
+	.runmi = -1,
+	.stack = { .max = CVM_KERNEL_SMEMORY },
+};
+
+// mnemonic of at most 4 chars as number: "jg" -> 'j' | 'g' << 8
+#define MNEM_KEY(a, b, c, d) \
+	((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+
+// perfect hash: every mnemonic of bclist has its own slot
+#define MNEM_SLOT(key) ((uint32_t)((key) * 0x33D0B343u) >> 26)
+
+#define MNEM(op, a, b, c, d) \
+	[MNEM_SLOT(MNEM_KEY(a, b, c, d))] = { op, MNEM_KEY(a, b, c, d) }
+
+// instructions by slot of their mnemonics
+static const struct {
+	uint8_t bcode;
+	uint32_t key;
+} bclist[CVM_KERNEL_MSIZE] = {
+	// PSEUDO INSTRUCTIONS
+	MNEM(C_CMNT, ';', 0  , 0  , 0  ), // 0 arg
+	MNEM(C_LABL, 'l', 'a', 'b', 'l'), // 1 arg
+	// MAIN INSTRUCTIONS
+	MNEM(C_PUSH, 'p', 'u', 's', 'h'), // 1 arg, 0 stack
+	MNEM(C_POP,  'p', 'o', 'p', 0  ), // 0 arg, 1 stack
+	MNEM(C_INC,  'i', 'n', 'c', 0  ), // 0 arg, 1 stack
+	MNEM(C_DEC,  'd', 'e', 'c', 0  ), // 0 arg, 1 stack
+	MNEM(C_JMP,  'j', 'm', 'p', 0  ), // 0 arg, 1 stack
+	MNEM(C_JG,   'j', 'g', 0  , 0  ), // 0 arg, 3 stack
+	MNEM(C_STOR, 's', 't', 'o', 'r'), // 0 arg, 2 stack
+	MNEM(C_LOAD, 'l', 'o', 'a', 'd'), // 0 arg, 1 stack
+	MNEM(C_CALL, 'c', 'a', 'l', 'l'), // 0 arg, 1 stack
+	MNEM(C_HLT,  'h', 'l', 't', 0  ), // 0 arg, 0 stack
+#ifdef CVM_KERNEL_IAPPEND
+	// ADD INSTRUCTIONS
+	MNEM(C_ADD,  'a', 'd', 'd', 0  ), // 0 arg, 2 stack
+	MNEM(C_SUB,  's', 'u', 'b', 0  ), // 0 arg, 2 stack
+	MNEM(C_MUL,  'm', 'u', 'l', 0  ), // 0 arg, 2 stack
+	MNEM(C_DIV,  'd', 'i', 'v', 0  ), // 0 arg, 2 stack
+	MNEM(C_MOD,  'm', 'o', 'd', 0  ), // 0 arg, 2 stack
+	MNEM(C_SHR,  's', 'h', 'r', 0  ), // 0 arg, 2 stack
+	MNEM(C_SHL,  's', 'h', 'l', 0  ), // 0 arg, 2 stack
+	MNEM(C_XOR,  'x', 'o', 'r', 0  ), // 0 arg, 2 stack
+	MNEM(C_AND,  'a', 'n', 'd', 0  ), // 0 arg, 2 stack
+	MNEM(C_OR,   'o', 'r', 0  , 0  ), // 0 arg, 2 stack
+	MNEM(C_NOT,  'n', 'o', 't', 0  ), // 0 arg, 1 stack
+	MNEM(C_JE,   'j', 'e', 0  , 0  ), // 0 arg, 3 stack
+	MNEM(C_JL,   'j', 'l', 0  , 0  ), // 0 arg, 3 stack
+	MNEM(C_JNE,  'j', 'n', 'e', 0  ), // 0 arg, 3 stack
+	MNEM(C_JLE,  'j', 'l', 'e', 0  ), // 0 arg, 3 stack
+	MNEM(C_JGE,  'j', 'g', 'e', 0  ), // 0 arg, 3 stack
+	MNEM(C_ALLC, 'a', 'l', 'l', 'c'), // 0 arg, 1 stack
+	MNEM(C_FCAL, 'f', 'c', 'a', 'l'), // 0 arg, 1 stack
+	MNEM(C_RET,  'r', 'e', 't', 0  ), // 0 arg, 0 stack
+	MNEM(C_FLD,  'f', 'l', 'd', 0  ), // 0 arg, 1 stack
+	MNEM(C_FST,  'f', 's', 't', 0  ), // 0 arg, 2 stack
 #endif
 };
 
-static struct virtual_machine {
-	int32_t cmused;
-	uint8_t memory[CVM_KERNEL_CMEMORY];
-	struct {
-		uint8_t bcode;
-		char *mnem;
-	} bclist[CVM_KERNEL_ISIZE];
-} VM = {
-	.cmused = 0,
-	.bclist = {
-		// PSEUDO INSTRUCTIONS
-		{ C_CMNT, ";"    }, // 0 arg
-		{ C_LABL, "labl" }, // 1 arg
-		// NULL INSTRUCTIONS
-		{ C_VOID, "\0"   }, // 0 arg
-		{ C_UNDF, "\1"   }, // 0 arg
-		// MAIN INSTRUCTIONS
-		{ C_PUSH, "push" }, // 1 arg, 0 stack
-		{ C_POP,  "pop"  }, // 0 arg, 1 stack
-		{ C_INC,  "inc"  }, // 0 arg, 1 stack
-		{ C_DEC,  "dec"  }, // 0 arg, 1 stack
-		{ C_JMP,  "jmp"  }, // 0 arg, 1 stack
-		{ C_JG,   "jg"   }, // 0 arg, 3 stack
-		{ C_STOR, "stor" }, // 0 arg, 2 stack
-		{ C_LOAD, "load" }, // 0 arg, 1 stack
-		{ C_CALL, "call" }, // 0 arg, 1 stack
-		{ C_HLT,  "hlt"  }, // 0 arg, 0 stack
-#ifdef CVM_KERNEL_IAPPEND
-		// ADD INSTRUCTIONS
-		{ C_ADD,  "add"  }, // 0 arg, 2 stack
-		{ C_SUB,  "sub"  }, // 0 arg, 2 stack
-		{ C_MUL,  "mul"  }, // 0 arg, 2 stack
-		{ C_DIV,  "div"  }, // 0 arg, 2 stack
-		{ C_MOD,  "mod"  }, // 0 arg, 2 stack
-		{ C_SHR,  "shr"  }, // 0 arg, 2 stack
-		{ C_SHL,  "shl"  }, // 0 arg, 2 stack
-		{ C_XOR,  "xor"  }, // 0 arg, 2 stack
-		{ C_AND,  "and"  }, // 0 arg, 2 stack
-		{ C_OR,   "or"   }, // 0 arg, 2 stack
-		{ C_NOT,  "not"  }, // 0 arg, 1 stack
-		{ C_JE,   "je"   }, // 0 arg, 3 stack
-		{ C_JL,   "jl"   }, // 0 arg, 3 stack
-		{ C_JNE,  "jne"  }, // 0 arg, 3 stack
-		{ C_JLE,  "jle"  }, // 0 arg, 3 stack
-		{ C_JGE,  "jge"  }, // 0 arg, 3 stack
-		{ C_ALLC, "allc" }, // 0 arg, 1 stack
-#endif
-	},
-};
+static int compile_file(FILE *output, FILE *input, int optimize, int container);
+static int compile_code(asmsrc_t *source, int optimize, int container, uint8_t **output, size_t *outlen);
+static int compile_read(asmcode_t *code, symtab_t *symtab, asmsrc_t *source);
+static int32_t compile_label(asmcode_t *code, symtab_t *symtab, asmword_t *name);
+static int compile_emit(asmcode_t *code, int compact, uint8_t **output, size_t *outlen);
+static int32_t compile_encode(asmcode_t *code, uint8_t *width, int32_t i, uint8_t *bytes, int32_t *count);
+static int32_t compile_value(asmcode_t *code, asminsn_t *insn);
+static int32_t compile_arg(uint8_t *bytes, uint8_t opcode, int32_t num, int32_t n);
+static uint8_t compile_width(int32_t num);
+static uint8_t compile_imm(uint8_t opcode, uint8_t *width);
+static int bcd_build(asmcode_t *code, int debug, uint8_t **output, size_t *outlen);
+static int bcd_parse(bcdfile_t *bcd, uint8_t *memory, uint32_t msize);
+static int bcd_verify(cvm_ctx_t *ctx, bcdfile_t *bcd);
+static int bcd_symbols(bcdbuf_t symbols, uint32_t cmused);
+static uint32_t bcd_lines(asmcode_t *code, bcdbuf_t *buf);
+static void bcd_copy(bcdbuf_t section, uint8_t **ptr, uint32_t *size);
+static void bcd_put8(bcdbuf_t *buf, uint8_t num);
+static void bcd_put32(bcdbuf_t *buf, uint32_t num);
+static int bcd_get8(bcdbuf_t *buf, uint8_t *num);
+static int bcd_get32(bcdbuf_t *buf, uint32_t *num);
+static uint32_t bcd_checksum(const uint8_t *bytes, uint32_t size);
+static uint32_t bcd_hash(uint32_t hash, const uint8_t *bytes, size_t size);
+static int asmcode_append(asmcode_t *code, asminsn_t *insn);
+static int asmsrc_line(asmsrc_t *source, char *buffer, int size, asmword_t *line);
+static int optimize_code(asmcode_t *code);
+static int optimize_tail(asminsn_t *insn, int32_t *size);
+static int optimize_unop(uint8_t opcode, int32_t x, int32_t *result);
+static int optimize_binop(uint8_t opcode, int32_t y, int32_t x, int32_t *result);
+static int optimize_pushes(uint8_t opcode);
+static int optimize_identity(uint8_t opcode, int32_t x);
+static uint8_t read_opcode(asmword_t *line, asmword_t *arg, uint8_t *width);
+static uint8_t read_width(asmword_t *word);
+static void read_word(asmword_t *line, asmword_t *word);
+static uint8_t find_opcode(asmword_t *word);
+static void split_32bits_to_8bits(uint32_t num, uint8_t *bytes);
+
+static int word_is_number(asmword_t *word);
+static int32_t word_to_number(asmword_t *word);
+
+static int ctx_run(cvm_ctx_t *ctx, vmmemory_t *memory, int32_t **output, int32_t *input);
+static int vm_loop_checked(cvm_ctx_t *ctx, vmstack_t *vmstack, int32_t mi, vmfuel_t *fuel);
+static int vm_loop_fuel_checked(cvm_ctx_t *ctx, vmstack_t *vmstack, int32_t mi, vmfuel_t *fuel);
+VM_INLINE int ctx_exec(cvm_ctx_t *ctx, vmstack_t *stack, vmmemory_t *memory, int32_t *input);
+static int ctx_run_fuel(cvm_ctx_t *ctx, vmstack_t *stack, int32_t mi, int32_t **output, vmfuel_t *fuel);
+VM_INLINE int ctx_input(vmstack_t *stack, vmmemory_t *memory, int32_t *input);
+static void ctx_output(vmstack_t *stack, int32_t **output);
+static void ctx_output_buf(vmstack_t *stack, int32_t *output, int32_t cap);
+VM_INLINE int ctx_verified(cvm_ctx_t *ctx, vmstack_t *stack);
+VM_INLINE int ctx_room(cvm_ctx_t *ctx, vmstack_t *stack);
+static void batch_work(batch_t *batch, vmmemory_t *memory);
+static int batch_take(batch_t *batch, int32_t *begin, int32_t *end);
+#ifdef CVM_KERNEL_THREADS
+	static void *batch_thread(void *arg);
+#endif
+
+static int vmmemory_grow(vmmemory_t *memory, int32_t size);
+static int vmframes_grow(vmmemory_t *memory, int32_t depth);
+VM_INLINE int vmstack_grow(vmstack_t *stack, int32_t size);
+VM_INLINE void vmstack_push(vmstack_t *stack, int32_t num);
+VM_INLINE int32_t vmstack_pop(vmstack_t *stack);
+VM_INLINE void vmstack_set(vmstack_t *stack, int32_t index, int32_t num);
+
+#ifdef CVM_KERNEL_IAPPEND
+	VM_INLINE int exec_not(vmstack_t *stack, int checked);
+	VM_INLINE int exec_binop(vmstack_t *stack, uint8_t opcode, int checked);
+	VM_INLINE int exec_allc(vmstack_t *stack, int checked);
+#endif 
+
+static int ctx_init(cvm_ctx_t *ctx);
+static int ctx_alloc(cvm_ctx_t *ctx, int32_t msize, int copy);
+static void ctx_release(cvm_ctx_t *ctx);
+static int ctx_load(cvm_ctx_t *ctx, uint8_t *memory, int32_t msize, uint8_t *map, size_t mapsize);
+static int ctx_restore(cvm_ctx_t *ctx, uint8_t *memory, size_t msize, int32_t *input, uint8_t *map, size_t mapsize);
+static void snap_write(FILE *output, const uint8_t *bytes, size_t size, uint32_t *hash);
+static int ctx_decode(cvm_ctx_t *ctx, uint8_t *memory, int32_t msize, uint8_t *map, size_t mapsize);
+static int32_t decode_insn(cvm_ctx_t *ctx, int32_t mi, cvm_insn_t *insn, int32_t *count);
+static int32_t decode_arg(cvm_ctx_t *ctx, int32_t mi, int32_t n);
+static uint8_t decode_jump(uint8_t opcode);
+static void verify_code(cvm_ctx_t *ctx, vstate_t **states);
+static int verify_table(cvm_ctx_t *ctx, bcdbuf_t table);
+static int verify_init(verifier_t *vf, cvm_ctx_t *ctx, int table);
+static void verify_free(verifier_t *vf);
+static int verify_insn(verifier_t *vf, vstate_t *st, int32_t ci);
+static int verify_next(verifier_t *vf, vstate_t *st, int32_t ci);
+static void verify_queue(verifier_t *vf, int32_t ci);
+static int verify_need(verifier_t *vf, vstate_t *st, int32_t count);
+static int verify_args(verifier_t *vf, int32_t proc, int32_t count);
+#ifdef CVM_KERNEL_IAPPEND
+	static int verify_call(verifier_t *vf, vstate_t *st, int32_t ci, int32_t entry);
+	static int verify_ret(verifier_t *vf, vstate_t *st);
+	static void verify_calls(verifier_t *vf, int32_t proc);
+#endif
+static void verify_depth(verifier_t *vf, int32_t depth);
+static int verify_push(verifier_t *vf, vstate_t *st, int known, int32_t num);
+static int verify_pop(vstate_t *st, int32_t *num);
+static int32_t verify_index(vstate_t *st, int known, int32_t index);
+static int verify_target(verifier_t *vf, int32_t mi, int32_t *ci);
+static int vstate_get(vstate_t *st, int32_t pos, int32_t *num);
+static void vstate_set(vstate_t *st, int32_t pos, int32_t num);
+static void vstate_forget(vstate_t *st, int32_t pos);
+static void fuse_code(cvm_ctx_t *ctx);
+static int fuse_insn(cvm_insn_t *insn);
+static inline const cvm_insn_t *insn_at(cvm_ctx_t *ctx, cvm_insn_t *scratch, int32_t mi);
+static int32_t insn_byte(cvm_ctx_t *ctx, const cvm_insn_t *scratch, const cvm_insn_t *ip);
+static uint8_t insn_opcode(uint8_t opcode);
+static int insn_append(uint8_t opcode);
+static int32_t insn_count(uint8_t opcode);
+static int32_t insn_split(cvm_ctx_t *ctx, const cvm_insn_t *scratch, const cvm_insn_t *ip);
+static int32_t fuse_split(cvm_ctx_t *ctx, int32_t ci);
+
+static void aot_insn(cvm_ctx_t *ctx, FILE *output, int32_t ci);
+static void aot_generic(FILE *output, cvm_insn_t *insn);
+static void aot_push_check(FILE *output, int32_t count);
+static void aot_size_check(FILE *output, int32_t count, uint8_t opcode);
+static void aot_index(FILE *output, int32_t num, uint8_t opcode, uint8_t code, const char *var);
+static void aot_address(FILE *output, const char *var, uint8_t opcode, uint8_t code);
+static void aot_target(cvm_ctx_t *ctx, FILE *output, int32_t num, uint8_t opcode, const char *cond);
+static void aot_goto(cvm_ctx_t *ctx, FILE *output, int32_t mi);
+static const char *aot_cond(uint8_t opcode);
+#ifdef CVM_KERNEL_IAPPEND
+	static void aot_fcal(FILE *output, int32_t ret);
+	static void aot_frame(FILE *output, const char *var, uint8_t opcode, uint8_t code);
+	static const char *aot_binop(uint8_t opcode);
+	static void aot_binop_write(FILE *output, uint8_t opcode, const char *operand);
+	static int32_t aot_operand(uint8_t opcode, int32_t num);
+#endif
+
+#ifdef CVM_KERNEL_PROFILE
+	static void profile_step(cvm_ctx_t *ctx, const cvm_insn_t *scratch, const cvm_insn_t *ip);
+	static void profile_call(vmprofile_t *prof, int32_t mi, int32_t max);
+	static int32_t profile_frame(vmprofile_t *prof, int32_t parent, int32_t mi);
+	static void profile_time(vmprofile_t *prof);
+	static int ctx_profile(cvm_ctx_t *ctx, cvm_profile_t *profile, int32_t **output, int32_t *input, int trace);
+	static int profile_event(vmprofile_t *prof, int32_t mi, int enter);
+	static void profile_leave(vmprofile_t *prof);
+	static uint64_t profile_ns(void);
+#endif
+
+#ifdef CVM_KERNEL_JIT
+	static void jit_code(cvm_ctx_t *ctx);
+	static void jit_free(cvm_ctx_t *ctx);
+	VM_INLINE int jit_run(cvm_ctx_t *ctx, vmstack_t *stack, int32_t *mi);
+	static void jit_prologue(jitbuf_t *jb);
+	static int32_t jit_insn(jitbuf_t *jb, int32_t ci);
+	static void jit_generic(jitbuf_t *jb, int32_t ci);
+	static void jit_push_check(jitbuf_t *jb, int32_t count);
+	static void jit_size_check(jitbuf_t *jb, int32_t count, uint8_t opcode);
+	static void jit_index(jitbuf_t *jb, int32_t num, uint8_t opcode, uint8_t code, int reg);
+	static void jit_address(jitbuf_t *jb, int reg, uint8_t opcode, uint8_t code);
+	static void jit_range(jitbuf_t *jb, uint8_t opcode);
+	static void jit_compare(jitbuf_t *jb);
+	static int jit_cond(uint8_t opcode);
+	static void jit_target(jitbuf_t *jb, int32_t num, uint8_t opcode, int cc);
+	static void jit_table_jump(jitbuf_t *jb);
+	#ifdef CVM_KERNEL_IAPPEND
+		static void jit_binop(jitbuf_t *jb, uint8_t opcode);
+		static void jit_binop_imm(jitbuf_t *jb, uint8_t opcode, int32_t num);
+		static void jit_frame_check(jitbuf_t *jb);
+		static void jit_frame_push(jitbuf_t *jb, int32_t ret);
+		static void jit_frame_index(jitbuf_t *jb, int reg, uint8_t opcode, uint8_t code);
+	#endif
+	static void jit_fail(jitbuf_t *jb, uint8_t opcode, uint8_t code);
+	static void jit_check(jitbuf_t *jb, int cc, uint8_t opcode, uint8_t code);
+	static void jit_movrm(jitbuf_t *jb, uint8_t op, int reg, int indexed, int32_t disp);
+	static void jit_movmi(jitbuf_t *jb, int32_t disp, int32_t num);
+	static void jit_modrm(jitbuf_t *jb, uint8_t op1, int n, uint8_t op2, int reg, int indexed, int32_t disp);
+	static void jit_cold(jitbuf_t *jb, int32_t ci);
+	static void jit_jmp(jitbuf_t *jb, int32_t ci);
+	static void jit_goto(jitbuf_t *jb, int32_t at);
+	static void jit_fixup(jitbuf_t *jb, int32_t ci);
+	static int32_t jit_jcc8(jitbuf_t *jb, int cc);
+	static void jit_land8(jitbuf_t *jb, int32_t l);
+	static void jit_patch32(jitbuf_t *jb, int32_t at, int32_t num);
+	static void jit_u32(jitbuf_t *jb, uint32_t num);
+	static void jit_bytes(jitbuf_t *jb, int n, ...);
+	static void jit_byte(jitbuf_t *jb, uint8_t byte);
+#endif
+
+VM_INLINE int exec_push(vmstack_t *stack, int32_t num, int checked);
+VM_INLINE int exec_pop(vmstack_t *stack, int checked);
+VM_INLINE int exec_incdec(vmstack_t *stack, uint8_t opcode, int checked);
+VM_INLINE int exec_stor(vmstack_t *stack, int checked);
+VM_INLINE int exec_load(vmstack_t *stack, int checked);
+VM_INLINE int exec_jmp(cvm_ctx_t *ctx, vmstack_t *stack, int32_t *mi, int checked);
+VM_INLINE int exec_jmpif(cvm_ctx_t *ctx, vmstack_t *stack, uint8_t opcode, int32_t *mi, int checked);
+VM_INLINE int exec_call(cvm_ctx_t *ctx, vmstack_t *stack, int32_t num, int32_t *mi, int checked);
+#ifdef CVM_KERNEL_IAPPEND
+	VM_INLINE int exec_fcal(cvm_ctx_t *ctx, vmstack_t *stack, int32_t num, int32_t *mi, int checked);
+	VM_INLINE int exec_ret(vmstack_t *stack, int32_t *mi);
+	VM_INLINE int exec_fld(vmstack_t *stack);
+	VM_INLINE int exec_fst(vmstack_t *stack);
+#endif
+
+static uint32_t join_8bits_to_32bits(uint8_t *bytes);
+static uint16_t wrap_return(uint8_t x, uint8_t y);
+
+/// SECTION: COMPILE
+
+// translate assembly mnemonics to byte codes
+// example: ("PUSH 5" -> C_PUSH || 0x00 || 0x00 || 0x00 || 0x05)
+// example: ("POP" -> C_POP)
+extern int cvm_compile(FILE *output, FILE *input) {
+	return compile_file(output, input, 0, 1);
+}
+
+// translate as cvm_compile does it, but fold constants, remove pairs of
+// instructions without effect and code after jmp/hlt which no label reaches
+// and write compact instructions ("PUSH 5" -> C_PSH8 || 0x05), program
+// must jump only to addresses pushed by "push label" (overflow of stack
+// by removed or folded push is not an error)
+extern int cvm_compile_opt(FILE *output, FILE *input) {
+	return compile_file(output, input, 1, 1);
+}
+
+// translate as cvm_compile (or cvm_compile_opt if optimize = 1) does
+// it and keep addresses of labels and lines of source in container
+extern int cvm_compile_debug(FILE *output, FILE *input, int optimize) {
+	return compile_file(output, input, optimize, 2);
+}
+
+// translate len bytes of assembly in src to byte codes
+// in *output (allocated by malloc) of *outlen bytes
+extern int cvm_compile_mem(const char *src, size_t len, uint8_t **output, size_t *outlen) {
+	asmsrc_t source = { NULL, src, len, 0 };
+
+	return compile_code(&source, 0, 0, output, outlen);
+}
+
+// input is read once, so it can be pipe
+static int compile_file(FILE *output, FILE *input, int optimize, int container) {
+	asmsrc_t source = { input, NULL, 0, 0 };
+	uint8_t *bytes;
+	size_t size;
+	int retcode;
+
+	retcode = compile_code(&source, optimize, container, &bytes, &size);
+	if (retcode != 0) {
+		return retcode;
+	}
+
+	fwrite(bytes, sizeof(uint8_t), size, output);
+	free(bytes);
+	return 0;
+}
+
+// byte code or its container (if container = 1, with
+// symbols and lines if container = 2) in *output
+static int compile_code(asmsrc_t *source, int optimize, int container, uint8_t **output, size_t *outlen) {
+	symtab_t *symtab;
+	asmcode_t code;
+	int retcode;
+
+	symtab = symtab_new(512);
+	if (symtab == NULL) {
+		return 4;
+	}
+	memset(&code, 0, sizeof(code));
+
+	retcode = compile_read(&code, symtab, source);
+	symtab_free(symtab);
+
+	if (retcode == 0 && optimize) {
+		while(optimize_code(&code)) {
+			// until code does not change
+		}
+	}
+
+	if (retcode == 0) {
+		retcode = compile_emit(&code, optimize, output, outlen);
+	}
+
+	if (retcode == 0 && container) {
+		retcode = bcd_build(&code, container == 2, output, outlen);
+	}
+
+	free(code.insn);
+	free(code.labels);
+	free(code.names);
+	return retcode;
+}
+
+// read instructions of source in one pass: labels are numbered
+// by first use and left in code as pseudo instructions
+static int compile_read(asmcode_t *code, symtab_t *symtab, asmsrc_t *source) {
+	asminsn_t insn;
+	asmlabel_t *label;
+	asmword_t line, arg;
+	char buffer[BUFSIZ];
+	int32_t nline;
+
+	nline = 0;
+	while(asmsrc_line(source, buffer, BUFSIZ, &line)) {
+		nline += 1;
+		insn.opcode = read_opcode(&line, &arg, &insn.width);
+		insn.arg = 0;
+		insn.label = -1;
+		insn.line = nline;
+
+		switch(insn.opcode) {
+			// undefined instruction
+			case C_UNDF:
+				return 1;
+			// pass null instructions
+			case C_VOID: case C_CMNT:
+				continue;
+			// label instruction -> its number
+			case C_LABL:
+				if (arg.len == 0 || word_is_number(&arg)) {
+					return 2;
+				}
+				insn.arg = compile_label(code, symtab, &arg);
+				if (insn.arg < 0) {
+					return 4;
+				}
+				code->labels[insn.arg].defined = 1;
+			break;
+			// push instruction -> number or label
+			case C_PUSH:
+				if (arg.len == 0) {
+					return 3;
+				}
+				if (word_is_number(&arg)) {
+					insn.arg = word_to_number(&arg);
+					break;
+				}
+				insn.label = compile_label(code, symtab, &arg);
+				if (insn.label < 0) {
+					return 4;
+				}
+			break;
+			default:
+			break;
+		}
+
+		if (asmcode_append(code, &insn) != 0) {
+			return 4;
+		}
+	}
+
+	// push of name without labl is push of number
+	for (int32_t i = 0; i < code->size; ++i) {
+		if (code->insn[i].label < 0) {
+			continue;
+		}
+		label = &code->labels[code->insn[i].label];
+		if (!label->defined) {
+			code->insn[i].arg = label->num;
+			code->insn[i].label = -1;
+		}
+	}
+
+	return 0;
+}
+
+// number of label by its name, new names get next number
+static int32_t compile_label(asmcode_t *code, symtab_t *symtab, asmword_t *name) {
+	asmlabel_t *labels;
+	int32_t index;
+	char *names;
+	int *temp;
+
+	temp = symtab_get(symtab, name->ptr, name->len);
+	if (temp != NULL) {
+		return *temp;
+	}
+
+	if (code->nlabels == code->caplabels) {
+		code->caplabels = code->caplabels ? code->caplabels * 2 : 64;
+		labels = (asmlabel_t*)realloc(code->labels, sizeof(asmlabel_t)*code->caplabels);
+		if (labels == NULL) {
+			return -1;
+		}
+		code->labels = labels;
+	}
+
+	// name is kept for symbols of container
+	while (code->nnames + name->len > code->capnames) {
+		code->capnames = code->capnames ? code->capnames * 2 : 1024;
+		names = (char*)realloc(code->names, sizeof(char)*code->capnames);
+		if (names == NULL) {
+			return -1;
+		}
+		code->names = names;
+	}
+
+	index = code->nlabels;
+	if (symtab_set(symtab, name->ptr, name->len, index) != 0) {
+		return -1;
+	}
+
+	code->nlabels += 1;
+	code->labels[index].defined = 0;
+	code->labels[index].num = word_to_number(name);
+	code->labels[index].name = code->nnames;
+	code->labels[index].len = name->len;
+	code->labels[index].addr = -1;
+
+	memcpy(code->names + code->nnames, name->ptr, name->len);
+	code->nnames += name->len;
+	return index;
+}
+
+// write byte codes of instructions, push takes 5 bytes; compact code:
+// push is joined with next load, stor or jump if its value fits into
+// the argument of immediate form, else it takes the shortest push;
+// widths of pushes of labels grow from one byte until addresses
+// of all labels fit into them
+static int compile_emit(asmcode_t *code, int compact, uint8_t **output, size_t *outlen) {
+	asminsn_t *insn;
+	uint8_t *bytes, *width, need;
+	int32_t count, size;
+	int changed;
+
+	width = (uint8_t*)malloc(sizeof(uint8_t)*(code->size+1));
+	if (width == NULL) {
+		return 4;
+	}
+
+	for (int32_t i = 0; i < code->size; ++i) {
+		insn = &code->insn[i];
+		width[i] = insn->width;
+		if (!compact && insn->opcode == C_PUSH && insn->width == 0) {
+			width[i] = 4;
+			continue;
+		}
+		if (insn->opcode != C_PUSH || insn->label >= 0) {
+			// push of label starts from one byte
+			if (width[i] == 0) {
+				width[i] = 1;
+			}
+			continue;
+		}
+		need = compile_width(insn->arg);
+		// push8/push16 of number which does not fit
+		if (insn->width != 0 && need > insn->width) {
+			free(width);
+			return 3;
+		}
+		width[i] = need;
+	}
+
+	// addresses only grow with widths, so this ends
+	do {
+		size = 0;
+		for (int32_t i = 0; i < code->size; i += count) {
+			count = 1;
+			if (code->insn[i].opcode == C_LABL) {
+				// last labl of name gives its address
+				code->labels[code->insn[i].arg].addr = size;
+				continue;
+			}
+			size += compile_encode(code, width, i, NULL, &count);
+		}
+
+		changed = 0;
+		for (int32_t i = 0; i < code->size; ++i) {
+			insn = &code->insn[i];
+			if (insn->opcode != C_PUSH || insn->label < 0) {
+				continue;
+			}
+			need = compile_width(code->labels[insn->label].addr);
+			if (need > width[i]) {
+				// push8/push16 of label
+				if (insn->width != 0) {
+					free(width);
+					return 3;
+				}
+				width[i] = need;
+				changed = 1;
+			}
+		}
+	} while(changed);
+
+	bytes = (uint8_t*)malloc(sizeof(uint8_t)*(size+1));
+	if (bytes == NULL) {
+		free(width);
+		return 4;
+	}
+
+	size = 0;
+	for (int32_t i = 0; i < code->size; i += count) {
+		count = 1;
+		if (code->insn[i].opcode != C_LABL) {
+			size += compile_encode(code, width, i, bytes + size, &count);
+		}
+	}
+
+	free(width);
+
+	*output = bytes;
+	*outlen = size;
+	return 0;
+}
+
+// byte code of instructions from i of code, return its size and
+// number of instructions of code in *count; bytes are written
+// if bytes != NULL, pushes of labels take width[i] bytes
+static int32_t compile_encode(asmcode_t *code, uint8_t *width, int32_t i, uint8_t *bytes, int32_t *count) {
+	asminsn_t *insn;
+	uint8_t opcode, imm;
+	int32_t num;
+
+	insn = &code->insn[i];
+	if (insn[0].opcode != C_PUSH) {
+		if (bytes != NULL) {
+			bytes[0] = insn[0].opcode;
+		}
+		return 1;
+	}
+
+	num = compile_value(code, &insn[0]);
+
+	// push8/push16 are not joined
+	opcode = C_UNDF;
+	if (insn[0].width == 0 && i+1 < code->size) {
+		opcode = compile_imm(insn[1].opcode, &imm);
+	}
+
+	// push x; load -> lodi x
+	// push x; jmp -> jmpi x
+	if (opcode != C_UNDF && width[i] <= imm) {
+		*count = 2;
+		return compile_arg(bytes, opcode, num, imm);
+	}
+
+	// push x; push y; stor -> stri x y
+	if (insn[0].width == 0 && width[i] == 1 && i+2 < code->size &&
+		insn[1].opcode == C_PUSH && insn[1].width == 0 && width[i+1] == 1 &&
+		insn[2].opcode == C_STOR) {
+		*count = 3;
+		if (bytes != NULL) {
+			bytes[0] = C_STRI;
+			bytes[1] = (uint8_t)num;
+			bytes[2] = (uint8_t)compile_value(code, &insn[1]);
+		}
+		return 3;
+	}
+
+	switch(width[i]) {
+		case 1:  return compile_arg(bytes, C_PSH8, num, 1);
+		case 2:  return compile_arg(bytes, C_PS16, num, 2);
+		default: return compile_arg(bytes, C_PUSH, num, 4);
+	}
+}
+
+// value of push: number or address of label
+static int32_t compile_value(asmcode_t *code, asminsn_t *insn) {
+	if (insn->label >= 0) {
+		return code->labels[insn->label].addr;
+	}
+	return insn->arg;
+}
+
+// write opcode and big-endian argument of n bytes (if bytes != NULL)
+// example: C_PS16, 300 -> C_PS16 || 0x01 || 0x2C
+static int32_t compile_arg(uint8_t *bytes, uint8_t opcode, int32_t num, int32_t n) {
+	if (bytes != NULL) {
+		bytes[0] = opcode;
+		for (int32_t i = 0; i < n; ++i) {
+			bytes[1+i] = (uint8_t)((uint32_t)num >> (8 * (n-1-i)));
+		}
+	}
+	return 1 + n;
+}
+
+// bytes of signed argument which holds num: 1, 2 or 4
+static uint8_t compile_width(int32_t num) {
+	if (num >= INT8_MIN && num <= INT8_MAX) {
+		return 1;
+	}
+	if (num >= INT16_MIN && num <= INT16_MAX) {
+		return 2;
+	}
+	return 4;
+}
+
+// immediate form of instruction after push and bytes
+// of its argument in *width or C_UNDF
+static uint8_t compile_imm(uint8_t opcode, uint8_t *width) {
+	*width = 2;
+	switch(opcode) {
+		case C_LOAD: *width = 1; return C_LODI;
+		case C_JMP:  return C_JMPI;
+		case C_JG:   return C_JGI;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_JE:   return C_JEI;
+		case C_JL:   return C_JLI;
+		case C_JNE:  return C_JNEI;
+		case C_JLE:  return C_JLEI;
+		case C_JGE:  return C_JGEI;
+	#endif
+		default:     return C_UNDF;
+	}
+}
+
+static int asmcode_append(asmcode_t *code, asminsn_t *insn) {
+	asminsn_t *temp;
+
+	if (code->size == code->cap) {
+		code->cap = code->cap ? code->cap * 2 : 1024;
+		temp = (asminsn_t*)realloc(code->insn, sizeof(asminsn_t)*code->cap);
+		if (temp == NULL) {
+			return 1;
+		}
+		code->insn = temp;
+	}
+
+	code->insn[code->size++] = *insn;
+	return 0;
+}
+
+// next line of source without '\n': line of file is read into buffer
+// by fgets, line of memory is not copied
+static int asmsrc_line(asmsrc_t *source, char *buffer, int size, asmword_t *line) {
+	const char *end;
+	size_t len;
+
+	if (source->input != NULL) {
+		if (fgets(buffer, size, source->input) == NULL) {
+			return 0;
+		}
+		line->ptr = buffer;
+		len = strlen(buffer);
+	} else {
+		if (source->pos >= source->size) {
+			return 0;
+		}
+		line->ptr = source->data + source->pos;
+		end = memchr(line->ptr, '\n', source->size - source->pos);
+		len = (end != NULL) ? (size_t)(end - line->ptr) + 1 : source->size - source->pos;
+		source->pos += len;
+		// line ends at '\0' as string of fgets
+		end = memchr(line->ptr, '\0', len);
+		if (end != NULL) {
+			len = end - line->ptr;
+		}
+	}
+
+	if (len > 0 && line->ptr[len-1] == '\n') {
+		len -= 1;
+	}
+
+	line->len = (int)len;
+	return 1;
+}
+
+// one pass of peephole optimization, return 1 if code was changed:
+// every instruction is appended to optimized code and then
+// its end is reduced while it has known sequence
+static int optimize_code(asmcode_t *code) {
+	asminsn_t *insn, *labels;
+	int32_t *refs, *at;
+	int32_t size, nlabels, w;
+	int changed, dead;
+
+	// labels without push are not reached by jumps, they are
+	// put aside and returned to their places in optimized code
+	// (symbols of container keep them)
+	refs = (int32_t*)calloc(code->nlabels+1, sizeof(int32_t));
+	labels = (asminsn_t*)malloc(sizeof(asminsn_t)*(code->size+1));
+	at = (int32_t*)malloc(sizeof(int32_t)*(code->size+1));
+	if (refs == NULL || labels == NULL || at == NULL) {
+		free(refs);
+		free(labels);
+		free(at);
+		return 0;
+	}
+	for (int32_t i = 0; i < code->size; ++i) {
+		if (code->insn[i].opcode == C_PUSH && code->insn[i].label >= 0) {
+			refs[code->insn[i].label] += 1;
+		}
+	}
+
+	insn = code->insn;
+	size = 0;
+	nlabels = 0;
+	changed = 0;
+	dead = 0;
+
+	for (int32_t i = 0; i < code->size; ++i) {
+		if (insn[i].opcode == C_LABL) {
+			if (refs[insn[i].arg] == 0) {
+				labels[nlabels] = insn[i];
+				at[nlabels++] = size;
+				continue;
+			}
+			dead = 0;
+		}
+
+		// code after jmp/hlt/ret up to label
+		if (dead) {
+			changed = 1;
+			continue;
+		}
+
+		insn[size++] = insn[i];
+		while(optimize_tail(insn, &size)) {
+			changed = 1;
+		}
+
+		// label inside of reduced instructions goes to their end
+		for (int32_t k = nlabels-1; k >= 0 && at[k] > size; --k) {
+			at[k] = size;
+		}
+
+		if (size > 0 && (insn[size-1].opcode == C_JMP || insn[size-1].opcode == C_HLT)) {
+			dead = 1;
+		}
+	#ifdef CVM_KERNEL_IAPPEND
+		if (size > 0 && insn[size-1].opcode == C_RET) {
+			dead = 1;
+		}
+	#endif
+	}
+
+	// code has place for labels which were taken from it,
+	// they are merged from the end (at[] does not decrease)
+	code->size = size + nlabels;
+	w = code->size;
+	for (int32_t k = nlabels-1; k >= 0; ) {
+		if (at[k] == size) {
+			insn[--w] = labels[k--];
+			continue;
+		}
+		insn[--w] = insn[--size];
+	}
+
+	free(refs);
+	free(labels);
+	free(at);
+	return changed;
+}
+
+// reduce last instructions of code, return 1 if they were changed,
+// instructions without effect are removed only if value which
+// they use is pushed by previous instruction (else they can fail);
+// removed and folded pushes don't fail on full stack any more
+static int optimize_tail(asminsn_t *insn, int32_t *size) {
+	asminsn_t *last;
+	int32_t num;
+
+	if (*size < 2 || insn[*size-2].opcode != C_PUSH) {
+		return 0;
+	}
+
+	last = &insn[*size-1];
+
+	// push x; pop -> (none)
+	if (last->opcode == C_POP) {
+		*size -= 2;
+		return 1;
+	}
+
+	// values of labels are not known before end of optimization
+	if (insn[*size-2].label >= 0) {
+		return 0;
+	}
+
+	// push x; inc -> push x+1
+	if (optimize_unop(last->opcode, insn[*size-2].arg, &num)) {
+		insn[*size-2].arg = num;
+		insn[*size-2].width = 0;
+		*size -= 1;
+		return 1;
+	}
+
+	// push x; push y; add -> push x+y
+	if (*size >= 3 && insn[*size-3].opcode == C_PUSH && insn[*size-3].label < 0 &&
+		optimize_binop(last->opcode, insn[*size-3].arg, insn[*size-2].arg, &num)) {
+		insn[*size-3].arg = num;
+		insn[*size-3].width = 0;
+		*size -= 2;
+		return 1;
+	}
+
+	// push 0; add -> (none)
+	if (*size >= 3 && optimize_pushes(insn[*size-3].opcode) &&
+		optimize_identity(last->opcode, insn[*size-2].arg)) {
+		*size -= 2;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int optimize_unop(uint8_t opcode, int32_t x, int32_t *result) {
+	switch(opcode) {
+		case C_INC: *result = (int32_t)((uint32_t)x + 1); return 1;
+		case C_DEC: *result = (int32_t)((uint32_t)x - 1); return 1;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_NOT: *result = ~x; return 1;
+	#endif
+		default: return 0;
+	}
+}
+
+// result of y @ x as cvm_run computes it,
+// division by zero and overflow are left to run time
+static int optimize_binop(uint8_t opcode, int32_t y, int32_t x, int32_t *result) {
+	switch(opcode) {
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_ADD: *result = (int32_t)((uint32_t)y + (uint32_t)x); return 1;
+		case C_SUB: *result = (int32_t)((uint32_t)y - (uint32_t)x); return 1;
+		case C_MUL: *result = (int32_t)((uint32_t)y * (uint32_t)x); return 1;
+		case C_AND: *result = y & x; return 1;
+		case C_OR:  *result = y | x; return 1;
+		case C_XOR: *result = y ^ x; return 1;
+		case C_DIV: case C_MOD:
+			if (x == 0 || (y == INT32_MIN && x == -1)) {
+				return 0;
+			}
+			*result = (opcode == C_DIV) ? y / x : y % x;
+			return 1;
+		case C_SHR: case C_SHL:
+			if (x < 0 || x > 31) {
+				return 0;
+			}
+			*result = (opcode == C_SHR) ? y >> x : (int32_t)((uint32_t)y << x);
+			return 1;
+	#endif
+		default: return 0;
+	}
+}
+
+// instruction leaves value on top of stack if it does not fail
+static int optimize_pushes(uint8_t opcode) {
+	switch(opcode) {
+		case C_PUSH: case C_LOAD: case C_INC: case C_DEC:
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_ADD: case C_SUB: case C_MUL: case C_DIV:
+		case C_MOD: case C_SHR: case C_SHL: case C_XOR:
+		case C_AND: case C_OR: case C_NOT: case C_FLD:
+	#endif
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+// y @ x = y for any y
+static int optimize_identity(uint8_t opcode, int32_t x) {
+	switch(opcode) {
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_ADD: case C_SUB: case C_OR:
+		case C_XOR: case C_SHR: case C_SHL:
+			return x == 0;
+		case C_MUL: case C_DIV:
+			return x == 1;
+	#endif
+		default:
+			return 0;
+	}
+}
+
+// read opcode from first word of line and its argument
+// from second word (len = 0 if it is not needed),
+// width of push8/push16 is 1/2 (0 for other words)
+// example: "  push  label ; x" -> C_PUSH, "label"
+// example: "push16 300" -> C_PUSH, "300", 2
+static uint8_t read_opcode(asmword_t *line, asmword_t *arg, uint8_t *width) {
+	asmword_t word;
+	uint8_t opcode;
+
+	arg->ptr = line->ptr;
+	arg->len = 0;
+
+	// get opcode from first word in line
+	read_word(line, &word);
+	*width = read_width(&word);
+	opcode = find_opcode(&word);
+	if (*width != 0 && opcode != C_PUSH) {
+		return C_UNDF;
+	}
+	switch(opcode) {
+		case C_PUSH: case C_LABL:
+			break;
+		default:
+			return opcode;
+	}
+
+	// get second word in line
+	read_word(line, arg);
+	return opcode;
+}
+
+// cut suffix of push8/push16 from word and return width of its
+// argument in bytes, other words are not changed (width 0)
+// example: "push8" -> "push", 1
+static uint8_t read_width(asmword_t *word) {
+	if (word->len == 5 && word->ptr[4] == '8') {
+		word->len = 4;
+		return 1;
+	}
+	if (word->len == 6 && word->ptr[4] == '1' && word->ptr[5] == '6') {
+		word->len = 4;
+		return 2;
+	}
+	return 0;
+}
+
+// cut first word from line
+// example: "  word1 word2" -> "word1", " word2"
+static void read_word(asmword_t *line, asmword_t *word) {
+	const char *ptr, *end;
+
+	ptr = line->ptr;
+	end = line->ptr + line->len;
+
+	while(ptr < end && isspace((unsigned char)*ptr)) {
+		++ptr;
+	}
+	word->ptr = ptr;
+
+	while(ptr < end && !isspace((unsigned char)*ptr)) {
+		++ptr;
+	}
+	word->len = ptr - word->ptr;
+
+	line->len = end - ptr;
+	line->ptr = ptr;
+}
+
+// get instruction by mnemonic in any case
+// example: "push", "PUSH" -> C_PUSH
+static uint8_t find_opcode(asmword_t *word) {
+	uint32_t key;
+
+	// void string
+	if (word->len == 0) {
+		return C_VOID;
+	}
+
+	// undefined code
+	if (word->len > 4) {
+		return C_UNDF;
+	}
+
+	key = 0;
+	for (int i = 0; i < word->len; ++i) {
+		key |= (uint32_t)(uint8_t)tolower((unsigned char)word->ptr[i]) << (8 * i);
+	}
+
+	if (bclist[MNEM_SLOT(key)].key != key) {
+		return C_UNDF;
+	}
+
+	return bclist[MNEM_SLOT(key)].bcode;
+}
+
+// example: "12345" -> true
+// example: "a12345", "12345a" -> false
+static int word_is_number(asmword_t *word) {
+	if (word->len == 0) {
+		return 0;
+	}
+
+	for (int i = 0; i < word->len; ++i) {
+		if (!isdigit((unsigned char)word->ptr[i])) {
+			return 0;
+		}
+	}
+
+	return 1; 
+}
+
+// number as atoi reads it: digits after optional sign,
+// value out of int64 is clamped, then truncated to int32
+// example: "-12a" -> -12, "abc" -> 0
+static int32_t word_to_number(asmword_t *word) {
+	uint64_t num, limit;
+	int neg, digit, i;
+
+	i = 0;
+	neg = 0;
+	if (i < word->len && (word->ptr[i] == '-' || word->ptr[i] == '+')) {
+		neg = (word->ptr[i++] == '-');
+	}
+
+	limit = neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+	num = 0;
+	for (; i < word->len && isdigit((unsigned char)word->ptr[i]); ++i) {
+		digit = word->ptr[i] - '0';
+		if (num > (limit - digit) / 10) {
+			num = limit;
+			break;
+		}
+		num = num * 10 + digit;
+	}
+
+	if (neg) {
+		num = -num;
+	}
+
+	return (int32_t)(uint32_t)num;
+}
+
+// return (x[0], x[1], x[2], x[3])
+static void split_32bits_to_8bits(uint32_t num, uint8_t *bytes) {
+	for (int i = 0; i < 4; ++i) {
+		bytes[i] = (uint8_t)(num >> (24 - i * 8));
+	}
+}
+
+
+
+/// SECTION: CONTAINER
+
+// put byte code into container with result of verifier, states of
+// verifier before jump targets (cvm_ctx_load checks them in one pass
+// instead of search), addresses of labels and lines of source if debug
+static int bcd_build(asmcode_t *code, int debug, uint8_t **output, size_t *outlen) {
+	cvm_ctx_t *ctx;
+	vstate_t *states;
+	asmlabel_t *label;
+	bcdbuf_t buf;
+	uint8_t *bytes, flags;
+	uint32_t nstates, nsymbols, nlines, size;
+	int32_t st;
+
+	flags = 0;
+	for (int32_t i = 0; i < code->size; ++i) {
+		if (insn_append(code->insn[i].opcode)) {
+			flags |= CVM_KERNEL_BAPPEND;
+		}
+	}
+
+	ctx = cvm_ctx_new();
+	if (ctx == NULL) {
+		return 4;
+	}
+
+	// code which can't be loaded has no tables, tables are made
+	// for the largest stack (loader checks them for its limit)
+	states = NULL;
+	ctx->stack.max = CVM_KERNEL_LIMIT;
+	if (*outlen <= CVM_KERNEL_LIMIT && ctx_decode(ctx, *output, (int32_t)*outlen, NULL, 0) == 0) {
+		verify_code(ctx, &states);
+	}
+
+	nstates = 0;
+	for (int32_t ci = 0; states != NULL && ci <= ctx->ncode; ++ci) {
+		if (states[ci].seen && states[ci].target) {
+			nstates += 9 + 8 * (uint32_t)states[ci].nconst;
+		}
+	}
+
+	size = CVM_KERNEL_BHEADER + 5 + (uint32_t)*outlen + 5 + 13 + 4;
+	if (states != NULL) {
+		size += 5 + nstates;
+	}
+
+	nsymbols = 0;
+	nlines = 0;
+	if (debug) {
+		for (int32_t i = 0; i < code->nlabels; ++i) {
+			if (code->labels[i].defined && code->labels[i].addr >= 0) {
+				nsymbols += 8 + (uint32_t)code->labels[i].len;
+			}
+		}
+		buf.ptr = NULL;
+		nlines = bcd_lines(code, &buf);
+		size += 5 + nsymbols + 5 + nlines;
+	}
+
+	bytes = (uint8_t*)malloc(sizeof(uint8_t)*size);
+	if (bytes == NULL) {
+		free(states);
+		cvm_ctx_free(ctx);
+		return 4;
+	}
+
+	buf.ptr = bytes;
+	memcpy(buf.ptr, CVM_KERNEL_BMAGIC, 4);
+	buf.ptr += 4;
+	bcd_put8(&buf, CVM_KERNEL_BVERSION);
+	bcd_put8(&buf, flags);
+
+	bcd_put8(&buf, CVM_KERNEL_BCODE);
+	bcd_put32(&buf, (uint32_t)*outlen);
+	memcpy(buf.ptr, *output, *outlen);
+	buf.ptr += *outlen;
+
+	// number of instructions, verified, min_args, max_depth
+	bcd_put8(&buf, CVM_KERNEL_BINFO);
+	bcd_put32(&buf, 13);
+	bcd_put32(&buf, (uint32_t)ctx->ncode);
+	bcd_put8(&buf, (uint8_t)ctx->verified);
+	bcd_put32(&buf, (uint32_t)ctx->minargs);
+	bcd_put32(&buf, (uint32_t)ctx->maxdepth);
+
+	// byte of instruction, depth, known values
+	if (states != NULL) {
+		bcd_put8(&buf, CVM_KERNEL_BSTATES);
+		bcd_put32(&buf, nstates);
+		for (int32_t mi = 0; mi <= ctx->cmused; ++mi) {
+			st = (mi < ctx->cmused) ? ctx->slots[mi] : ctx->ncode;
+			if (st < 0 || !states[st].seen || !states[st].target) {
+				continue;
+			}
+			bcd_put32(&buf, (uint32_t)mi);
+			bcd_put32(&buf, (uint32_t)states[st].depth);
+			bcd_put8(&buf, (uint8_t)states[st].nconst);
+			for (int32_t i = 0; i < states[st].nconst; ++i) {
+				bcd_put32(&buf, (uint32_t)states[st].consts[i].pos);
+				bcd_put32(&buf, (uint32_t)states[st].consts[i].num);
+			}
+		}
+	}
+
+	if (debug) {
+		// address, length of name, name
+		bcd_put8(&buf, CVM_KERNEL_BSYMBOLS);
+		bcd_put32(&buf, nsymbols);
+		for (int32_t i = 0; i < code->nlabels; ++i) {
+			label = &code->labels[i];
+			if (!label->defined || label->addr < 0) {
+				continue;
+			}
+			bcd_put32(&buf, (uint32_t)label->addr);
+			bcd_put32(&buf, (uint32_t)label->len);
+			memcpy(buf.ptr, code->names + label->name, label->len);
+			buf.ptr += label->len;
+		}
+
+		bcd_put8(&buf, CVM_KERNEL_BLINES);
+		bcd_put32(&buf, nlines);
+		bcd_lines(code, &buf);
+	}
+
+	bcd_put32(&buf, bcd_checksum(bytes, size - 4));
+
+	free(states);
+	cvm_ctx_free(ctx);
+	free(*output);
+
+	*output = bytes;
+	*outlen = size;
+	return 0;
+}
+
+// find sections of container, 1 if it is damaged
+// or code has instructions which kernel doesn't have
+static int bcd_parse(bcdfile_t *bcd, uint8_t *memory, uint32_t msize) {
+	bcdbuf_t buf, *section;
+	uint32_t size;
+	uint8_t id;
+
+	memset(bcd, 0, sizeof(*bcd));
+
+	if (msize < CVM_KERNEL_BHEADER + 4 || memcmp(memory, CVM_KERNEL_BMAGIC, 4) != 0 ||
+		memory[4] != CVM_KERNEL_BVERSION) {
+		return 1;
+	}
+	if (bcd_checksum(memory, msize - 4) != join_8bits_to_32bits(memory + msize - 4)) {
+		return 1;
+	}
+
+	bcd->flags = memory[5];
+#ifndef CVM_KERNEL_IAPPEND
+	if (bcd->flags & CVM_KERNEL_BAPPEND) {
+		return 1;
+	}
+#endif
+
+	buf.ptr = memory + CVM_KERNEL_BHEADER;
+	buf.left = msize - CVM_KERNEL_BHEADER - 4;
+
+	while (buf.left > 0) {
+		if (bcd_get8(&buf, &id) != 0 || bcd_get32(&buf, &size) != 0 || size > buf.left) {
+			return 1;
+		}
+
+		// unknown sections are skipped
+		switch(id) {
+			case CVM_KERNEL_BCODE:    section = &bcd->code;    break;
+			case CVM_KERNEL_BINFO:    section = &bcd->info;    break;
+			case CVM_KERNEL_BSTATES:  section = &bcd->states;  break;
+			case CVM_KERNEL_BSYMBOLS: section = &bcd->symbols; break;
+			case CVM_KERNEL_BLINES:   section = &bcd->lines;   break;
+			default:                  section = NULL;          break;
+		}
+		if (section != NULL) {
+			if (section->ptr != NULL) {
+				return 1;
+			}
+			section->ptr = buf.ptr;
+			section->left = size;
+		}
+
+		buf.ptr += size;
+		buf.left -= size;
+	}
+
+	if (bcd->code.ptr == NULL) {
+		return 1;
+	}
+
+	return bcd_symbols(bcd->symbols, bcd->code.left);
+}
+
+// take result of verifier from container, 1 if
+// there is no result for this code or tables don't prove it
+static int bcd_verify(cvm_ctx_t *ctx, bcdfile_t *bcd) {
+	bcdbuf_t info;
+	uint32_t ncode;
+	uint8_t verified;
+
+	info = bcd->info;
+	if (info.ptr == NULL || bcd_get32(&info, &ncode) != 0 || bcd_get8(&info, &verified) != 0) {
+		return 1;
+	}
+	if (ncode != (uint32_t)ctx->ncode) {
+		return 1;
+	}
+
+	// program which is not verified runs with checks
+	if (!verified) {
+		ctx->verified = 0;
+		ctx->minargs = 0;
+		ctx->maxdepth = 0;
+		return 0;
+	}
+
+	if (bcd->states.ptr == NULL) {
+		return 1;
+	}
+	return verify_table(ctx, bcd->states);
+}
+
+// labels must be in code
+static int bcd_symbols(bcdbuf_t symbols, uint32_t cmused) {
+	uint32_t addr, len;
+
+	while (symbols.left > 0) {
+		if (bcd_get32(&symbols, &addr) != 0 || bcd_get32(&symbols, &len) != 0) {
+			return 1;
+		}
+		if (addr > cmused || len > symbols.left) {
+			return 1;
+		}
+		symbols.ptr += len;
+		symbols.left -= len;
+	}
+
+	return 0;
+}
+
+// lines of instructions in order of code: difference with line
+// of previous instruction 1 ... 255 or 0 and big-endian line,
+// bytes are written if buf->ptr != NULL, return their number
+static uint32_t bcd_lines(asmcode_t *code, bcdbuf_t *buf) {
+	uint32_t size;
+	int32_t line, diff;
+
+	size = 0;
+	line = 0;
+	for (int32_t i = 0; i < code->size; ++i) {
+		if (code->insn[i].opcode == C_LABL) {
+			continue;
+		}
+
+		diff = code->insn[i].line - line;
+		line = code->insn[i].line;
+		if (diff >= 1 && diff <= 255) {
+			size += 1;
+			if (buf->ptr != NULL) {
+				bcd_put8(buf, (uint8_t)diff);
+			}
+		} else {
+			size += 5;
+			if (buf->ptr != NULL) {
+				bcd_put8(buf, 0);
+				bcd_put32(buf, (uint32_t)line);
+			}
+		}
+	}
+
+	return size;
+}
+
+// copy section of container to memory of context (NULL if
+// it is empty or there is no memory for it)
+static void bcd_copy(bcdbuf_t section, uint8_t **ptr, uint32_t *size) {
+	free(*ptr);
+	*ptr = NULL;
+	*size = 0;
+
+	if (section.left == 0) {
+		return;
+	}
+
+	*ptr = (uint8_t*)malloc(sizeof(uint8_t)*section.left);
+	if (*ptr != NULL) {
+		memcpy(*ptr, section.ptr, section.left);
+		*size = section.left;
+	}
+}
+
+static void bcd_put8(bcdbuf_t *buf, uint8_t num) {
+	*buf->ptr++ = num;
+}
+
+static void bcd_put32(bcdbuf_t *buf, uint32_t num) {
+	split_32bits_to_8bits(num, buf->ptr);
+	buf->ptr += 4;
+}
+
+// return 1 if there are no bytes
+static int bcd_get8(bcdbuf_t *buf, uint8_t *num) {
+	if (buf->left < 1) {
+		return 1;
+	}
+
+	*num = *buf->ptr++;
+	buf->left -= 1;
+	return 0;
+}
+
+static int bcd_get32(bcdbuf_t *buf, uint32_t *num) {
+	if (buf->left < 4) {
+		return 1;
+	}
+
+	*num = join_8bits_to_32bits(buf->ptr);
+	buf->ptr += 4;
+	buf->left -= 4;
+	return 0;
+}
+
+// FNV-1a hash of bytes
+static uint32_t bcd_checksum(const uint8_t *bytes, uint32_t size) {
+	return bcd_hash(CVM_KERNEL_FNVBASIS, bytes, size);
+}
+
+// FNV-1a hash continued by bytes
+static uint32_t bcd_hash(uint32_t hash, const uint8_t *bytes, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+
+/// SECTION: CONTEXT
+
+// create virtual machine with empty code memory
+extern cvm_ctx_t *cvm_ctx_new(void) {
+	cvm_ctx_t *ctx;
+
+	ctx = (cvm_ctx_t*)malloc(sizeof(cvm_ctx_t));
+	if (ctx == NULL) {
+		return NULL;
+	}
+
+	if (ctx_init(ctx) != 0) {
+		free(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+extern void cvm_ctx_free(cvm_ctx_t *ctx) {
+#ifdef CVM_KERNEL_JIT
+	jit_free(ctx);
+#endif
+	ctx_release(ctx);
+	free(ctx->symbols);
+	free(ctx->lines);
+	free(ctx->stack.values);
+	free(ctx->stack.frames);
+	free(ctx);
+}
+
+// code memory of at most cmemory bytes and stack of at most smemory
+// values, return 1 if they are invalid or loaded program is larger
+// than cmemory (then limits don't change); run of cvm_ctx_run_for
+// can't be resumed after it
+extern int cvm_ctx_limits(cvm_ctx_t *ctx, int32_t cmemory, int32_t smemory) {
+	if (cmemory <= 0 || cmemory > CVM_KERNEL_LIMIT ||
+		smemory <= 0 || smemory > CVM_KERNEL_LIMIT ||
+		ctx->cmused > cmemory) {
+		return 1;
+	}
+
+	ctx->cmax = cmemory;
+	ctx->stack.max = smemory;
+	ctx->runmi = -1;
+	if (ctx->stack.cap > smemory) {
+		free(ctx->stack.values);
+		ctx->stack.values = NULL;
+		ctx->stack.cap = 0;
+	}
+	if (ctx->stack.capframes > smemory) {
+		free(ctx->stack.frames);
+		ctx->stack.frames = NULL;
+		ctx->stack.capframes = 0;
+	}
+
+	// loaded program stays, it is verified and translated
+	// again as both depend on limit of stack
+	if (ctx->code == &EMPTY) {
+		return 0;
+	}
+	for (int32_t i = 0; i < ctx->ncode; ++i) {
+		ctx->code[i].opcode = insn_opcode(ctx->code[i].opcode);
+	}
+#ifdef CVM_KERNEL_JIT
+	jit_free(ctx);
+#endif
+	verify_code(ctx, NULL);
+#ifdef CVM_KERNEL_JIT
+	jit_code(ctx);
+#endif
+	fuse_code(ctx);
+	return 0;
+}
+
+extern int cvm_limits(int32_t cmemory, int32_t smemory) {
+	return cvm_ctx_limits(&VM, cmemory, smemory);
+}
+
+static int ctx_init(cvm_ctx_t *ctx) {
+	ctx->cmax = CVM_KERNEL_CMEMORY;
+	ctx->cmused = 0;
+	ctx->ncode = 0;
+	ctx->memory = NULL;
+	ctx->map = NULL;
+	ctx->mapsize = 0;
+	ctx->code = &EMPTY;
+	ctx->slots = NULL;
+	ctx->bytes = EMPTYBYTES;
+	memset(ctx->fused, 0, sizeof(ctx->fused));
+	ctx->verified = 0;
+	ctx->minargs = 0;
+	ctx->maxdepth = 0;
+	ctx->jit = NULL;
+	ctx->jitsize = 0;
+	ctx->runmi = -1;
+	ctx->symbols = NULL;
+	ctx->nsymbols = 0;
+	ctx->lines = NULL;
+	ctx->nlines = 0;
+#ifdef CVM_KERNEL_PROFILE
+	ctx->profile = NULL;
+#endif
+	ctx->stack.values = NULL;
+	ctx->stack.cap = 0;
+	ctx->stack.max = CVM_KERNEL_SMEMORY;
+	ctx->stack.frames = NULL;
+	ctx->stack.capframes = 0;
+
+	return 0;
+}
+
+// code memory for program of msize bytes (without copy of bytes
+// for mapped file), return 1 if there is no memory for it
+// (then ctx has empty code)
+static int ctx_alloc(cvm_ctx_t *ctx, int32_t msize, int copy) {
+	ctx_release(ctx);
+
+	if (copy) {
+		ctx->memory = (uint8_t*)malloc(sizeof(uint8_t)*(msize+1));
+	}
+	// end of code is hlt, the last instruction cut by
+	// the end of code is decoded from one byte at least
+	ctx->code = (cvm_insn_t*)malloc(sizeof(cvm_insn_t)*(msize+CVM_KERNEL_DECODE));
+	ctx->slots = (int32_t*)malloc(sizeof(int32_t)*(msize+1));
+	ctx->bytes = (int32_t*)malloc(sizeof(int32_t)*(msize+CVM_KERNEL_DECODE));
+
+	if ((copy && ctx->memory == NULL) || ctx->code == NULL ||
+		ctx->slots == NULL || ctx->bytes == NULL) {
+		ctx_release(ctx);
+		return 1;
+	}
+
+	return 0;
+}
+
+// free code memory, ctx has empty code
+static void ctx_release(cvm_ctx_t *ctx) {
+	if (ctx->code != &EMPTY) {
+		free(ctx->code);
+	}
+	if (ctx->map != NULL) {
+	#ifdef CVM_KERNEL_MMAP
+		munmap(ctx->map, ctx->mapsize);
+	#endif
+	} else {
+		free(ctx->memory);
+	}
+	free(ctx->slots);
+	if (ctx->bytes != EMPTYBYTES) {
+		free(ctx->bytes);
+	}
+
+	ctx->cmused = 0;
+	ctx->ncode = 0;
+	ctx->memory = NULL;
+	ctx->map = NULL;
+	ctx->mapsize = 0;
+	ctx->code = &EMPTY;
+	ctx->slots = NULL;
+	ctx->bytes = EMPTYBYTES;
+}
+
+
+
+/// SECTION: LOAD
+
+// load byte codes (or container of cvm_compile) to code memory
+// of virtual machine and decode them into instructions for cvm_ctx_run
+extern int cvm_ctx_load(cvm_ctx_t *ctx, uint8_t *memory, int32_t msize) {
+	return ctx_load(ctx, memory, msize, NULL, 0);
+}
+
+#ifdef CVM_KERNEL_MMAP
+// map file read-only, map is NULL for empty file
+// which can't be mapped; return 2 if file can't be read
+static int ctx_map(const char *filename, uint8_t **map, size_t *size) {
+	struct stat st;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return 2;
+	}
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return 2;
+	}
+	if (st.st_size > INT32_MAX) {
+		close(fd);
+		return 1;
+	}
+
+	*map = NULL;
+	*size = (size_t)st.st_size;
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	*map = (uint8_t*)mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (*map == MAP_FAILED) {
+		*map = NULL;
+		return 2;
+	}
+
+	return 0;
+}
+#else
+// read file in allocated memory; return 2 if file can't be read
+static int ctx_read(const char *filename, uint8_t **memory, size_t *size) {
+	FILE *reader;
+	long fsize;
+
+	reader = fopen(filename, "rb");
+	if (reader == NULL) {
+		return 2;
+	}
+
+	fseek(reader, 0, SEEK_END);
+	fsize = ftell(reader);
+	fseek(reader, 0, SEEK_SET);
+	if (fsize < 0 || fsize > INT32_MAX) {
+		fclose(reader);
+		return (fsize < 0) ? 2 : 1;
+	}
+
+	*memory = (uint8_t*)malloc(sizeof(uint8_t)*((size_t)fsize+1));
+	if (*memory == NULL) {
+		fclose(reader);
+		return 1;
+	}
+	if (fread(*memory, 1, (size_t)fsize, reader) != (size_t)fsize) {
+		free(*memory);
+		fclose(reader);
+		return 2;
+	}
+	fclose(reader);
+
+	*size = (size_t)fsize;
+	return 0;
+}
+#endif
+
+// load file of byte codes, on POSIX it is mapped read-only and code
+// memory of context is its bytes, so processes running the same
+// program share them; return 2 if file can't be read
+extern int cvm_ctx_load_file(cvm_ctx_t *ctx, const char *filename) {
+	uint8_t *memory;
+	size_t size;
+	int retcode;
+
+#ifdef CVM_KERNEL_MMAP
+	retcode = ctx_map(filename, &memory, &size);
+	if (retcode != 0) {
+		return retcode;
+	}
+	if (memory == NULL) {
+		return cvm_ctx_load(ctx, (uint8_t[1]){C_HLT}, 0);
+	}
+
+	// mapping is owned by context only after successful load
+	retcode = ctx_load(ctx, memory, (int32_t)size, memory, size);
+	if (retcode != 0) {
+		munmap(memory, size);
+	}
+#else
+	retcode = ctx_read(filename, &memory, &size);
+	if (retcode != 0) {
+		return retcode;
+	}
+
+	retcode = cvm_ctx_load(ctx, memory, (int32_t)size);
+	free(memory);
+#endif
+
+	return retcode;
+}
+
+// load program from memory, bytes of code stay in map
+// if it is given (map is owned by context after success)
+static int ctx_load(cvm_ctx_t *ctx, uint8_t *memory, int32_t msize, uint8_t *map, size_t mapsize) {
+	bcdfile_t bcd;
+
+	if (msize < 0) {
+		return 1;
+	}
+
+	// file without magic is byte code only
+	if (msize >= 4 && memcmp(memory, CVM_KERNEL_BMAGIC, 4) == 0) {
+		if (bcd_parse(&bcd, memory, (uint32_t)msize) != 0) {
+			return 1;
+		}
+	} else {
+		memset(&bcd, 0, sizeof(bcd));
+		bcd.code.ptr = memory;
+		bcd.code.left = (uint32_t)msize;
+	}
+
+	if (bcd.code.left > (uint32_t)ctx->cmax) {
+		return 1;
+	}
+
+#ifdef CVM_KERNEL_JIT
+	jit_free(ctx);
+#endif
+	bcd_copy((bcdbuf_t){NULL, 0}, &ctx->symbols, &ctx->nsymbols);
+	bcd_copy((bcdbuf_t){NULL, 0}, &ctx->lines, &ctx->nlines);
+
+	// without memory for code ctx has empty program
+	if (ctx_decode(ctx, bcd.code.ptr, (int32_t)bcd.code.left, map, mapsize) != 0) {
+		ctx->verified = 0;
+		return 1;
+	}
+
+	// verify before superinstructions hide pushes of addresses
+	if (bcd_verify(ctx, &bcd) != 0) {
+		verify_code(ctx, NULL);
+	}
+
+	bcd_copy(bcd.symbols, &ctx->symbols, &ctx->nsymbols);
+	bcd_copy(bcd.lines, &ctx->lines, &ctx->nlines);
+
+#ifdef CVM_KERNEL_JIT
+	jit_code(ctx);
+#endif
+	fuse_code(ctx);
+	return 0;
+}
+
+// address of label by symbols of container or -1
+extern int32_t cvm_ctx_symbol(cvm_ctx_t *ctx, const char *name) {
+	bcdbuf_t symbols;
+	uint32_t addr, len;
+	size_t size;
+
+	symbols.ptr = ctx->symbols;
+	symbols.left = ctx->nsymbols;
+	size = strlen(name);
+
+	// symbols were checked by cvm_ctx_load
+	while (bcd_get32(&symbols, &addr) == 0 && bcd_get32(&symbols, &len) == 0) {
+		if (len == size && memcmp(symbols.ptr, name, size) == 0) {
+			return (int32_t)addr;
+		}
+		symbols.ptr += len;
+		symbols.left -= len;
+	}
+
+	return -1;
+}
+
+// label with the largest address <= mi, its name is written to
+// name of size bytes (with '\0'); return its address or -1
+extern int32_t cvm_ctx_label(cvm_ctx_t *ctx, int32_t mi, char *name, size_t size) {
+	bcdbuf_t symbols;
+	uint32_t addr, len, n;
+	int32_t found;
+
+	symbols.ptr = ctx->symbols;
+	symbols.left = ctx->nsymbols;
+	found = -1;
+
+	while (bcd_get32(&symbols, &addr) == 0 && bcd_get32(&symbols, &len) == 0) {
+		if ((int32_t)addr <= mi && (int32_t)addr > found && size > 0) {
+			found = (int32_t)addr;
+			n = (len < size) ? len : (uint32_t)size - 1;
+			memcpy(name, symbols.ptr, n);
+			name[n] = '\0';
+		}
+		symbols.ptr += len;
+		symbols.left -= len;
+	}
+
+	return found;
+}
+
+// line of source of instruction at byte mi by lines of
+// container or -1 (there are no lines or mi is inside of instruction)
+extern int32_t cvm_ctx_line(cvm_ctx_t *ctx, int32_t mi) {
+	bcdbuf_t lines;
+	uint32_t line;
+	uint8_t diff;
+
+	if (mi < 0 || mi >= ctx->cmused || ctx->slots[mi] < 0) {
+		return -1;
+	}
+
+	lines.ptr = ctx->lines;
+	lines.left = ctx->nlines;
+	line = 0;
+
+	for (int32_t ci = 0; ci <= ctx->slots[mi]; ++ci) {
+		if (bcd_get8(&lines, &diff) != 0) {
+			return -1;
+		}
+		if (diff != 0) {
+			line += diff;
+		} else if (bcd_get32(&lines, &line) != 0) {
+			return -1;
+		}
+	}
+
+	return (int32_t)line;
+}
+
+// number of superinstructions made by last load
+extern void cvm_ctx_fused(cvm_ctx_t *ctx, int32_t fused[CVM_FUSE_COUNT]) {
+	memcpy(fused, ctx->fused, sizeof(ctx->fused));
+}
+
+// result of verifier of last load: 1 if program runs without checks
+// for input of minargs ... (limit of stack)-maxdepth values
+extern int cvm_ctx_verified(cvm_ctx_t *ctx, int32_t *minargs, int32_t *maxdepth) {
+	*minargs = ctx->minargs;
+	*maxdepth = ctx->maxdepth;
+	return ctx->verified;
+}
+
+// load byte codes to static memory of virtual machine
+extern int cvm_load(uint8_t *memory, int32_t msize) {
+	return cvm_ctx_load(&VM, memory, msize);
+}
+
+extern int cvm_load_file(const char *filename) {
+	return cvm_ctx_load_file(&VM, filename);
+}
+
+extern int32_t cvm_symbol(const char *name) {
+	return cvm_ctx_symbol(&VM, name);
+}
+
+extern int32_t cvm_label(int32_t mi, char *name, size_t size) {
+	return cvm_ctx_label(&VM, mi, name, size);
+}
+
+extern int32_t cvm_line(int32_t mi) {
+	return cvm_ctx_line(&VM, mi);
+}
+
+// copy byte codes to code memory (or use them in map) and
+// decode them, return 1 if there is no memory for code
+static int ctx_decode(cvm_ctx_t *ctx, uint8_t *memory, int32_t msize, uint8_t *map, size_t mapsize) {
+	int32_t ci, size, count;
+
+	ctx->runmi = -1;
+	if (ctx_alloc(ctx, msize, map == NULL) != 0) {
+		return 1;
+	}
+
+	if (map != NULL) {
+		ctx->memory = memory;
+		ctx->map = map;
+		ctx->mapsize = mapsize;
+	} else {
+		memcpy(ctx->memory, memory, msize);
+	}
+	ctx->cmused = msize;
+
+	ci = 0;
+	for (int32_t mi = 0; mi < msize; mi += size) {
+		size = decode_insn(ctx, mi, &ctx->code[ci], &count);
+		ctx->slots[mi] = ci;
+		for (int32_t i = 0; i < count; ++i) {
+			ctx->bytes[ci++] = mi;
+		}
+		for (int32_t i = mi+1; i < mi+size && i < msize; ++i) {
+			ctx->slots[i] = -1;
+		}
+	}
+
+	// end of code
+	ctx->code[ci].opcode = C_HLT;
+	ctx->code[ci].arg = 0;
+	ctx->bytes[ci] = msize;
+	ctx->ncode = ci;
+	return 0;
+}
+
+// decode instruction at byte mi into *count instructions
+// (at most CVM_KERNEL_DECODE) and return its size in bytes
+static int32_t decode_insn(cvm_ctx_t *ctx, int32_t mi, cvm_insn_t *insn, int32_t *count) {
+	uint8_t opcode;
+
+	opcode = ctx->memory[mi];
+	insn->opcode = opcode;
+	insn->arg = 0;
+	*count = 1;
+
+	switch(opcode) {
+		case C_PUSH:
+			insn->arg = decode_arg(ctx, mi+1, 4);
+			return 5;
+		case C_PSH8: case C_PS16:
+			insn->opcode = C_PUSH;
+			insn->arg = decode_arg(ctx, mi+1, (opcode == C_PSH8) ? 1 : 2);
+			return (opcode == C_PSH8) ? 2 : 3;
+		// push and next instruction
+		case C_LODI:
+			insn[0].opcode = C_PUSH;
+			insn[0].arg = decode_arg(ctx, mi+1, 1);
+			insn[1].opcode = C_LOAD;
+			insn[1].arg = 0;
+			*count = 2;
+			return 2;
+		case C_STRI:
+			insn[0].opcode = C_PUSH;
+			insn[0].arg = decode_arg(ctx, mi+1, 1);
+			insn[1].opcode = C_PUSH;
+			insn[1].arg = decode_arg(ctx, mi+2, 1);
+			insn[2].opcode = C_STOR;
+			insn[2].arg = 0;
+			*count = 3;
+			return 3;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_JEI: case C_JLI: case C_JNEI:
+		case C_JLEI: case C_JGEI:
+	#endif
+		case C_JMPI: case C_JGI:
+			insn[0].opcode = C_PUSH;
+			insn[0].arg = decode_arg(ctx, mi+1, 2);
+			insn[1].opcode = decode_jump(opcode);
+			insn[1].arg = 0;
+			*count = 2;
+			return 3;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_FCAL:
+	#endif
+		case C_CALL:
+			// return address
+			insn->arg = mi + 1;
+			return 1;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_ADD: case C_SUB: case C_MUL: case C_DIV:
+		case C_MOD: case C_SHR: case C_SHL: case C_XOR:
+		case C_AND: case C_OR:  case C_NOT: case C_JE:
+		case C_JL:  case C_JNE: case C_JLE: case C_JGE:
+		case C_ALLC: case C_RET: case C_FLD: case C_FST:
+	#endif
+		case C_POP:  case C_INC:  case C_DEC: case C_JMP:
+		case C_JG:   case C_STOR: case C_LOAD: case C_HLT:
+			return 1;
+		default:
+			insn->opcode = C_UNDF;
+			return 1;
+	}
+}
+
+// signed big-endian argument of n bytes from byte mi, argument cut
+// by the end of code reads as zero (code memory can be read-only map
+// of file, so its bytes after cmused are not read)
+static int32_t decode_arg(cvm_ctx_t *ctx, int32_t mi, int32_t n) {
+	uint8_t bytes[4];
+	int32_t left;
+
+	memset(bytes, 0, sizeof(bytes));
+	left = ctx->cmused - mi;
+	if (left > 0) {
+		memcpy(bytes, ctx->memory + mi, (left < n) ? left : n);
+	}
+
+	switch(n) {
+		case 1:  return (int8_t)bytes[0];
+		case 2:  return (int16_t)((uint16_t)bytes[0] << 8 | bytes[1]);
+		default: return (int32_t)join_8bits_to_32bits(bytes);
+	}
+}
+
+// jump of immediate form of jump
+static uint8_t decode_jump(uint8_t opcode) {
+	switch(opcode) {
+		case C_JMPI: return C_JMP;
+		case C_JGI:  return C_JG;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_JEI:  return C_JE;
+		case C_JLI:  return C_JL;
+		case C_JNEI: return C_JNE;
+		case C_JLEI: return C_JLE;
+		case C_JGEI: return C_JGE;
+	#endif
+		default:     return C_UNDF;
+	}
+}
+
+// prove for all paths of program that stack has enough values for
+// every instruction, depth of stack is limited and jumps go
+// to the start of instructions by addresses pushed in code,
+// states before instructions of verified program are given
+// to *states (allocated by malloc) if states != NULL
+static void verify_code(cvm_ctx_t *ctx, vstate_t **states) {
+	verifier_t vf;
+	vstate_t st;
+	int32_t ci;
+	int retcode;
+
+	ctx->verified = 0;
+	ctx->minargs = 0;
+	ctx->maxdepth = 0;
+
+	if (verify_init(&vf, ctx, 0) != 0) {
+		return;
+	}
+
+	// program starts with inputs only
+	memset(&st, 0, sizeof(st));
+	retcode = verify_next(&vf, &st, 0);
+
+	while (retcode == 0 && vf.nwork > 0) {
+		ci = vf.work[--vf.nwork];
+		vf.states[ci].queued = 0;
+		st = vf.states[ci];
+		vf.ci = ci;
+		retcode = verify_insn(&vf, &st, ci);
+	}
+
+	if (retcode == 0) {
+		ctx->verified = 1;
+		ctx->minargs = vf.procs[0].minargs;
+		ctx->maxdepth = vf.maxdepth;
+	}
+
+	if (states != NULL && retcode == 0) {
+		*states = vf.states;
+		vf.states = NULL;
+	}
+
+	verify_free(&vf);
+}
+
+// prove program as verify_code does it by states of jump targets from
+// container: code is passed once in order, state of instruction comes
+// from previous instruction or from table, then every jump must give
+// to table state with the same depth and known values; 1 if table
+// doesn't prove program
+static int verify_table(cvm_ctx_t *ctx, bcdbuf_t table) {
+	verifier_t vf;
+	vstate_t st, *next;
+	uint32_t mi, depth, pos, num;
+	uint8_t nconst;
+	int32_t ci;
+	int retcode;
+
+	if (verify_init(&vf, ctx, 1) != 0) {
+		return 1;
+	}
+
+	retcode = 0;
+	while (retcode == 0 && table.left > 0) {
+		if (bcd_get32(&table, &mi) != 0 || bcd_get32(&table, &depth) != 0 || bcd_get8(&table, &nconst) != 0) {
+			retcode = 1;
+			break;
+		}
+		if (mi > (uint32_t)ctx->cmused || nconst > CVM_KERNEL_VCONST) {
+			retcode = 1;
+			break;
+		}
+		if ((int32_t)depth < -ctx->stack.max || (int32_t)depth > ctx->stack.max) {
+			retcode = 1;
+			break;
+		}
+
+		ci = ((int32_t)mi < ctx->cmused) ? ctx->slots[mi] : ctx->ncode;
+		if (ci < 0 || vf.states[ci].seen) {
+			retcode = 1;
+			break;
+		}
+
+		next = &vf.states[ci];
+		next->seen = 1;
+		next->target = 1;
+		next->depth = (int32_t)depth;
+		for (int32_t i = 0; i < nconst; ++i) {
+			if (bcd_get32(&table, &pos) != 0 || bcd_get32(&table, &num) != 0) {
+				retcode = 1;
+				break;
+			}
+			vstate_set(next, (int32_t)pos, (int32_t)num);
+		}
+	}
+
+	// program starts with inputs only
+	memset(&st, 0, sizeof(st));
+	if (retcode == 0) {
+		retcode = verify_next(&vf, &st, 0);
+	}
+
+	for (ci = 0; retcode == 0 && ci <= ctx->ncode; ++ci) {
+		if (!vf.states[ci].seen) {
+			continue;
+		}
+		st = vf.states[ci];
+		vf.ci = ci;
+		retcode = verify_insn(&vf, &st, ci);
+	}
+
+	if (retcode == 0) {
+		ctx->verified = 1;
+		ctx->minargs = vf.procs[0].minargs;
+		ctx->maxdepth = vf.maxdepth;
+	}
+
+	verify_free(&vf);
+	return retcode;
+}
+
+// memory of verifier for code of ctx, work list is not
+// needed if states of jump targets are given by table
+static int verify_init(verifier_t *vf, cvm_ctx_t *ctx, int table) {
+	vf->ctx = ctx;
+	vf->states = (vstate_t*)calloc(ctx->ncode+1, sizeof(vstate_t));
+	vf->procs = (vproc_t*)malloc(sizeof(vproc_t)*(ctx->ncode+1));
+	vf->calls = (int32_t*)malloc(sizeof(int32_t)*(ctx->ncode+1));
+	vf->work = table ? NULL : (int32_t*)malloc(sizeof(int32_t)*(ctx->ncode+1));
+	vf->table = table;
+	vf->ci = -1;
+	vf->nwork = 0;
+	vf->maxdepth = 0;
+
+	if (vf->states == NULL || vf->procs == NULL || vf->calls == NULL || (!table && vf->work == NULL)) {
+		verify_free(vf);
+		return 1;
+	}
+
+	for (int32_t ci = 0; ci <= ctx->ncode; ++ci) {
+		vf->procs[ci] = (vproc_t){ .minargs = 0, .ret = CVM_KERNEL_VNPOS, .calls = -1 };
+		// fcal is not in list of its procedure
+		vf->calls[ci] = -2;
+	}
+	return 0;
+}
+
+static void verify_free(verifier_t *vf) {
+	free(vf->states);
+	free(vf->procs);
+	free(vf->calls);
+	free(vf->work);
+	vf->states = NULL;
+	vf->procs = NULL;
+	vf->calls = NULL;
+	vf->work = NULL;
+}
+
+// apply instruction ci to state st and pass it to next instructions
+static int verify_insn(verifier_t *vf, vstate_t *st, int32_t ci) {
+	cvm_insn_t *insn;
+	int32_t x, y, pos1, pos2;
+	int known;
+
+	insn = &vf->ctx->code[ci];
+
+	switch(insn->opcode) {
+		case C_PUSH:
+			if (verify_push(vf, st, 1, insn->arg) != 0) {
+				return 1;
+			}
+			return verify_next(vf, st, ci+1);
+		case C_POP:
+			if (verify_need(vf, st, 1) != 0) {
+				return 1;
+			}
+			verify_pop(st, &x);
+			return verify_next(vf, st, ci+1);
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_NOT:
+	#endif
+		case C_INC: case C_DEC:
+			if (verify_need(vf, st, 1) != 0) {
+				return 1;
+			}
+			verify_pop(st, &x);
+			verify_push(vf, st, 0, 0);
+			return verify_next(vf, st, ci+1);
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_ADD: case C_SUB: case C_MUL: case C_DIV:
+		case C_MOD: case C_SHR: case C_SHL: case C_XOR:
+		case C_AND: case C_OR:
+			if (verify_need(vf, st, 2) != 0) {
+				return 1;
+			}
+			verify_pop(st, &x);
+			verify_pop(st, &y);
+			verify_push(vf, st, 0, 0);
+			return verify_next(vf, st, ci+1);
+		case C_ALLC:
+			if (verify_need(vf, st, 1) != 0) {
+				return 1;
+			}
+			if (!verify_pop(st, &x) || x < 0 || x >= vf->ctx->stack.max) {
+				return 1;
+			}
+			// allc fails if stack becomes full
+			verify_depth(vf, st->depth + x + 1);
+			st->depth += x;
+			return verify_next(vf, st, ci+1);
+		case C_JE: case C_JL: case C_JNE:
+		case C_JLE: case C_JGE:
+	#endif
+		case C_JG:
+			if (verify_need(vf, st, 3) != 0) {
+				return 1;
+			}
+			if (!verify_pop(st, &x) || verify_target(vf, x, &x) != 0) {
+				return 1;
+			}
+			verify_pop(st, &y);
+			verify_pop(st, &y);
+			if (verify_next(vf, st, x) != 0) {
+				return 1;
+			}
+			return verify_next(vf, st, ci+1);
+		case C_JMP:
+			if (verify_need(vf, st, 1) != 0) {
+				return 1;
+			}
+			if (!verify_pop(st, &x) || verify_target(vf, x, &x) != 0) {
+				return 1;
+			}
+			return verify_next(vf, st, x);
+		case C_CALL:
+			if (verify_need(vf, st, 1) != 0) {
+				return 1;
+			}
+			if (!verify_pop(st, &x) || verify_target(vf, x, &x) != 0) {
+				return 1;
+			}
+			// return address
+			verify_push(vf, st, 1, insn->arg);
+			return verify_next(vf, st, x);
+		case C_LOAD:
+			if (verify_need(vf, st, 1) != 0) {
+				return 1;
+			}
+			// address is checked by load
+			known = verify_pop(st, &x);
+			pos1 = verify_index(st, known, x);
+			if (pos1 != CVM_KERNEL_VNPOS && vstate_get(st, pos1, &y)) {
+				verify_push(vf, st, 1, y);
+			} else {
+				verify_push(vf, st, 0, 0);
+			}
+			return verify_next(vf, st, ci+1);
+		case C_STOR:
+			if (verify_need(vf, st, 2) != 0) {
+				return 1;
+			}
+			// addresses are checked by stor
+			known = verify_pop(st, &x);
+			known |= verify_pop(st, &y) << 1;
+			pos1 = verify_index(st, known & 1, x);
+			pos2 = verify_index(st, known & 2, y);
+			if (pos1 == CVM_KERNEL_VNPOS) {
+				st->nconst = 0;
+			} else if (pos2 != CVM_KERNEL_VNPOS && vstate_get(st, pos2, &y)) {
+				vstate_set(st, pos1, y);
+			} else {
+				vstate_forget(st, pos1);
+			}
+			return verify_next(vf, st, ci+1);
+		case C_HLT: case C_UNDF:
+			return 0;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_FCAL:
+			if (verify_need(vf, st, 1) != 0) {
+				return 1;
+			}
+			if (!verify_pop(st, &x) || verify_target(vf, x, &x) != 0) {
+				return 1;
+			}
+			return verify_call(vf, st, ci, x);
+		case C_RET:
+			return verify_ret(vf, st);
+		case C_FLD:
+			if (verify_need(vf, st, 1) != 0) {
+				return 1;
+			}
+			// address is checked by fld
+			verify_pop(st, &x);
+			verify_push(vf, st, 0, 0);
+			return verify_next(vf, st, ci+1);
+		case C_FST:
+			if (verify_need(vf, st, 2) != 0) {
+				return 1;
+			}
+			// addresses are checked by fst, they are relative to frame
+			verify_pop(st, &x);
+			verify_pop(st, &y);
+			st->nconst = 0;
+			return verify_next(vf, st, ci+1);
+	#endif
+		default:
+			return 1;
+	}
+}
+
+// merge state st into state before instruction ci
+static int verify_next(verifier_t *vf, vstate_t *st, int32_t ci) {
+	vstate_t *next;
+	int32_t n, num;
+
+	next = &vf->states[ci];
+
+	// state of table (or passed instruction) must know no more than st,
+	// state of next instruction is given by previous one
+	if (vf->table) {
+		if (next->seen) {
+			if (next->depth != st->depth) {
+				return 1;
+			}
+			for (int32_t i = 0; i < next->nconst; ++i) {
+				if (!vstate_get(st, next->consts[i].pos, &num) || num != next->consts[i].num) {
+					return 1;
+				}
+			}
+			return 0;
+		}
+		if (ci != vf->ci+1) {
+			return 1;
+		}
+		*next = *st;
+		next->seen = 1;
+		next->target = 0;
+		return 0;
+	}
+
+	if (!next->seen) {
+		*next = *st;
+		next->seen = 1;
+		next->queued = 0;
+		next->target = (ci != vf->ci+1);
+	} else {
+		next->target |= (ci != vf->ci+1);
+		// instruction is in one procedure
+		if (next->depth != st->depth || next->proc != st->proc) {
+			return 1;
+		}
+
+		// keep values which are equal on both paths
+		n = 0;
+		for (int32_t i = 0; i < next->nconst; ++i) {
+			if (vstate_get(st, next->consts[i].pos, &num) && num == next->consts[i].num) {
+				next->consts[n++] = next->consts[i];
+			}
+		}
+
+		if (n == next->nconst) {
+			return 0;
+		}
+		next->nconst = n;
+	}
+
+	verify_queue(vf, ci);
+	return 0;
+}
+
+// instruction ci is verified again with its state
+static void verify_queue(verifier_t *vf, int32_t ci) {
+	if (!vf->states[ci].queued) {
+		vf->states[ci].queued = 1;
+		vf->work[vf->nwork++] = ci;
+	}
+}
+
+// stack must hold count values
+static int verify_need(verifier_t *vf, vstate_t *st, int32_t count) {
+	return verify_args(vf, st->proc, count - st->depth);
+}
+
+// procedure needs at least count values under its frame
+// (program needs count input values)
+static int verify_args(verifier_t *vf, int32_t proc, int32_t count) {
+	if (count > vf->procs[proc].minargs) {
+		vf->procs[proc].minargs = count;
+	#ifdef CVM_KERNEL_IAPPEND
+		verify_calls(vf, proc);
+	#endif
+	}
+	return vf->procs[proc].minargs > vf->ctx->stack.max;
+}
+
+#ifdef CVM_KERNEL_IAPPEND
+	// fcal ci of procedure at instruction entry: procedure starts with
+	// empty frame, caller gives values which it takes and continues
+	// after its ret with the depth of ret over depth of fcal (caller
+	// doesn't know its values after call), frames are not in tables
+	static int verify_call(verifier_t *vf, vstate_t *st, int32_t ci, int32_t entry) {
+		vproc_t *proc;
+		vstate_t frame;
+
+		if (vf->table) {
+			return 1;
+		}
+
+		memset(&frame, 0, sizeof(frame));
+		frame.proc = entry;
+		if (verify_next(vf, &frame, entry) != 0) {
+			return 1;
+		}
+
+		proc = &vf->procs[entry];
+		if (vf->calls[ci] == -2) {
+			vf->calls[ci] = proc->calls;
+			proc->calls = ci;
+		}
+
+		if (verify_need(vf, st, proc->minargs) != 0) {
+			return 1;
+		}
+
+		// fcal continues when ret of procedure is found
+		if (proc->ret == CVM_KERNEL_VNPOS) {
+			return 0;
+		}
+
+		st->depth += proc->ret;
+		if (st->depth > vf->ctx->stack.max) {
+			return 1;
+		}
+		verify_depth(vf, st->depth);
+		st->nconst = 0;
+		return verify_next(vf, st, ci+1);
+	}
+
+	// all rets of procedure leave the same depth over its frame
+	// (ret of program fails, its depth is not used)
+	static int verify_ret(verifier_t *vf, vstate_t *st) {
+		vproc_t *proc;
+
+		proc = &vf->procs[st->proc];
+		if (proc->ret == CVM_KERNEL_VNPOS) {
+			proc->ret = st->depth;
+			verify_calls(vf, st->proc);
+			return 0;
+		}
+
+		return proc->ret != st->depth;
+	}
+
+	// verify fcal instructions of procedure again
+	static void verify_calls(verifier_t *vf, int32_t proc) {
+		for (int32_t ci = vf->procs[proc].calls; ci >= 0; ci = vf->calls[ci]) {
+			verify_queue(vf, ci);
+		}
+	}
+#endif
+
+// stack grows up to depth values over inputs
+static void verify_depth(verifier_t *vf, int32_t depth) {
+	if (depth > vf->maxdepth) {
+		vf->maxdepth = depth;
+	}
+}
+
+static int verify_push(verifier_t *vf, vstate_t *st, int known, int32_t num) {
+	if (st->depth >= vf->ctx->stack.max) {
+		return 1;
+	}
+
+	st->depth += 1;
+	verify_depth(vf, st->depth);
+
+	if (known) {
+		vstate_set(st, st->depth-1, num);
+	}
+
+	return 0;
+}
+
+// return 1 if value was known
+static int verify_pop(vstate_t *st, int32_t *num) {
+	int known;
+
+	st->depth -= 1;
+	known = vstate_get(st, st->depth, num);
+	vstate_forget(st, st->depth);
+
+	return known;
+}
+
+// position of value by address of load/stor or CVM_KERNEL_VNPOS
+// if address is unknown or its position depends on inputs
+static int32_t verify_index(vstate_t *st, int known, int32_t index) {
+	if (!known || index >= 0 || index < -CVM_KERNEL_LIMIT) {
+		return CVM_KERNEL_VNPOS;
+	}
+
+	return st->depth + index;
+}
+
+// byte mi must be start of instruction
+static int verify_target(verifier_t *vf, int32_t mi, int32_t *ci) {
+	if (mi < 0 || mi >= vf->ctx->cmused || vf->ctx->slots[mi] < 0) {
+		return 1;
+	}
+
+	*ci = vf->ctx->slots[mi];
+	return 0;
+}
+
+static int vstate_get(vstate_t *st, int32_t pos, int32_t *num) {
+	for (int32_t i = 0; i < st->nconst; ++i) {
+		if (st->consts[i].pos == pos) {
+			*num = st->consts[i].num;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// remember value at position, the deepest value
+// is forgotten if there is no free place
+static void vstate_set(vstate_t *st, int32_t pos, int32_t num) {
+	int32_t i, low;
+
+	low = 0;
+	for (i = 0; i < st->nconst; ++i) {
+		if (st->consts[i].pos == pos) {
+			break;
+		}
+		if (st->consts[i].pos < st->consts[low].pos) {
+			low = i;
+		}
+	}
+
+	if (i == CVM_KERNEL_VCONST) {
+		i = low;
+	} else if (i == st->nconst) {
+		st->nconst += 1;
+	}
+
+	st->consts[i].pos = pos;
+	st->consts[i].num = num;
+}
+
+static void vstate_forget(vstate_t *st, int32_t pos) {
+	for (int32_t i = 0; i < st->nconst; ++i) {
+		if (st->consts[i].pos == pos) {
+			st->consts[i] = st->consts[--st->nconst];
+			return;
+		}
+	}
+}
+
+// replace frequent sequences which start with push by superinstructions,
+// the following instructions stay in code as targets of jumps
+static void fuse_code(cvm_ctx_t *ctx) {
+	int kind;
+
+	memset(ctx->fused, 0, sizeof(ctx->fused));
+
+	for (int32_t i = 0; i < ctx->ncode; ++i) {
+		if (ctx->code[i].opcode != C_PUSH) {
+			continue;
+		}
+
+		kind = fuse_insn(&ctx->code[i]);
+		if (kind >= 0) {
+			ctx->fused[kind] += 1;
+		}
+	}
+}
+
+// example: (push -1; load) -> (plod -1; load)
+static int fuse_insn(cvm_insn_t *insn) {
+	switch(insn[1].opcode) {
+		case C_LOAD:
+			insn->opcode = C_PLOD;
+			return CVM_FUSE_LOAD;
+		case C_JMP:
+			insn->opcode = C_PJMP;
+			return CVM_FUSE_JMP;
+		case C_CALL:
+			insn->opcode = C_PCAL;
+			return CVM_FUSE_CALL;
+		case C_JG:
+			insn->opcode = C_PJG;
+			return CVM_FUSE_JCC;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_JE:
+			insn->opcode = C_PJE;
+			return CVM_FUSE_JCC;
+		case C_JL:
+			insn->opcode = C_PJL;
+			return CVM_FUSE_JCC;
+		case C_JNE:
+			insn->opcode = C_PJNE;
+			return CVM_FUSE_JCC;
+		case C_JLE:
+			insn->opcode = C_PJLE;
+			return CVM_FUSE_JCC;
+		case C_JGE:
+			insn->opcode = C_PJGE;
+			return CVM_FUSE_JCC;
+		case C_FCAL:
+			insn->opcode = C_PFCL;
+			return CVM_FUSE_FCAL;
+	#endif
+		case C_PUSH:
+			if (insn[2].opcode != C_STOR) {
+				return -1;
+			}
+			if (insn[3].opcode == C_POP) {
+				insn->opcode = C_PSTP;
+				return CVM_FUSE_STORP;
+			}
+			insn->opcode = C_PSTR;
+			return CVM_FUSE_STOR;
+		default:
+			return -1;
+	}
+}
+
+// opcode of instruction before fuse_code
+static uint8_t insn_opcode(uint8_t opcode) {
+	switch(opcode) {
+		case C_PLOD: case C_PSTR: case C_PSTP:
+		case C_PJMP: case C_PCAL: case C_PJG:
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_PJE:  case C_PJL:  case C_PJNE:
+		case C_PJLE: case C_PJGE: case C_PFCL:
+	#endif
+			return C_PUSH;
+		default:
+			return opcode;
+	}
+}
+
+// instruction is one of additional instructions (CVM_KERNEL_IAPPEND)
+static int insn_append(uint8_t opcode) {
+	switch(opcode) {
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_ADD: case C_SUB: case C_MUL: case C_DIV:
+		case C_MOD: case C_SHR: case C_SHL: case C_XOR:
+		case C_AND: case C_OR:  case C_NOT: case C_JE:
+		case C_JL:  case C_JNE: case C_JLE: case C_JGE:
+		case C_ALLC: case C_FCAL: case C_RET: case C_FLD:
+		case C_FST:
+			return 1;
+	#endif
+		default:
+			return 0;
+	}
+}
+
+// number of instructions done by superinstruction
+static int32_t insn_count(uint8_t opcode) {
+	switch(opcode) {
+		case C_PLOD: case C_PJMP: case C_PCAL: case C_PJG:
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_PJE:  case C_PJL:  case C_PJNE:
+		case C_PJLE: case C_PJGE: case C_PFCL:
+	#endif
+			return 2;
+		case C_PSTR:
+			return 3;
+		case C_PSTP:
+			return 4;
+		default:
+			return 1;
+	}
+}
+
+// instructions of superinstruction ip up to the next instruction
+// of byte code (compact instruction is not split)
+static int32_t insn_split(cvm_ctx_t *ctx, const cvm_insn_t *scratch, const cvm_insn_t *ip) {
+	int32_t ci, count;
+
+	count = insn_count(ip->opcode);
+	if (ip == &scratch[0]) {
+		return count;
+	}
+
+	ci = (int32_t)(ip - ctx->code);
+	for (int32_t i = 1; i < count; ++i) {
+		if (ctx->bytes[ci+i] != ctx->bytes[ci]) {
+			return i;
+		}
+	}
+	return count;
+}
+
+// make push from superinstruction which includes instruction ci,
+// so that program comes to ci; return index of push or -1
+static int32_t fuse_split(cvm_ctx_t *ctx, int32_t ci) {
+	for (int32_t i = ci-1; i >= 0 && i >= ci-3; --i) {
+		if (i + insn_count(ctx->code[i].opcode) > ci) {
+			ctx->code[i].opcode = C_PUSH;
+			return i;
+		}
+	}
+	return -1;
+}
+
+// decoded instruction at byte mi < cmused
+static inline const cvm_insn_t *insn_at(cvm_ctx_t *ctx, cvm_insn_t *scratch, int32_t mi) {
+	int32_t size, count;
+
+	if (ctx->slots[mi] >= 0) {
+		return ctx->code + ctx->slots[mi];
+	}
+
+	// jump inside of instruction: decode from byte mi and continue
+	// at next byte, instructions of compact instruction are fused,
+	// so that program does not stop between them; the last
+	// instruction of scratch keeps byte mi for insn_byte
+	size = decode_insn(ctx, mi, &scratch[0], &count);
+	scratch[count].opcode = C_SYNC;
+	scratch[count].arg = mi + size;
+	scratch[CVM_KERNEL_DECODE+1].opcode = C_SYNC;
+	scratch[CVM_KERNEL_DECODE+1].arg = mi;
+	if (scratch[0].opcode == C_PUSH) {
+		fuse_insn(&scratch[0]);
+	}
+
+	return scratch;
+}
+
+// byte of instruction ip of interpreter loop, inverse of insn_at
+static int32_t insn_byte(cvm_ctx_t *ctx, const cvm_insn_t *scratch, const cvm_insn_t *ip) {
+	if (ip == &scratch[0]) {
+		return scratch[CVM_KERNEL_DECODE+1].arg;
+	}
+	if (ip->opcode == C_SYNC) {
+		return ip->arg;
+	}
+
+	// bytes[ncode] is the end of code
+	return ctx->bytes[ip - ctx->code];
+}
+
+
+
+/// SECTION: JIT
+
+#ifdef CVM_KERNEL_JIT
+
+// registers of native code:
+// r12 = stack base, r13 = stack size, r14 = jump table,
+// r15 = capacity of stack, rbx = pointer to vmstack_t
+// (frame and depth of fcal are kept there), rbp = pointer
+// to byte of exit (native code continues there if r8d != 0)
+enum {
+	J_O = 0x0, J_NO = 0x1, J_B  = 0x2, J_AE = 0x3,
+	J_E = 0x4, J_NE = 0x5, J_BE = 0x6, J_A  = 0x7,
+	J_S = 0x8, J_NS = 0x9, J_L  = 0xC, J_GE = 0xD,
+	J_LE = 0xE, J_G = 0xF,
+};
+
+// x86 registers used as operands
+enum {
+	R_EAX = 0, R_ECX = 1, R_EDX = 2,
+};
+
+// translate loaded code to x86-64,
+// ctx->jit stays NULL if translation failed
+static void jit_code(cvm_ctx_t *ctx) {
+	jitbuf_t jb;
+	uint8_t *native;
+	uint64_t *table;
+	size_t csize, size;
+	int32_t ci;
+
+	memset(&jb, 0, sizeof(jb));
+	jb.ctx = ctx;
+	jb.native = (int32_t*)malloc(sizeof(int32_t)*(ctx->ncode+1));
+	jb.bytes = ctx->bytes;
+	jb.cold = (int32_t*)malloc(sizeof(int32_t)*(ctx->ncode+1));
+	if (jb.native == NULL || jb.cold == NULL) {
+		goto end;
+	}
+
+	for (ci = 0; ci <= ctx->ncode; ++ci) {
+		jb.native[ci] = -1;
+	}
+
+	jit_prologue(&jb);
+
+	// superinstructions leave code of covered instructions
+	// to the end, it is used only by jumps inside of them
+	for (ci = 0; ci <= ctx->ncode; ci += jit_insn(&jb, ci)) {
+		;
+	}
+	for (int32_t i = 0; i < jb.ncold; ++i) {
+		ci = jb.cold[i];
+		jb.native[ci] = jb.size;
+		jb.mi = jb.bytes[ci];
+		jit_generic(&jb, ci);
+		jit_jmp(&jb, ci+1);
+	}
+
+	if (jb.failed) {
+		goto end;
+	}
+
+	for (int32_t i = 0; i < jb.nfix; ++i) {
+		jit_patch32(&jb, jb.fix[i].at, jb.native[jb.fix[i].ci] - (jb.fix[i].at + 4));
+	}
+
+	csize = (jb.size + 7) & ~(size_t)7;
+	size = csize + sizeof(uint64_t)*ctx->cmused;
+
+	native = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (native == MAP_FAILED) {
+		goto end;
+	}
+
+	// jump table: byte of code -> native code or 0
+	table = (uint64_t*)(native + csize);
+	for (int32_t mi = 0; mi < ctx->cmused; ++mi) {
+		table[mi] = (ctx->slots[mi] < 0) ? 0 :
+			(uint64_t)(uintptr_t)(native + jb.native[ctx->slots[mi]]);
+	}
+
+	memcpy(native, jb.data, jb.size);
+	memcpy(native + jb.table, &(uint64_t){(uint64_t)(uintptr_t)table}, 8);
+
+	if (mprotect(native, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(native, size);
+		goto end;
+	}
+
+	ctx->jit = native;
+	ctx->jitsize = size;
+
+end:
+	free(jb.data);
+	free(jb.native);
+	free(jb.cold);
+	free(jb.fix);
+}
+
+static void jit_free(cvm_ctx_t *ctx) {
+	if (ctx->jit != NULL) {
+		munmap(ctx->jit, ctx->jitsize);
+	}
+	ctx->jit = NULL;
+	ctx->jitsize = 0;
+}
+
+// run native code from byte *mi = 0 of program,
+// return CVM_KERNEL_JEXIT if interpreter must continue at byte *mi
+VM_INLINE int jit_run(cvm_ctx_t *ctx, vmstack_t *stack, int32_t *mi) {
+	int (*entry)(int32_t *base, vmstack_t *stack, int32_t *mi, int32_t cap, int resume);
+	int retcode;
+
+	stack->base[stack->size-1] = stack->tos;
+
+	*(void**)&entry = ctx->jit;
+	retcode = entry(stack->base, stack, mi, stack->cap, 0);
+
+	// native code stops at byte *mi if stack or frames of fcal
+	// are full, then it continues there in grown memory
+	while (retcode == CVM_KERNEL_JGROW || retcode == CVM_KERNEL_JFRAME) {
+		if (retcode == CVM_KERNEL_JGROW && vmstack_grow(stack, stack->cap+1) != 0) {
+			return wrap_return(C_PUSH, 1);
+		}
+	#ifdef CVM_KERNEL_IAPPEND
+		if (retcode == CVM_KERNEL_JFRAME && vmframes_grow(stack->memory, stack->depth+1) != 0) {
+			return wrap_return(C_FCAL, 3);
+		}
+	#endif
+		retcode = entry(stack->base, stack, mi, stack->cap, 1);
+	}
+
+	stack->tos = stack->base[stack->size-1];
+	return retcode;
+}
+
+// int entry(int32_t *base, vmstack_t *stack, int32_t *mi, int32_t cap)
+static void jit_prologue(jitbuf_t *jb) {
+	int32_t l1;
+
+	// push rbx; push rbp; push r12; push r13; push r14; push r15
+	jit_bytes(jb, 10, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);
+	// mov rbx, rsi; mov rbp, rdx; mov r12, rdi; mov r15d, ecx
+	jit_bytes(jb, 12, 0x48, 0x89, 0xF3, 0x48, 0x89, 0xD5, 0x49, 0x89, 0xFC, 0x41, 0x89, 0xCF);
+	// mov r13d, [rbx+size]
+	jit_bytes(jb, 4, 0x44, 0x8B, 0x6B, (uint8_t)offsetof(vmstack_t, size));
+	// mov r14, table
+	jit_bytes(jb, 2, 0x49, 0xBE);
+	jb->table = jb->size;
+	jit_bytes(jb, 8, 0, 0, 0, 0, 0, 0, 0, 0);
+	// test r8d, r8d; jnz continue
+	jit_bytes(jb, 3, 0x45, 0x85, 0xC0);
+	l1 = jit_jcc8(jb, J_NE);
+	jit_jmp(jb, 0);
+
+	// halt: return 0
+	jb->lhalt = jb->size;
+	jit_bytes(jb, 2, 0x31, 0xC0);
+	// error: return eax
+	jb->lerror = jb->size;
+	// mov [rbx+size], r13d
+	jit_bytes(jb, 4, 0x44, 0x89, 0x6B, (uint8_t)offsetof(vmstack_t, size));
+	// pop r15; pop r14; pop r13; pop r12; pop rbp; pop rbx; ret
+	jit_bytes(jb, 11, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3);
+
+	// exit to interpreter: *mi = eax, return CVM_KERNEL_JEXIT
+	jb->lexit = jb->size;
+	jit_bytes(jb, 3, 0x89, 0x45, 0x00);
+	jit_byte(jb, 0xB8);
+	jit_u32(jb, (uint32_t)CVM_KERNEL_JEXIT);
+	jit_goto(jb, jb->lerror);
+
+	// stack is full: *mi = eax, return CVM_KERNEL_JGROW
+	jb->lgrow = jb->size;
+	jit_bytes(jb, 3, 0x89, 0x45, 0x00);
+	jit_byte(jb, 0xB8);
+	jit_u32(jb, (uint32_t)CVM_KERNEL_JGROW);
+	jit_goto(jb, jb->lerror);
+
+	// frames of fcal are full: *mi = eax, return CVM_KERNEL_JFRAME
+	jb->lframe = jb->size;
+	jit_bytes(jb, 3, 0x89, 0x45, 0x00);
+	jit_byte(jb, 0xB8);
+	jit_u32(jb, (uint32_t)CVM_KERNEL_JFRAME);
+	jit_goto(jb, jb->lerror);
+
+	// continue at byte *mi after jit_run grows stack
+	jit_land8(jb, l1);
+	// mov eax, [rbp]
+	jit_bytes(jb, 3, 0x8B, 0x45, 0x00);
+	jit_table_jump(jb);
+}
+
+// translate instruction ci (or superinstruction from ci),
+// return number of instructions
+static int32_t jit_insn(jitbuf_t *jb, int32_t ci) {
+	cvm_insn_t *insn;
+	int32_t num;
+
+	insn = &jb->ctx->code[ci];
+	jb->native[ci] = jb->size;
+	jb->mi = jb->bytes[ci];
+
+	if (insn[0].opcode != C_PUSH || ci+1 >= jb->ctx->ncode) {
+		jit_generic(jb, ci);
+		return 1;
+	}
+
+	num = insn[0].arg;
+
+	switch(insn[1].opcode) {
+		case C_LOAD:
+			jit_push_check(jb, 1);
+			jit_index(jb, num, C_LOAD, 2, R_EAX);
+			// mov eax, [r12+rax*4]; mov [r12+r13*4], eax; inc r13d
+			jit_bytes(jb, 4, 0x41, 0x8B, 0x04, 0x84);
+			jit_movrm(jb, 0x89, R_EAX, 1, 0);
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xC5);
+			break;
+		case C_PUSH:
+			if (ci+2 >= jb->ctx->ncode || insn[2].opcode != C_STOR) {
+				jit_generic(jb, ci);
+				return 1;
+			}
+			jit_push_check(jb, 2);
+			// destination -> edx, source -> eax
+			jit_index(jb, insn[1].arg, C_STOR, 2, R_EDX);
+			jit_index(jb, num, C_STOR, 4, R_EAX);
+			// mov eax, [r12+rax*4]; mov [r12+rdx*4], eax
+			jit_bytes(jb, 4, 0x41, 0x8B, 0x04, 0x84);
+			jit_bytes(jb, 4, 0x41, 0x89, 0x04, 0x94);
+			jit_cold(jb, ci+1);
+			jit_cold(jb, ci+2);
+			return 3;
+		case C_JMP:
+			jit_push_check(jb, 1);
+			jit_target(jb, num, C_JMP, J_O);
+			break;
+		case C_CALL:
+			jit_push_check(jb, 1);
+			if (num < 0 || num >= jb->ctx->cmused) {
+				jit_fail(jb, C_CALL, 2);
+				break;
+			}
+			// return address
+			jit_movmi(jb, 0, insn[1].arg);
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xC5);
+			jit_target(jb, num, C_CALL, J_O);
+			break;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_JE: case C_JL: case C_JNE:
+		case C_JLE: case C_JGE:
+	#endif
+		case C_JG:
+			jit_push_check(jb, 1);
+			// cmp r13d, 2
+			jit_bytes(jb, 4, 0x41, 0x83, 0xFD, 0x02);
+			jit_check(jb, J_GE, insn[1].opcode, 1);
+			if (num < 0 || num >= jb->ctx->cmused) {
+				jit_fail(jb, insn[1].opcode, 2);
+				break;
+			}
+			jit_compare(jb);
+			jit_target(jb, num, insn[1].opcode, jit_cond(insn[1].opcode));
+			break;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_ADD: case C_SUB: case C_MUL: case C_AND:
+		case C_OR:  case C_XOR: case C_SHL: case C_SHR:
+			jit_push_check(jb, 1);
+			// test r13d, r13d
+			jit_bytes(jb, 3, 0x45, 0x85, 0xED);
+			jit_check(jb, J_NE, insn[1].opcode, 1);
+			jit_binop_imm(jb, insn[1].opcode, num);
+			break;
+		case C_FCAL:
+			jit_push_check(jb, 1);
+			if (num < 0 || num >= jb->ctx->cmused) {
+				jit_fail(jb, C_FCAL, 2);
+				break;
+			}
+			jit_frame_check(jb);
+			jit_frame_push(jb, insn[1].arg);
+			jit_target(jb, num, C_FCAL, J_O);
+			break;
+	#endif
+		default:
+			jit_generic(jb, ci);
+			return 1;
+	}
+
+	jit_cold(jb, ci+1);
+	return 2;
+}
+
+// translate one instruction without constant operands
+static void jit_generic(jitbuf_t *jb, int32_t ci) {
+	cvm_insn_t *insn;
+	int32_t l1, l2;
+
+	insn = &jb->ctx->code[ci];
+
+	switch(insn->opcode) {
+		case C_PUSH:
+			jit_push_check(jb, 1);
+			jit_movmi(jb, 0, insn->arg);
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xC5);
+			break;
+		case C_POP:
+			jit_size_check(jb, 1, C_POP);
+			// dec r13d
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xCD);
+			break;
+		case C_INC:
+			jit_size_check(jb, 1, C_INC);
+			jit_modrm(jb, 0, 1, 0xFF, 0, 1, -4);
+			break;
+		case C_DEC:
+			jit_size_check(jb, 1, C_DEC);
+			jit_modrm(jb, 0, 1, 0xFF, 1, 1, -4);
+			break;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_NOT:
+			jit_size_check(jb, 1, C_NOT);
+			jit_modrm(jb, 0, 1, 0xF7, 2, 1, -4);
+			break;
+		case C_ADD: case C_SUB: case C_MUL: case C_DIV:
+		case C_MOD: case C_SHR: case C_SHL: case C_XOR:
+		case C_AND: case C_OR:
+			jit_size_check(jb, 2, insn->opcode);
+			jit_binop(jb, insn->opcode);
+			break;
+		case C_ALLC:
+			jit_size_check(jb, 1, C_ALLC);
+			// dec r13d; mov ecx, [top]
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xCD);
+			jit_movrm(jb, 0x8B, R_ECX, 1, 0);
+			// test ecx, ecx
+			jit_bytes(jb, 2, 0x85, 0xC9);
+			jit_check(jb, J_NS, C_ALLC, 2);
+			// lea rax, [r13+rcx]; cmp rax, max
+			jit_bytes(jb, 5, 0x49, 0x8D, 0x44, 0x0D, 0x00);
+			jit_bytes(jb, 2, 0x48, 0x3D);
+			jit_u32(jb, (uint32_t)jb->ctx->stack.max);
+			jit_check(jb, J_L, C_ALLC, 3);
+			// cmp eax, r15d; jle fill
+			jit_bytes(jb, 3, 0x44, 0x39, 0xF8);
+			l1 = jit_jcc8(jb, J_LE);
+			// stack grows before allc: inc r13d; mov eax, mi
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xC5);
+			jit_byte(jb, 0xB8);
+			jit_u32(jb, (uint32_t)jb->mi);
+			jit_goto(jb, jb->lgrow);
+			jit_land8(jb, l1);
+			// test ecx, ecx; jz end
+			jit_bytes(jb, 2, 0x85, 0xC9);
+			l1 = jit_jcc8(jb, J_E);
+			// loop: mov [r12+r13*4], 0; inc r13d; dec ecx; jnz loop
+			l2 = jb->size;
+			jit_movmi(jb, 0, 0);
+			jit_bytes(jb, 5, 0x41, 0xFF, 0xC5, 0xFF, 0xC9);
+			jit_bytes(jb, 2, 0x70 | J_NE, (uint8_t)(l2 - (jb->size + 2)));
+			jit_land8(jb, l1);
+			break;
+		case C_JE: case C_JL: case C_JNE:
+		case C_JLE: case C_JGE:
+	#endif
+		case C_JG:
+			jit_size_check(jb, 3, insn->opcode);
+			// dec r13d; mov eax, [top]
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xCD);
+			jit_movrm(jb, 0x8B, R_EAX, 1, 0);
+			jit_range(jb, insn->opcode);
+			jit_compare(jb);
+			l1 = jit_jcc8(jb, jit_cond(insn->opcode) ^ 1);
+			jit_table_jump(jb);
+			jit_land8(jb, l1);
+			break;
+		case C_JMP:
+			jit_size_check(jb, 1, C_JMP);
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xCD);
+			jit_movrm(jb, 0x8B, R_EAX, 1, 0);
+			jit_range(jb, C_JMP);
+			jit_table_jump(jb);
+			break;
+		case C_CALL:
+			jit_size_check(jb, 1, C_CALL);
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xCD);
+			jit_movrm(jb, 0x8B, R_EAX, 1, 0);
+			jit_range(jb, C_CALL);
+			// return address
+			jit_movmi(jb, 0, insn->arg);
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xC5);
+			jit_table_jump(jb);
+			break;
+		case C_STOR:
+			jit_size_check(jb, 2, C_STOR);
+			// sub r13d, 2
+			jit_bytes(jb, 4, 0x41, 0x83, 0xED, 0x02);
+			jit_movrm(jb, 0x8B, R_EDX, 1, 4);
+			jit_address(jb, R_EDX, C_STOR, 2);
+			jit_movrm(jb, 0x8B, R_EAX, 1, 0);
+			jit_address(jb, R_EAX, C_STOR, 4);
+			// mov eax, [r12+rax*4]; mov [r12+rdx*4], eax
+			jit_bytes(jb, 4, 0x41, 0x8B, 0x04, 0x84);
+			jit_bytes(jb, 4, 0x41, 0x89, 0x04, 0x94);
+			break;
+		case C_LOAD:
+			jit_size_check(jb, 1, C_LOAD);
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xCD);
+			jit_movrm(jb, 0x8B, R_EAX, 1, 0);
+			jit_address(jb, R_EAX, C_LOAD, 2);
+			// mov eax, [r12+rax*4]
+			jit_bytes(jb, 4, 0x41, 0x8B, 0x04, 0x84);
+			jit_movrm(jb, 0x89, R_EAX, 1, 0);
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xC5);
+			break;
+		case C_HLT:
+			jit_goto(jb, jb->lhalt);
+			return;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_FCAL:
+			jit_size_check(jb, 1, C_FCAL);
+			// address stays in stack until frame has memory
+			jit_movrm(jb, 0x8B, R_EAX, 1, -4);
+			jit_range(jb, C_FCAL);
+			jit_frame_check(jb);
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xCD);
+			jit_frame_push(jb, insn->arg);
+			jit_table_jump(jb);
+			break;
+		case C_RET:
+			// mov edx, [rbx+depth]; test edx, edx
+			jit_bytes(jb, 3, 0x8B, 0x53, (uint8_t)offsetof(vmstack_t, depth));
+			jit_bytes(jb, 2, 0x85, 0xD2);
+			jit_check(jb, J_NE, C_RET, 1);
+			// dec edx; mov [rbx+depth], edx
+			jit_bytes(jb, 2, 0xFF, 0xCA);
+			jit_bytes(jb, 3, 0x89, 0x53, (uint8_t)offsetof(vmstack_t, depth));
+			// mov rcx, [rbx+memory]; mov rcx, [rcx+frames]
+			jit_bytes(jb, 4, 0x48, 0x8B, 0x4B, (uint8_t)offsetof(vmstack_t, memory));
+			jit_bytes(jb, 4, 0x48, 0x8B, 0x49, (uint8_t)offsetof(vmmemory_t, frames));
+			// mov eax, [rcx+rdx*8] (return address)
+			jit_bytes(jb, 3, 0x8B, 0x04, 0xD1);
+			// frame is base of previous frame or 0:
+			// xor esi, esi; test edx, edx; jz set; mov esi, [rcx+rdx*8-4]
+			jit_bytes(jb, 4, 0x31, 0xF6, 0x85, 0xD2);
+			l1 = jit_jcc8(jb, J_E);
+			jit_bytes(jb, 4, 0x8B, 0x74, 0xD1, 0xFC);
+			jit_land8(jb, l1);
+			// mov [rbx+frame], esi
+			jit_bytes(jb, 3, 0x89, 0x73, (uint8_t)offsetof(vmstack_t, frame));
+			// return after the end of code halts: cmp eax, cmused; jae halt
+			jit_byte(jb, 0x3D);
+			jit_u32(jb, (uint32_t)jb->ctx->cmused);
+			jit_bytes(jb, 2, 0x0F, 0x80 | J_AE);
+			jit_u32(jb, (uint32_t)(jb->lhalt - (jb->size + 4)));
+			jit_table_jump(jb);
+			break;
+		case C_FLD:
+			jit_size_check(jb, 1, C_FLD);
+			// dec r13d; movsxd rax, [top]
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xCD);
+			jit_bytes(jb, 5, 0x4B, 0x63, 0x44, 0xAC, 0x00);
+			jit_frame_index(jb, R_EAX, C_FLD, 2);
+			// mov eax, [r12+rax*4]; mov [top], eax; inc r13d
+			jit_bytes(jb, 4, 0x41, 0x8B, 0x04, 0x84);
+			jit_movrm(jb, 0x89, R_EAX, 1, 0);
+			jit_bytes(jb, 3, 0x41, 0xFF, 0xC5);
+			break;
+		case C_FST:
+			jit_size_check(jb, 2, C_FST);
+			// sub r13d, 2; movsxd rax, [top+4] (in); movsxd rdx, [top] (out)
+			jit_bytes(jb, 4, 0x41, 0x83, 0xED, 0x02);
+			jit_bytes(jb, 5, 0x4B, 0x63, 0x44, 0xAC, 0x04);
+			jit_bytes(jb, 5, 0x4B, 0x63, 0x54, 0xAC, 0x00);
+			jit_frame_index(jb, R_EAX, C_FST, 2);
+			jit_frame_index(jb, R_EDX, C_FST, 4);
+			// mov ecx, [r12+rdx*4]; mov [r12+rax*4], ecx
+			jit_bytes(jb, 4, 0x41, 0x8B, 0x0C, 0x94);
+			jit_bytes(jb, 4, 0x41, 0x89, 0x0C, 0x84);
+			break;
+	#endif
+		default:
+			jit_fail(jb, C_UNDF, 1);
+			return;
+	}
+}
+
+// stack must have place for count values, else jit_run grows
+// stack (or fails as push) and native code repeats instruction
+static void jit_push_check(jitbuf_t *jb, int32_t count) {
+	int32_t l1;
+
+	// lea eax, [r13+count-1]; cmp eax, r15d; jl next
+	jit_bytes(jb, 4, 0x41, 0x8D, 0x45, (uint8_t)(count-1));
+	jit_bytes(jb, 3, 0x44, 0x39, 0xF8);
+	l1 = jit_jcc8(jb, J_L);
+	// mov eax, mi
+	jit_byte(jb, 0xB8);
+	jit_u32(jb, (uint32_t)jb->mi);
+	jit_goto(jb, jb->lgrow);
+	jit_land8(jb, l1);
+}
+
+// stack must hold count values
+static void jit_size_check(jitbuf_t *jb, int32_t count, uint8_t opcode) {
+	// cmp r13d, count
+	jit_bytes(jb, 4, 0x41, 0x83, 0xFD, (uint8_t)count);
+	jit_check(jb, J_GE, opcode, 1);
+}
+
+// reg = stack index by constant address num
+// for stack of size r13d without this address
+// (errors are code and code+1 as in exec_load/exec_stor)
+static void jit_index(jitbuf_t *jb, int32_t num, uint8_t opcode, uint8_t code, int reg) {
+	if (num < -jb->ctx->stack.max) {
+		jit_fail(jb, opcode, code);
+		return;
+	}
+	if (num >= jb->ctx->stack.max) {
+		jit_fail(jb, opcode, code+1);
+		return;
+	}
+
+	if (num < 0) {
+		// cmp r13d, -num
+		jit_bytes(jb, 3, 0x41, 0x81, 0xFD);
+		jit_u32(jb, (uint32_t)-num);
+		jit_check(jb, J_GE, opcode, code);
+		// lea reg, [r13+num]
+		jit_bytes(jb, 3, 0x41, 0x8D, 0x85 | (reg << 3));
+		jit_u32(jb, (uint32_t)num);
+	} else {
+		// cmp r13d, num
+		jit_bytes(jb, 3, 0x41, 0x81, 0xFD);
+		jit_u32(jb, (uint32_t)num);
+		jit_check(jb, J_G, opcode, code+1);
+		// mov reg, num
+		jit_byte(jb, 0xB8 + reg);
+		jit_u32(jb, (uint32_t)num);
+	}
+}
+
+// reg = stack index by address in reg
+static void jit_address(jitbuf_t *jb, int reg, uint8_t opcode, uint8_t code) {
+	int32_t l1, l2;
+
+	// test reg, reg; jns positive
+	jit_bytes(jb, 2, 0x85, 0xC0 | (reg << 3) | reg);
+	l1 = jit_jcc8(jb, J_NS);
+	// add reg, r13d
+	jit_bytes(jb, 3, 0x44, 0x01, 0xE8 | reg);
+	jit_check(jb, J_NS, opcode, code);
+	jit_bytes(jb, 1, 0xEB);
+	l2 = jb->size;
+	jit_byte(jb, 0);
+	jit_land8(jb, l1);
+	// cmp reg, r13d
+	jit_bytes(jb, 3, 0x44, 0x39, 0xE8 | reg);
+	jit_check(jb, J_L, opcode, code+1);
+	jit_land8(jb, l2);
+}
+
+// address of jump in eax must be in code memory
+static void jit_range(jitbuf_t *jb, uint8_t opcode) {
+	// cmp eax, cmused
+	jit_byte(jb, 0x3D);
+	jit_u32(jb, (uint32_t)jb->ctx->cmused);
+	jit_check(jb, J_B, opcode, 2);
+}
+
+// pop x and y, then compare y with x
+static void jit_compare(jitbuf_t *jb) {
+	// sub r13d, 2; mov ecx, [x]; cmp [y], ecx
+	jit_bytes(jb, 4, 0x41, 0x83, 0xED, 0x02);
+	jit_movrm(jb, 0x8B, R_ECX, 1, 4);
+	jit_movrm(jb, 0x39, R_ECX, 1, 0);
+}
+
+// condition of jump instruction
+static int jit_cond(uint8_t opcode) {
+	switch(opcode) {
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_JL:  return J_L;
+		case C_JE:  return J_E;
+		case C_JNE: return J_NE;
+		case C_JLE: return J_LE;
+		case C_JGE: return J_GE;
+	#endif
+		default:    return J_G;
+	}
+}
+
+// jump to constant address num of code memory if condition cc
+// (J_O means always), address is checked by caller
+static void jit_target(jitbuf_t *jb, int32_t num, uint8_t opcode, int cc) {
+	int32_t l1;
+
+	if (num < 0 || num >= jb->ctx->cmused) {
+		jit_fail(jb, opcode, 2);
+		return;
+	}
+
+	if (jb->ctx->slots[num] >= 0) {
+		if (cc == J_O) {
+			jit_jmp(jb, jb->ctx->slots[num]);
+		} else {
+			jit_bytes(jb, 2, 0x0F, 0x80 | cc);
+			jit_fixup(jb, jb->ctx->slots[num]);
+		}
+		return;
+	}
+
+	// jump inside of instruction
+	l1 = (cc == J_O) ? -1 : jit_jcc8(jb, cc ^ 1);
+	jit_byte(jb, 0xB8);
+	jit_u32(jb, (uint32_t)num);
+	jit_goto(jb, jb->lexit);
+	if (l1 >= 0) {
+		jit_land8(jb, l1);
+	}
+}
+
+// jump to address of code memory in eax
+static void jit_table_jump(jitbuf_t *jb) {
+	int32_t l1;
+
+	// mov edx, eax; mov rax, [r14+rax*8]; test rax, rax; jz exit; jmp rax
+	jit_bytes(jb, 2, 0x89, 0xC2);
+	jit_bytes(jb, 4, 0x49, 0x8B, 0x04, 0xC6);
+	jit_bytes(jb, 3, 0x48, 0x85, 0xC0);
+	l1 = jit_jcc8(jb, J_E);
+	jit_bytes(jb, 2, 0xFF, 0xE0);
+	jit_land8(jb, l1);
+	// jump inside of instruction: mov eax, edx
+	jit_bytes(jb, 2, 0x89, 0xD0);
+	jit_goto(jb, jb->lexit);
+}
+
+#ifdef CVM_KERNEL_IAPPEND
+	// y = y @ x for two values on top of stack
+	static void jit_binop(jitbuf_t *jb, uint8_t opcode) {
+		// mov eax, [y]
+		jit_movrm(jb, 0x8B, R_EAX, 1, -8);
+
+		switch(opcode) {
+			case C_ADD: jit_movrm(jb, 0x03, R_EAX, 1, -4); break;
+			case C_SUB: jit_movrm(jb, 0x2B, R_EAX, 1, -4); break;
+			case C_AND: jit_movrm(jb, 0x23, R_EAX, 1, -4); break;
+			case C_OR:  jit_movrm(jb, 0x0B, R_EAX, 1, -4); break;
+			case C_XOR: jit_movrm(jb, 0x33, R_EAX, 1, -4); break;
+			case C_MUL: jit_modrm(jb, 0x0F, 2, 0xAF, R_EAX, 1, -4); break;
+			default:
+				jit_movrm(jb, 0x8B, R_ECX, 1, -4);
+				switch(opcode) {
+					// sar eax, cl
+					case C_SHR: jit_bytes(jb, 2, 0xD3, 0xF8); break;
+					// shl eax, cl
+					case C_SHL: jit_bytes(jb, 2, 0xD3, 0xE0); break;
+					// cdq; idiv ecx
+					case C_DIV: jit_bytes(jb, 3, 0x99, 0xF7, 0xF9); break;
+					// cdq; idiv ecx; mov eax, edx
+					case C_MOD: jit_bytes(jb, 5, 0x99, 0xF7, 0xF9, 0x89, 0xD0); break;
+				}
+		}
+
+		// mov [y], eax; dec r13d
+		jit_movrm(jb, 0x89, R_EAX, 1, -8);
+		jit_bytes(jb, 3, 0x41, 0xFF, 0xCD);
+	}
+
+	// y = y @ num for value on top of stack
+	static void jit_binop_imm(jitbuf_t *jb, uint8_t opcode, int32_t num) {
+		switch(opcode) {
+			case C_ADD: jit_modrm(jb, 0, 1, 0x81, 0, 1, -4); break;
+			case C_OR:  jit_modrm(jb, 0, 1, 0x81, 1, 1, -4); break;
+			case C_AND: jit_modrm(jb, 0, 1, 0x81, 4, 1, -4); break;
+			case C_SUB: jit_modrm(jb, 0, 1, 0x81, 5, 1, -4); break;
+			case C_XOR: jit_modrm(jb, 0, 1, 0x81, 6, 1, -4); break;
+			case C_MUL:
+				// mov eax, [y]; imul eax, eax, num; mov [y], eax
+				jit_movrm(jb, 0x8B, R_EAX, 1, -4);
+				jit_bytes(jb, 2, 0x69, 0xC0);
+				jit_u32(jb, (uint32_t)num);
+				jit_movrm(jb, 0x89, R_EAX, 1, -4);
+				return;
+			// shifts take 5 bits of count as sar/shl by cl
+			case C_SHL: jit_modrm(jb, 0, 1, 0xC1, 4, 1, -4); jit_byte(jb, num & 31); return;
+			case C_SHR: jit_modrm(jb, 0, 1, 0xC1, 7, 1, -4); jit_byte(jb, num & 31); return;
+		}
+		jit_u32(jb, (uint32_t)num);
+	}
+
+	// frame of fcal must have memory, else jit_run grows frames
+	// (or fails as fcal) and native code repeats instruction;
+	// rcx = memory and edx = depth are left for jit_frame_push
+	static void jit_frame_check(jitbuf_t *jb) {
+		int32_t l1;
+
+		// mov rcx, [rbx+memory]; mov edx, [rbx+depth]
+		jit_bytes(jb, 4, 0x48, 0x8B, 0x4B, (uint8_t)offsetof(vmstack_t, memory));
+		jit_bytes(jb, 3, 0x8B, 0x53, (uint8_t)offsetof(vmstack_t, depth));
+		// cmp edx, [rcx+capframes]; jl next
+		jit_bytes(jb, 3, 0x3B, 0x51, (uint8_t)offsetof(vmmemory_t, capframes));
+		l1 = jit_jcc8(jb, J_L);
+		jit_byte(jb, 0xB8);
+		jit_u32(jb, (uint32_t)jb->mi);
+		jit_goto(jb, jb->lframe);
+		jit_land8(jb, l1);
+	}
+
+	// new frame with return address ret and base r13d as exec_fcal
+	static void jit_frame_push(jitbuf_t *jb, int32_t ret) {
+		// mov rcx, [rcx+frames]; mov dword [rcx+rdx*8], ret
+		jit_bytes(jb, 4, 0x48, 0x8B, 0x49, (uint8_t)offsetof(vmmemory_t, frames));
+		jit_bytes(jb, 3, 0xC7, 0x04, 0xD1);
+		jit_u32(jb, (uint32_t)ret);
+		// mov [rcx+rdx*8+4], r13d; inc edx
+		jit_bytes(jb, 5, 0x44, 0x89, 0x6C, 0xD1, 0x04);
+		jit_bytes(jb, 2, 0xFF, 0xC2);
+		// mov [rbx+depth], edx; mov [rbx+frame], r13d
+		jit_bytes(jb, 3, 0x89, 0x53, (uint8_t)offsetof(vmstack_t, depth));
+		jit_bytes(jb, 4, 0x44, 0x89, 0x6B, (uint8_t)offsetof(vmstack_t, frame));
+	}
+
+	// reg = frame + address in reg (64 bits), it must be index
+	// of stack of size r13d (errors are code and code+1 as in
+	// exec_fld/exec_fst)
+	static void jit_frame_index(jitbuf_t *jb, int reg, uint8_t opcode, uint8_t code) {
+		// movsxd rcx, [rbx+frame]; add reg, rcx
+		jit_bytes(jb, 4, 0x48, 0x63, 0x4B, (uint8_t)offsetof(vmstack_t, frame));
+		jit_bytes(jb, 3, 0x48, 0x01, 0xC8 | reg);
+		jit_check(jb, J_NS, opcode, code);
+		// cmp reg, r13
+		jit_bytes(jb, 3, 0x4C, 0x39, 0xE8 | reg);
+		jit_check(jb, J_L, opcode, code+1);
+	}
+#endif
+
+// error of instruction: return wrap_return(opcode, code)
+static void jit_fail(jitbuf_t *jb, uint8_t opcode, uint8_t code) {
+	jit_byte(jb, 0xB8);
+	jit_u32(jb, wrap_return(opcode, code));
+	jit_goto(jb, jb->lerror);
+}
+
+// fail if condition cc is false
+static void jit_check(jitbuf_t *jb, int cc, uint8_t opcode, uint8_t code) {
+	int32_t l1;
+
+	l1 = jit_jcc8(jb, cc);
+	jit_fail(jb, opcode, code);
+	jit_land8(jb, l1);
+}
+
+// mov reg, [stack] or mov [stack], reg and other
+// instructions op reg, [stack] where [stack] is r12+r13*4+disp
+// if indexed or r12+disp
+static void jit_movrm(jitbuf_t *jb, uint8_t op, int reg, int indexed, int32_t disp) {
+	jit_modrm(jb, 0, 1, op, reg, indexed, disp);
+}
+
+// mov dword [r12+r13*4+disp], num
+static void jit_movmi(jitbuf_t *jb, int32_t disp, int32_t num) {
+	jit_modrm(jb, 0, 1, 0xC7, 0, 1, disp);
+	jit_u32(jb, (uint32_t)num);
+}
+
+// instruction with one or two bytes of opcode
+// (first byte is used only if n = 2)
+static void jit_modrm(jitbuf_t *jb, uint8_t op1, int n, uint8_t op2, int reg, int indexed, int32_t disp) {
+	int small;
+
+	small = (disp >= -128 && disp <= 127);
+
+	// REX.X for r13, REX.B for r12
+	jit_byte(jb, 0x41 | (indexed ? 0x02 : 0x00));
+	if (n == 2) {
+		jit_byte(jb, op1);
+	}
+	jit_byte(jb, op2);
+	jit_byte(jb, (small ? 0x40 : 0x80) | (reg << 3) | 0x04);
+	jit_byte(jb, indexed ? 0xAC : 0x24);
+
+	if (small) {
+		jit_byte(jb, (uint8_t)disp);
+	} else {
+		jit_u32(jb, (uint32_t)disp);
+	}
+}
+
+// emit standalone code of instruction ci after all code
+static void jit_cold(jitbuf_t *jb, int32_t ci) {
+	jb->cold[jb->ncold++] = ci;
+}
+
+// jmp to instruction ci
+static void jit_jmp(jitbuf_t *jb, int32_t ci) {
+	jit_byte(jb, 0xE9);
+	jit_fixup(jb, ci);
+}
+
+// jmp to offset of native code
+static void jit_goto(jitbuf_t *jb, int32_t at) {
+	jit_byte(jb, 0xE9);
+	jit_u32(jb, (uint32_t)(at - (jb->size + 4)));
+}
+
+// rel32 to instruction ci, it is set when all code is made
+static void jit_fixup(jitbuf_t *jb, int32_t ci) {
+	jitfix_t *fix;
+
+	if (jb->nfix == jb->capfix) {
+		jb->capfix = jb->capfix ? jb->capfix * 2 : 256;
+		fix = (jitfix_t*)realloc(jb->fix, sizeof(jitfix_t)*jb->capfix);
+		if (fix == NULL) {
+			jb->failed = 1;
+			jb->nfix = 0;
+			return;
+		}
+		jb->fix = fix;
+	}
+
+	jb->fix[jb->nfix].at = jb->size;
+	jb->fix[jb->nfix].ci = ci;
+	jb->nfix += 1;
+
+	jit_u32(jb, 0);
+}
+
+// short conditional jump forward, return place of rel8
+static int32_t jit_jcc8(jitbuf_t *jb, int cc) {
+	jit_byte(jb, 0x70 | cc);
+	jit_byte(jb, 0);
+	return jb->size - 1;
+}
+
+// set rel8 at place l to current offset
+static void jit_land8(jitbuf_t *jb, int32_t l) {
+	if (!jb->failed) {
+		jb->data[l] = (uint8_t)(jb->size - (l + 1));
+	}
+}
+
+static void jit_patch32(jitbuf_t *jb, int32_t at, int32_t num) {
+	memcpy(jb->data + at, &num, 4);
+}
+
+static void jit_u32(jitbuf_t *jb, uint32_t num) {
+	for (int i = 0; i < 4; ++i) {
+		jit_byte(jb, (uint8_t)(num >> (8*i)));
+	}
+}
+
+static void jit_bytes(jitbuf_t *jb, int n, ...) {
+	va_list args;
+
+	va_start(args, n);
+	for (int i = 0; i < n; ++i) {
+		jit_byte(jb, (uint8_t)va_arg(args, int));
+	}
+	va_end(args);
+}
+
+static void jit_byte(jitbuf_t *jb, uint8_t byte) {
+	uint8_t *data;
+
+	if (jb->failed) {
+		return;
+	}
+
+	if (jb->size == jb->cap) {
+		jb->cap = jb->cap ? jb->cap * 2 : 4096;
+		data = (uint8_t*)realloc(jb->data, jb->cap);
+		if (data == NULL) {
+			jb->failed = 1;
+			return;
+		}
+		jb->data = data;
+	}
+
+	jb->data[jb->size++] = byte;
+}
+
+#endif /* CVM_KERNEL_JIT */
+
+
+
+/// SECTION: AOT
+
+// translate loaded code to C source with function
+// int CVM_AOT_SYMBOL(int32_t **output, int32_t *input)
+// which works as cvm_run for this code
+extern int cvm_ctx_aot(cvm_ctx_t *ctx, FILE *output) {
+	cvm_insn_t insn[CVM_KERNEL_DECODE];
+	int32_t size, count;
+
+	fprintf(output,
+		"// C code of cvm program (%d bytes), build it by\n"
+		"// $ gcc -O2 -shared -fPIC prog.c -o prog.so\n"
+		"#include <stdint.h>\n"
+		"#include <stdlib.h>\n\n"
+		"#define SMEMORY %d\n"
+		"#define CMUSED  %d\n\n"
+		"// address of jump is in code memory\n"
+		"#define ADDRESS(mi) ((mi) >= 0 && (mi) < CMUSED)\n\n"
+		"static int run(int32_t *base, int32_t *frames, int32_t **output, int32_t *input);\n\n"
+		"int %s(int32_t **output, int32_t *input) {\n"
+		"\tint32_t *base, *frames;\n"
+		"\tint retcode;\n\n"
+		"\t// frames of fcal: return address and base\n"
+		"\tbase = (int32_t*)malloc(sizeof(int32_t)*SMEMORY);\n"
+		"\tframes = (int32_t*)malloc(sizeof(int32_t)*2*SMEMORY);\n"
+		"\tretcode = 0x%04X;\n"
+		"\tif (base != NULL && frames != NULL) {\n"
+		"\t\tretcode = run(base, frames, output, input);\n"
+		"\t}\n"
+		"\tfree(base);\n"
+		"\tfree(frames);\n"
+		"\treturn retcode;\n"
+		"}\n\n"
+		"static int run(int32_t *base, int32_t *frames, int32_t **output, int32_t *input) {\n",
+		ctx->cmused, ctx->stack.max, ctx->cmused, CVM_AOT_SYMBOL, wrap_return(C_PUSH, 1));
+
+	// variables which the program doesn't use are cast to void for
+	// -Wall, program starts by dispatch as the label may be unused
+	fprintf(output,
+		"\tint32_t size, num1, num2, mi, depth, frame;\n\n"
+		"\t(void)frames;\n"
+		"\t(void)num1;\n"
+		"\t(void)num2;\n"
+		"\tdepth = 0;\n"
+		"\tframe = 0;\n"
+		"\t(void)depth;\n"
+		"\t(void)frame;\n"
+		"\tsize = 0;\n"
+		"\tfor (int i = 1; i <= input[0] && i <= SMEMORY; ++i) {\n"
+		"\t\tbase[size++] = input[i];\n"
+		"\t}\n"
+		"\tmi = 0;\n"
+		"\tgoto dispatch;\n\n");
+
+	// instructions in order of code, instructions inside of compact
+	// instruction are always joined with its push
+	for (int32_t ci = 0; ci < ctx->ncode; ++ci) {
+		if (ctx->slots[ctx->bytes[ci]] == ci) {
+			aot_insn(ctx, output, ci);
+		}
+	}
+	fprintf(output, "\tgoto end;\n\n");
+
+	// jumps inside of instructions: decode from byte mi
+	// and continue at next byte as cvm_ctx_run does
+	for (int32_t mi = 0; mi < ctx->cmused; ++mi) {
+		if (ctx->slots[mi] >= 0) {
+			continue;
+		}
+		size = decode_insn(ctx, mi, insn, &count);
+		fprintf(output, "L%d:\n", mi);
+		for (int32_t i = 0; i < count; ++i) {
+			aot_generic(output, &insn[i]);
+		}
+		aot_goto(ctx, output, mi + size);
+	}
+
+	fprintf(output, "\ndispatch:\n\tswitch(mi) {\n");
+	for (int32_t mi = 0; mi < ctx->cmused; ++mi) {
+		fprintf(output, "\t\tcase %d: goto L%d;\n", mi, mi);
+	}
+	fprintf(output,
+		"\t}\n\n"
+		"end:\n"
+		"\t*output = (int32_t*)malloc(sizeof(int32_t)*(size+1));\n"
+		"\t(*output)[0] = size;\n"
+		"\tfor (int i = 1; i <= size; ++i) {\n"
+		"\t\t(*output)[i] = base[size-i];\n"
+		"\t}\n"
+		"\treturn 0;\n"
+		"}\n");
+
+	return ferror(output) ? 1 : 0;
+}
+
+// write instruction ci at its byte, if its push is used by next
+// instructions then they are joined (their code is left for jumps),
+// next[i] is byte of instruction ci+i
+static void aot_insn(cvm_ctx_t *ctx, FILE *output, int32_t ci) {
+	cvm_insn_t insn[3];
+	int32_t next[4];
+
+	for (int i = 0; i < 4; ++i) {
+		next[i] = ctx->bytes[(ci+i < ctx->ncode) ? ci+i : ctx->ncode];
+		if (i < 3) {
+			insn[i] = ctx->code[(ci+i < ctx->ncode) ? ci+i : ctx->ncode];
+			insn[i].opcode = insn_opcode(insn[i].opcode);
+		}
+	}
+
+	fprintf(output, "L%d:\n", next[0]);
+
+	if (insn[0].opcode != C_PUSH || ci+1 >= ctx->ncode) {
+		aot_generic(output, &insn[0]);
+		return;
+	}
+
+	switch(insn[1].opcode) {
+		case C_LOAD:
+			aot_push_check(output, 1);
+			aot_index(output, insn[0].arg, C_LOAD, 2, "num1");
+			fprintf(output, "\tbase[size++] = base[num1];\n");
+			aot_goto(ctx, output, next[2]);
+			break;
+		case C_PUSH:
+			if (ci+2 >= ctx->ncode || insn[2].opcode != C_STOR) {
+				aot_generic(output, &insn[0]);
+				break;
+			}
+			aot_push_check(output, 2);
+			aot_index(output, insn[1].arg, C_STOR, 2, "num1");
+			aot_index(output, insn[0].arg, C_STOR, 4, "num2");
+			fprintf(output, "\tbase[num1] = base[num2];\n");
+			aot_goto(ctx, output, next[3]);
+			break;
+		case C_JMP:
+			aot_push_check(output, 1);
+			aot_target(ctx, output, insn[0].arg, C_JMP, NULL);
+			break;
+		case C_CALL:
+			aot_push_check(output, 1);
+			if (insn[0].arg < 0 || insn[0].arg >= ctx->cmused) {
+				fprintf(output, "\treturn 0x%04X;\n", wrap_return(C_CALL, 2));
+				break;
+			}
+			fprintf(output, "\tbase[size++] = %d;\n", insn[1].arg);
+			aot_target(ctx, output, insn[0].arg, C_CALL, NULL);
+			break;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_FCAL:
+			aot_push_check(output, 1);
+			if (insn[0].arg < 0 || insn[0].arg >= ctx->cmused) {
+				fprintf(output, "\treturn 0x%04X;\n", wrap_return(C_FCAL, 2));
+				break;
+			}
+			aot_fcal(output, insn[1].arg);
+			aot_target(ctx, output, insn[0].arg, C_FCAL, NULL);
+			break;
+	#endif
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_JE: case C_JL: case C_JNE:
+		case C_JLE: case C_JGE:
+	#endif
+		case C_JG:
+			aot_push_check(output, 1);
+			fprintf(output, "\tif (size < 2) return 0x%04X;\n", wrap_return(insn[1].opcode, 1));
+			if (insn[0].arg < 0 || insn[0].arg >= ctx->cmused) {
+				fprintf(output, "\treturn 0x%04X;\n", wrap_return(insn[1].opcode, 2));
+				break;
+			}
+			fprintf(output, "\tnum1 = base[--size];\n\tnum2 = base[--size];\n");
+			aot_target(ctx, output, insn[0].arg, insn[1].opcode, aot_cond(insn[1].opcode));
+			aot_goto(ctx, output, next[2]);
+			break;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_ADD: case C_SUB: case C_MUL:
+		case C_AND: case C_OR:  case C_XOR:
+		case C_SHL: case C_SHR:
+			aot_push_check(output, 1);
+			fprintf(output, "\tif (size < 1) return 0x%04X;\n", wrap_return(insn[1].opcode, 1));
+			fprintf(output, "\tnum1 = %d;\n", aot_operand(insn[1].opcode, insn[0].arg));
+			aot_binop_write(output, insn[1].opcode, "num1");
+			aot_goto(ctx, output, next[2]);
+			break;
+	#endif
+		default:
+			aot_generic(output, &insn[0]);
+			break;
+	}
+}
+
+// write one instruction as exec_* functions do it
+static void aot_generic(FILE *output, cvm_insn_t *insn) {
+	uint8_t opcode;
+
+	opcode = insn->opcode;
+
+	switch(opcode) {
+		case C_PUSH:
+			aot_push_check(output, 1);
+			fprintf(output, "\tbase[size++] = %d;\n", insn->arg);
+			break;
+		case C_POP:
+			aot_size_check(output, 1, C_POP);
+			fprintf(output, "\tsize -= 1;\n");
+			break;
+		case C_INC:
+			aot_size_check(output, 1, C_INC);
+			fprintf(output, "\tbase[size-1] = (int32_t)((uint32_t)base[size-1] + 1);\n");
+			break;
+		case C_DEC:
+			aot_size_check(output, 1, C_DEC);
+			fprintf(output, "\tbase[size-1] = (int32_t)((uint32_t)base[size-1] - 1);\n");
+			break;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_NOT:
+			aot_size_check(output, 1, C_NOT);
+			fprintf(output, "\tbase[size-1] = ~base[size-1];\n");
+			break;
+		case C_ADD: case C_SUB: case C_MUL: case C_DIV:
+		case C_MOD: case C_SHR: case C_SHL: case C_XOR:
+		case C_AND: case C_OR:
+			aot_size_check(output, 2, opcode);
+			fprintf(output, "\tnum1 = base[--size];\n");
+			aot_binop_write(output, opcode, (opcode == C_SHL || opcode == C_SHR) ? "num1 & 31" : "num1");
+			break;
+		case C_ALLC:
+			aot_size_check(output, 1, C_ALLC);
+			fprintf(output,
+				"\tnum1 = base[--size];\n"
+				"\tif (num1 < 0) return 0x%04X;\n"
+				"\tif (num1 >= SMEMORY-size) return 0x%04X;\n"
+				"\tfor (int i = 0; i < num1; ++i) {\n"
+				"\t\tbase[size++] = 0;\n"
+				"\t}\n",
+				wrap_return(C_ALLC, 2), wrap_return(C_ALLC, 3));
+			break;
+		case C_JE: case C_JL: case C_JNE:
+		case C_JLE: case C_JGE:
+	#endif
+		case C_JG:
+			aot_size_check(output, 3, opcode);
+			fprintf(output,
+				"\tmi = base[--size];\n"
+				"\tif (!ADDRESS(mi)) return 0x%04X;\n"
+				"\tnum1 = base[--size];\n"
+				"\tnum2 = base[--size];\n"
+				"\tif (num2 %s num1) goto dispatch;\n",
+				wrap_return(opcode, 2), aot_cond(opcode));
+			break;
+		case C_JMP:
+			aot_size_check(output, 1, C_JMP);
+			fprintf(output,
+				"\tmi = base[--size];\n"
+				"\tif (!ADDRESS(mi)) return 0x%04X;\n"
+				"\tgoto dispatch;\n",
+				wrap_return(C_JMP, 2));
+			break;
+		case C_CALL:
+			aot_size_check(output, 1, C_CALL);
+			fprintf(output,
+				"\tmi = base[--size];\n"
+				"\tif (!ADDRESS(mi)) return 0x%04X;\n"
+				"\tbase[size++] = %d;\n"
+				"\tgoto dispatch;\n",
+				wrap_return(C_CALL, 2), insn->arg);
+			break;
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_FCAL:
+			aot_size_check(output, 1, C_FCAL);
+			fprintf(output,
+				"\tmi = base[--size];\n"
+				"\tif (!ADDRESS(mi)) return 0x%04X;\n",
+				wrap_return(C_FCAL, 2));
+			aot_fcal(output, insn->arg);
+			fprintf(output, "\tgoto dispatch;\n");
+			break;
+		case C_RET:
+			fprintf(output,
+				"\tif (depth == 0) return 0x%04X;\n"
+				"\tdepth -= 1;\n"
+				"\tmi = frames[2*depth];\n"
+				"\tframe = (depth > 0) ? frames[2*depth-1] : 0;\n"
+				"\tif (mi >= CMUSED) goto end;\n"
+				"\tgoto dispatch;\n",
+				wrap_return(C_RET, 1));
+			break;
+		case C_FLD:
+			aot_size_check(output, 1, C_FLD);
+			fprintf(output, "\tnum1 = base[--size];\n");
+			aot_frame(output, "num1", C_FLD, 2);
+			fprintf(output, "\tbase[size++] = base[num1];\n");
+			break;
+		case C_FST:
+			aot_size_check(output, 2, C_FST);
+			fprintf(output, "\tnum1 = base[--size];\n\tnum2 = base[--size];\n");
+			aot_frame(output, "num1", C_FST, 2);
+			aot_frame(output, "num2", C_FST, 4);
+			fprintf(output, "\tbase[num1] = base[num2];\n");
+			break;
+	#endif
+		case C_STOR:
+			aot_size_check(output, 2, C_STOR);
+			fprintf(output, "\tnum1 = base[--size];\n\tnum2 = base[--size];\n");
+			aot_address(output, "num1", C_STOR, 2);
+			aot_address(output, "num2", C_STOR, 4);
+			fprintf(output, "\tbase[num1] = base[num2];\n");
+			break;
+		case C_LOAD:
+			aot_size_check(output, 1, C_LOAD);
+			fprintf(output, "\tnum1 = base[--size];\n");
+			aot_address(output, "num1", C_LOAD, 2);
+			fprintf(output, "\tbase[size++] = base[num1];\n");
+			break;
+		case C_HLT:
+			fprintf(output, "\tgoto end;\n");
+			break;
+		default:
+			fprintf(output, "\treturn 0x%04X;\n", wrap_return(C_UNDF, 1));
+			break;
+	}
+}
+
+// stack must have place for count values
+static void aot_push_check(FILE *output, int32_t count) {
+	fprintf(output, "\tif (size > SMEMORY-%d) return 0x%04X;\n", count, wrap_return(C_PUSH, 1));
+}
+
+// stack must hold count values
+static void aot_size_check(FILE *output, int32_t count, uint8_t opcode) {
+	fprintf(output, "\tif (size < %d) return 0x%04X;\n", count, wrap_return(opcode, 1));
+}
+
+// var = stack index by constant address num
+static void aot_index(FILE *output, int32_t num, uint8_t opcode, uint8_t code, const char *var) {
+	// stack holds at most CVM_KERNEL_LIMIT values
+	if (num < -CVM_KERNEL_LIMIT) {
+		fprintf(output, "\treturn 0x%04X;\n", wrap_return(opcode, code));
+	} else if (num >= CVM_KERNEL_LIMIT) {
+		fprintf(output, "\treturn 0x%04X;\n", wrap_return(opcode, code+1));
+	} else if (num < 0) {
+		fprintf(output, "\t%s = size - %d;\n", var, -num);
+		fprintf(output, "\tif (%s < 0) return 0x%04X;\n", var, wrap_return(opcode, code));
+	} else {
+		fprintf(output, "\t%s = %d;\n", var, num);
+		fprintf(output, "\tif (%s >= size) return 0x%04X;\n", var, wrap_return(opcode, code+1));
+	}
+}
+
+// var = stack index by address in var
+static void aot_address(FILE *output, const char *var, uint8_t opcode, uint8_t code) {
+	fprintf(output,
+		"\tif (%s < 0) {\n"
+		"\t\t%s += size;\n"
+		"\t\tif (%s < 0) return 0x%04X;\n"
+		"\t} else if (%s >= size) {\n"
+		"\t\treturn 0x%04X;\n"
+		"\t}\n",
+		var, var, var, wrap_return(opcode, code), var, wrap_return(opcode, code+1));
+}
+
+// jump to constant address num if cond (num2 cond num1) or always
+static void aot_target(cvm_ctx_t *ctx, FILE *output, int32_t num, uint8_t opcode, const char *cond) {
+	if (num < 0 || num >= ctx->cmused) {
+		fprintf(output, "\treturn 0x%04X;\n", wrap_return(opcode, 2));
+		return;
+	}
+
+	if (cond != NULL) {
+		fprintf(output, "\tif (num2 %s num1) goto L%d;\n", cond, num);
+	} else {
+		fprintf(output, "\tgoto L%d;\n", num);
+	}
+}
+
+// continue at byte mi
+static void aot_goto(cvm_ctx_t *ctx, FILE *output, int32_t mi) {
+	if (mi >= ctx->cmused) {
+		fprintf(output, "\tgoto end;\n");
+	} else {
+		fprintf(output, "\tgoto L%d;\n", mi);
+	}
+}
+
+static const char *aot_cond(uint8_t opcode) {
+	switch(opcode) {
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_JL:  return "<";
+		case C_JE:  return "==";
+		case C_JNE: return "!=";
+		case C_JLE: return "<=";
+		case C_JGE: return ">=";
+	#endif
+		default:    return ">";
+	}
+}
+
+#ifdef CVM_KERNEL_IAPPEND
+	// new frame of fcal with return address ret,
+	// address of function is popped to mi
+	static void aot_fcal(FILE *output, int32_t ret) {
+		fprintf(output,
+			"\tif (depth == SMEMORY) return 0x%04X;\n"
+			"\tframes[2*depth] = %d;\n"
+			"\tframes[2*depth+1] = size;\n"
+			"\tdepth += 1;\n"
+			"\tframe = size;\n",
+			wrap_return(C_FCAL, 3), ret);
+	}
+
+	// var = stack index by address in var relative to frame
+	static void aot_frame(FILE *output, const char *var, uint8_t opcode, uint8_t code) {
+		fprintf(output,
+			"\tif (%s < -frame) return 0x%04X;\n"
+			"\tif (%s >= size - frame) return 0x%04X;\n"
+			"\t%s += frame;\n",
+			var, wrap_return(opcode, code), var, wrap_return(opcode, code+1), var);
+	}
+
+	static const char *aot_binop(uint8_t opcode) {
+		switch(opcode) {
+			case C_ADD: return "+";
+			case C_SUB: return "-";
+			case C_MUL: return "*";
+			case C_DIV: return "/";
+			case C_MOD: return "%";
+			case C_AND: return "&";
+			case C_OR:  return "|";
+			case C_XOR: return "^";
+			case C_SHR: return ">>";
+			default:    return "<<";
+		}
+	}
+
+	// base[size-1] @= operand, add, sub, mul and shl wrap
+	// in unsigned type as exec_binop does it
+	static void aot_binop_write(FILE *output, uint8_t opcode, const char *operand) {
+		switch(opcode) {
+			case C_ADD: case C_SUB: case C_MUL: case C_SHL:
+				fprintf(output, "\tbase[size-1] = (int32_t)((uint32_t)base[size-1] %s (uint32_t)(%s));\n",
+					aot_binop(opcode), operand);
+				break;
+			default:
+				fprintf(output, "\tbase[size-1] %s= %s;\n", aot_binop(opcode), operand);
+				break;
+		}
+	}
+
+	// shift count is taken modulo 32 as exec_binop does it,
+	// else C compiler is free to fold shifts by constant to anything
+	static int32_t aot_operand(uint8_t opcode, int32_t num) {
+		if (opcode == C_SHL || opcode == C_SHR) {
+			return num & 31;
+		}
+		return num;
+	}
+#endif
+
+
+
+/// SECTION: RUN
+
+// Threaded dispatch: every handler jumps straight to the handler
+// of the next instruction through the table of label addresses.
+// Switch dispatch: every handler returns to one switch.
+#ifdef CVM_KERNEL_THREADED
+	#define VM_TARGET(op) L_##op:
+	#define VM_DEFAULT    L_DEFAULT:
+	#define VM_DISPATCH() goto *dispatch[ip->opcode]
+#else
+	#define VM_TARGET(op) case op:
+	#define VM_DEFAULT    default:
+	#define VM_DISPATCH() goto vm_switch
+#endif
+
+// go to instruction after n instructions
+#define VM_NEXT(n) \
+	do { \
+		ip += (n); \
+		VM_SPEND(n); \
+		VM_PROBE(); \
+		VM_DISPATCH(); \
+	} while(0)
+
+// go to byte mi or to instruction after n instructions if mi < 0,
+// verified programs jump only to the start of instructions
+#define VM_JUMP(mi, n) \
+	do { \
+		ip = ((mi) < 0) ? ip + (n) : \
+			VM_CHECKED ? insn_at(ctx, scratch, (mi)) : ctx->code + ctx->slots[(mi)]; \
+		VM_SPEND(n); \
+		VM_PROBE(); \
+		VM_DISPATCH(); \
+	} while(0)
+
+// count n done instructions, program stops before next
+// instruction when all instructions are used or it is stop
+#define VM_SPEND(n) \
+	do { \
+		if (VM_FUEL && ((left -= (n)) <= 0 || ip == stop)) goto vm_yield; \
+		VM_SPLIT(); \
+	} while(0)
+
+// superinstruction of more instructions than left is split,
+// so that cvm_ctx_run_for runs at most max instructions
+#define VM_SPLIT() \
+	do { \
+		if (VM_FUEL && left < CVM_KERNEL_FUSED && left < insn_count(ip->opcode)) goto vm_split; \
+	} while(0)
+
+// profiler counts next instruction, other loops have no code for it
+#ifdef CVM_KERNEL_PROFILE
+	#define VM_PROBE() \
+		do { \
+			if (VM_PROFILE) profile_step(ctx, scratch, ip); \
+		} while(0)
+#else
+	#define VM_PROBE() do {} while(0)
+#endif
+
+// leave handler if instruction failed
+#define VM_CHECK(x) \
+	do { \
+		if ((retcode = (x)) != 0) goto vm_error; \
+	} while(0)
+
+// verified program has room for frame of fcal (verifier bounds
+// depth of every frame), else it continues with checks
+#define VM_FRAME() \
+	do { \
+		if (!VM_CHECKED && !ctx_room(ctx, stack)) goto vm_checked; \
+	} while(0)
+
+// interpreter loop with all checks
+#define VM_LOOP    vm_loop_checked
+#define VM_CHECKED 1
+#define VM_FUEL    0
+#define VM_PROFILE 0
+#include "cvmloop.h"
+
+// interpreter loop for verified programs
+#define VM_LOOP    vm_loop_verified
+#define VM_CHECKED 0
+#define VM_FUEL    0
+#define VM_PROFILE 0
+#include "cvmloop.h"
+
+// interpreter loops of cvm_ctx_run_for
+#define VM_LOOP    vm_loop_fuel_checked
+#define VM_CHECKED 1
+#define VM_FUEL    1
+#define VM_PROFILE 0
+#include "cvmloop.h"
+
+#define VM_LOOP    vm_loop_fuel_verified
+#define VM_CHECKED 0
+#define VM_FUEL    1
+#define VM_PROFILE 0
+#include "cvmloop.h"
+
+#ifdef CVM_KERNEL_PROFILE
+	// interpreter loop of cvm_ctx_profile
+	#define VM_LOOP    vm_loop_profile
+	#define VM_CHECKED 1
+	#define VM_FUEL    0
+	#define VM_PROFILE 1
+	#include "cvmloop.h"
+#endif
+
+// byte code interpretation 
+extern int cvm_ctx_run(cvm_ctx_t *ctx, int32_t **output, int32_t *input) {
+	ctx->runmi = -1;
+	return ctx_run(ctx, &ctx->stack, output, input);
+}
+
+// byte code interpretation with result in output of cap values
+// given by caller: output[0] is number of values of stack and
+// output[1] ... output[min(output[0], cap)] are values in order
+// of cvm_run, so program can be run without allocation of memory
+extern int cvm_ctx_run_buf(cvm_ctx_t *ctx, int32_t *output, int32_t cap, int32_t *input) {
+	vmstack_t stack;
+	int retcode;
+
+	ctx->runmi = -1;
+	retcode = ctx_exec(ctx, &stack, &ctx->stack, input);
+	if (retcode != 0) {
+		return retcode;
+	}
+
+	ctx_output_buf(&stack, output, cap);
+	return 0;
+}
+
+// run code of ctx on stack in memory, code of ctx
+// is not changed, so it can be run by many threads
+static int ctx_run(cvm_ctx_t *ctx, vmmemory_t *memory, int32_t **output, int32_t *input) {
+	vmstack_t stack;
+	int retcode;
+
+	retcode = ctx_exec(ctx, &stack, memory, input);
+	if (retcode != 0) {
+		return retcode;
+	}
+
+	ctx_output(&stack, output);
+	return 0;
+}
+
+// run program for input, result is in stack
+VM_INLINE int ctx_exec(cvm_ctx_t *ctx, vmstack_t *stack, vmmemory_t *memory, int32_t *input) {
+	int32_t mi;
+	int retcode;
+
+	if (ctx_input(stack, memory, input) != 0) {
+		return wrap_return(C_PUSH, 1);
+	}
+
+	mi = 0;
+	retcode = CVM_KERNEL_JEXIT;
+
+#ifdef CVM_KERNEL_JIT
+	if (ctx->jit != NULL) {
+		retcode = jit_run(ctx, stack, &mi);
+	}
+#endif
+
+	// interpreter runs program or continues it after native code
+	if (retcode == CVM_KERNEL_JEXIT) {
+		if (mi == 0 && ctx_verified(ctx, stack)) {
+			retcode = vm_loop_verified(ctx, stack, mi, NULL);
+		} else {
+			retcode = vm_loop_checked(ctx, stack, mi, NULL);
+		}
+	}
+
+	return retcode;
+}
+
+// push values of input (at most limit of stack) to empty stack
+// in memory, return 1 if there is no memory for them
+VM_INLINE int ctx_input(vmstack_t *stack, vmmemory_t *memory, int32_t *input) {
+	int32_t *base;
+	int32_t size, tos;
+
+	size = (input[0] < memory->max) ? input[0] : memory->max;
+
+	// memory of previous runs is enough for small input
+	if (memory->values == NULL || size > memory->cap) {
+		if (vmmemory_grow(memory, size) != 0) {
+			return 1;
+		}
+	}
+
+	// pushes of input: values[0] gets tos of empty stack
+	base = memory->values + 1;
+	tos = 0;
+	for (int32_t i = 1; i <= size; ++i) {
+		base[i-2] = tos;
+		tos = input[i];
+	}
+
+	stack->memory = memory;
+	stack->base = base;
+	stack->cap = memory->cap;
+	stack->size = size;
+	stack->tos = tos;
+	stack->frame = 0;
+	stack->depth = 0;
+	return 0;
+}
+
+// program runs without checks for this input: stack
+// has memory for maxdepth values over it
+VM_INLINE int ctx_verified(cvm_ctx_t *ctx, vmstack_t *stack) {
+	return ctx->verified && stack->size >= ctx->minargs && ctx_room(ctx, stack);
+}
+
+// stack has memory for maxdepth values over its size
+VM_INLINE int ctx_room(cvm_ctx_t *ctx, vmstack_t *stack) {
+	if (stack->size + ctx->maxdepth <= stack->cap) {
+		return 1;
+	}
+	return ctx->maxdepth <= stack->memory->max - stack->size &&
+		vmstack_grow(stack, stack->size + ctx->maxdepth) == 0;
+}
+
+// copy values of stack to output in order of cvm_run
+static void ctx_output(vmstack_t *stack, int32_t **output) {
+	int32_t size;
+
+	size = stack->size;
+	stack->base[size-1] = stack->tos;
+
+	*output = (int32_t*)malloc(sizeof(int32_t)*(size+1));
+	(*output)[0] = size;
+
+	for (int i = 1; i <= size; ++i) {
+		(*output)[i] = stack->base[size-i];
+	}
+}
+
+// copy at most cap values of stack to output in order of cvm_run
+static void ctx_output_buf(vmstack_t *stack, int32_t *output, int32_t cap) {
+	int32_t size;
+
+	size = stack->size;
+	stack->base[size-1] = stack->tos;
+
+	output[0] = size;
+	if (cap > size) {
+		cap = size;
+	}
+
+	for (int32_t i = 1; i <= cap; ++i) {
+		output[i] = stack->base[size-i];
+	}
+}
+
+// byte code interpretation in static memory of virtual machine
+extern int cvm_run(int32_t **output, int32_t *input) {
+	return cvm_ctx_run(&VM, output, input);
+}
+
+extern int cvm_run_buf(int32_t *output, int32_t cap, int32_t *input) {
+	return cvm_ctx_run_buf(&VM, output, cap, input);
+}
+
+// byte code interpretation limited by max instructions: program which
+// used them is stopped (CVM_YIELD) and keeps its state in ctx until
+// cvm_ctx_resume, cvm_ctx_run_for or cvm_ctx_load. Native code can't
+// count instructions, so program is interpreted.
+extern int cvm_ctx_run_for(cvm_ctx_t *ctx, int32_t **output, int32_t *input, int64_t max) {
+	vmstack_t stack;
+
+	vmfuel_t fuel;
+
+	ctx->runmi = -1;
+	if (ctx_input(&stack, &ctx->stack, input) != 0) {
+		return wrap_return(C_PUSH, 1);
+	}
+	ctx->runverified = ctx_verified(ctx, &stack);
+
+	fuel.left = max;
+	fuel.stop = NULL;
+	return ctx_run_fuel(ctx, &stack, 0, output, &fuel);
+}
+
+// continue program stopped by cvm_ctx_run_for for max instructions,
+// CVM_IDLE if there is no stopped program
+extern int cvm_ctx_resume(cvm_ctx_t *ctx, int32_t **output, int64_t max) {
+	vmstack_t stack;
+	vmfuel_t fuel;
+
+	if (ctx->runmi < 0) {
+		return CVM_IDLE;
+	}
+
+	stack.memory = &ctx->stack;
+	stack.base = ctx->stack.values + 1;
+	stack.cap = ctx->stack.cap;
+	stack.size = ctx->runsize;
+	stack.tos = stack.base[stack.size-1];
+	stack.depth = ctx->rundepth;
+	stack.frame = (stack.depth > 0) ? ctx->stack.frames[stack.depth-1].base : 0;
+
+	fuel.left = max;
+	fuel.stop = NULL;
+	return ctx_run_fuel(ctx, &stack, ctx->runmi, output, &fuel);
+}
+
+extern int cvm_run_for(int32_t **output, int32_t *input, int64_t max) {
+	return cvm_ctx_run_for(&VM, output, input, max);
+}
+
+extern int cvm_resume(int32_t **output, int64_t max) {
+	return cvm_ctx_resume(&VM, output, max);
+}
+
+// byte code interpretation which stops (CVM_YIELD) when program comes
+// to byte mi, as cvm_ctx_run_for stops, or runs to the end if it doesn't
+extern int cvm_ctx_run_until(cvm_ctx_t *ctx, int32_t **output, int32_t *input, int32_t mi) {
+	vmstack_t stack;
+	vmfuel_t fuel;
+	int32_t split;
+	int retcode;
+
+	ctx->runmi = -1;
+	if (ctx_input(&stack, &ctx->stack, input) != 0) {
+		return wrap_return(C_PUSH, 1);
+	}
+	ctx->runverified = ctx_verified(ctx, &stack);
+
+	fuel.left = INT64_MAX;
+	fuel.stop = NULL;
+	split = -1;
+	if (mi >= 0 && mi < ctx->cmused && ctx->slots[mi] >= 0) {
+		fuel.stop = ctx->code + ctx->slots[mi];
+		split = fuse_split(ctx, ctx->slots[mi]);
+	}
+
+	retcode = ctx_run_fuel(ctx, &stack, 0, output, &fuel);
+
+	if (split >= 0) {
+		fuse_insn(&ctx->code[split]);
+	}
+	return retcode;
+}
+
+extern int cvm_run_until(int32_t **output, int32_t *input, int32_t mi) {
+	return cvm_ctx_run_until(&VM, output, input, mi);
+}
+
+// write bytes of snapshot and continue its checksum
+static void snap_write(FILE *output, const uint8_t *bytes, size_t size, uint32_t *hash) {
+	*hash = bcd_hash(*hash, bytes, size);
+	fwrite(bytes, 1, size, output);
+}
+
+// write program stopped by cvm_ctx_run_for or cvm_ctx_run_until,
+// CVM_IDLE if there is no stopped program
+extern int cvm_ctx_snapshot(cvm_ctx_t *ctx, FILE *output) {
+	uint8_t bytes[CVM_KERNEL_SHEADER];
+	uint32_t hash;
+
+	if (ctx->runmi < 0) {
+		return CVM_IDLE;
+	}
+
+	hash = CVM_KERNEL_FNVBASIS;
+	memcpy(bytes, CVM_KERNEL_SMAGIC, 4);
+	bytes[4] = CVM_KERNEL_SVERSION;
+	split_32bits_to_8bits((uint32_t)ctx->cmused, bytes+5);
+	split_32bits_to_8bits((uint32_t)ctx->runmi, bytes+9);
+	split_32bits_to_8bits((uint32_t)ctx->runsize, bytes+13);
+
+	snap_write(output, bytes, CVM_KERNEL_SHEADER, &hash);
+	snap_write(output, ctx->memory, (size_t)ctx->cmused, &hash);
+	for (int32_t i = 1; i <= ctx->runsize; ++i) {
+		split_32bits_to_8bits((uint32_t)ctx->stack.values[i], bytes);
+		snap_write(output, bytes, 4, &hash);
+	}
+
+	split_32bits_to_8bits((uint32_t)ctx->rundepth, bytes);
+	snap_write(output, bytes, 4, &hash);
+	for (int32_t i = 0; i < ctx->rundepth; ++i) {
+		split_32bits_to_8bits((uint32_t)ctx->stack.frames[i].ret, bytes);
+		split_32bits_to_8bits((uint32_t)ctx->stack.frames[i].base, bytes+4);
+		snap_write(output, bytes, 8, &hash);
+	}
+
+	split_32bits_to_8bits(hash, bytes);
+	fwrite(bytes, 1, 4, output);
+	return ferror(output) ? 1 : 0;
+}
+
+// load code of snapshot and its stopped program with values of
+// input pushed on the stack, then cvm_ctx_resume continues it
+extern int cvm_ctx_restore(cvm_ctx_t *ctx, uint8_t *memory, size_t msize, int32_t *input) {
+	return ctx_restore(ctx, memory, msize, input, NULL, 0);
+}
+
+// restore snapshot of file, on POSIX it is mapped read-only and
+// code memory of context stays in it; return 2 if file can't be read
+extern int cvm_ctx_restore_file(cvm_ctx_t *ctx, const char *filename, int32_t *input) {
+	uint8_t *memory;
+	size_t size;
+	int retcode;
+
+#ifdef CVM_KERNEL_MMAP
+	retcode = ctx_map(filename, &memory, &size);
+	if (retcode != 0) {
+		return retcode;
+	}
+	if (memory == NULL) {
+		return 1;
+	}
+
+	// mapping is owned by context only after successful restore
+	retcode = ctx_restore(ctx, memory, size, input, memory, size);
+	if (retcode != 0) {
+		munmap(memory, size);
+	}
+#else
+	retcode = ctx_read(filename, &memory, &size);
+	if (retcode != 0) {
+		return retcode;
+	}
+
+	retcode = ctx_restore(ctx, memory, size, input, NULL, 0);
+	free(memory);
+#endif
+
+	return retcode;
+}
+
+// restore snapshot from memory, code stays in map if it is given
+// (snapshot of version 1 has no frames, of version 2 no checksum)
+static int ctx_restore(cvm_ctx_t *ctx, uint8_t *memory, size_t msize, int32_t *input, uint8_t *map, size_t mapsize) {
+	uint32_t cmused, mi, size, depth;
+	uint8_t *values, *frames;
+	vmstack_t stack;
+	size_t used;
+
+	if (msize < CVM_KERNEL_SHEADER || memcmp(memory, CVM_KERNEL_SMAGIC, 4) != 0 ||
+		memory[4] < 1 || memory[4] > CVM_KERNEL_SVERSION) {
+		return 1;
+	}
+
+	cmused = join_8bits_to_32bits(memory + 5);
+	mi = join_8bits_to_32bits(memory + 9);
+	size = join_8bits_to_32bits(memory + 13);
+
+	if (cmused > (uint32_t)ctx->cmax || mi > cmused || size > (uint32_t)ctx->stack.max ||
+		(uint32_t)input[0] > (uint32_t)ctx->stack.max - size) {
+		return 1;
+	}
+
+	used = CVM_KERNEL_SHEADER + (size_t)cmused + (size_t)size * 4;
+	values = memory + CVM_KERNEL_SHEADER + cmused;
+	frames = memory + used + 4;
+	depth = 0;
+	if (memory[4] > 1) {
+		if (msize < used + 4) {
+			return 1;
+		}
+		depth = join_8bits_to_32bits(memory + used);
+		if (depth > (uint32_t)ctx->stack.max) {
+			return 1;
+		}
+		used += 4 + (size_t)depth * 8;
+	}
+	if (memory[4] > 2) {
+		if (msize != used + 4 ||
+			bcd_checksum(memory, used) != join_8bits_to_32bits(memory + used)) {
+			return 1;
+		}
+	} else if (msize != used) {
+		return 1;
+	}
+
+	// return address is in code and frame is in limit of stack
+	for (uint32_t i = 0; i < depth; ++i) {
+		if (join_8bits_to_32bits(frames + i * 8) > cmused ||
+			join_8bits_to_32bits(frames + i * 8 + 4) > (uint32_t)ctx->stack.max) {
+			return 1;
+		}
+	}
+
+	if (ctx_load(ctx, memory + CVM_KERNEL_SHEADER, (int32_t)cmused, map, mapsize) != 0) {
+		return 1;
+	}
+
+	stack.memory = &ctx->stack;
+	if (vmstack_grow(&stack, (int32_t)size + input[0]) != 0 ||
+		vmframes_grow(&ctx->stack, (int32_t)depth) != 0) {
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < size; ++i) {
+		stack.base[i] = (int32_t)join_8bits_to_32bits(values + i * 4);
+	}
+	for (int32_t i = 1; i <= input[0]; ++i) {
+		stack.base[size+i-1] = input[i];
+	}
+	for (uint32_t i = 0; i < depth; ++i) {
+		ctx->stack.frames[i].ret = (int32_t)join_8bits_to_32bits(frames + i * 8);
+		ctx->stack.frames[i].base = (int32_t)join_8bits_to_32bits(frames + i * 8 + 4);
+	}
+
+	ctx->runmi = (int32_t)mi;
+	ctx->runsize = (int32_t)size + input[0];
+	ctx->rundepth = (int32_t)depth;
+	ctx->runverified = 0;
+	return 0;
+}
+
+extern int cvm_snapshot(FILE *output) {
+	return cvm_ctx_snapshot(&VM, output);
+}
+
+extern int cvm_restore(uint8_t *memory, size_t msize, int32_t *input) {
+	return cvm_ctx_restore(&VM, memory, msize, input);
+}
 
-static void compile_push(FILE *output, hashtab_t *hashtab, char *arg);
-static char *read_opcode(char *line, uint8_t *opcode);
-static uint8_t find_opcode(char *str);
-static void split_32bits_to_8bits(uint32_t num, uint8_t *bytes);
+extern int cvm_restore_file(const char *filename, int32_t *input) {
+	return cvm_ctx_restore_file(&VM, filename, input);
+}
 
-static char *str_trim_spaces(char *str);
-static char *str_set_end(char *str);
-static char *str_to_lower(char *str);
-static int str_is_number(char *str);
+// run program from byte mi on stack in memory of ctx
+static int ctx_run_fuel(cvm_ctx_t *ctx, vmstack_t *stack, int32_t mi, int32_t **output, vmfuel_t *fuel) {
+	int retcode;
 
-#ifdef CVM_KERNEL_IAPPEND
-	static int exec_not(stack_t *stack);
-	static int exec_binop(stack_t *stack, uint8_t opcode);
-	static int exec_allc(stack_t *stack);
-#endif 
+	fuel->mi = mi;
+	ctx->runmi = -1;
 
-static int exec_push(stack_t *stack, int32_t *mi);
-static int exec_pop(stack_t *stack);
-static int exec_incdec(stack_t *stack, uint8_t opcode);
-static int exec_stor(stack_t *stack);
-static int exec_load(stack_t *stack);
-static int exec_jmp(stack_t *stack, int32_t *mi);
-static int exec_jmpif(stack_t *stack, uint8_t opcode, int32_t *mi);
-static int exec_call(stack_t *stack, int32_t *mi);
+	if (fuel->left <= 0 || (mi == 0 && fuel->stop == ctx->code)) {
+		retcode = CVM_YIELD;
+	} else if (ctx->runverified) {
+		retcode = vm_loop_fuel_verified(ctx, stack, mi, fuel);
+	} else {
+		retcode = vm_loop_fuel_checked(ctx, stack, mi, fuel);
+	}
 
-static uint32_t join_8bits_to_32bits(uint8_t *bytes);
-static uint16_t wrap_return(uint8_t x, uint8_t y);
+	if (retcode == CVM_YIELD) {
+		stack->base[stack->size-1] = stack->tos;
+		ctx->runmi = fuel->mi;
+		ctx->runsize = stack->size;
+		ctx->rundepth = stack->depth;
+		return CVM_YIELD;
+	}
 
-/// SECTION: COMPILE
+	if (retcode != 0) {
+		return retcode;
+	}
 
-// translate assembly mnemonics to byte codes
-// example: ("PUSH 5" -> C_PUSH || 0x00 || 0x00 || 0x00 || 0x05)
-// example: ("POP" -> C_POP)
-extern int cvm_compile(FILE *output, FILE *input) {
-	hashtab_t *hashtab;
-	int32_t bindex;
-	char buffer[BUFSIZ];
-	char *arg;
-	uint8_t opcode;
+	ctx_output(stack, output);
+	return 0;
+}
 
-	hashtab = hashtab_new(512);
-	bindex = 0;
+#ifdef CVM_KERNEL_PROFILE
+// byte code interpretation with profiler: instructions by opcode and
+// by byte, time of handlers and tree of calls (call is left when program
+// comes to its return address) are written to profile also if program
+// fails, cvm_profile_free frees them; native code is not used
+extern int cvm_ctx_profile(cvm_ctx_t *ctx, cvm_profile_t *profile, int32_t **output, int32_t *input) {
+	return ctx_profile(ctx, profile, output, input, 0);
+}
 
-	// save label addresses into hashtab
-	while(fgets(buffer, BUFSIZ, input) != NULL) {
-		arg = read_opcode(buffer, &opcode);
+// cvm_ctx_profile with timeline of calls: every call and its
+// return are events, program is function at byte 0
+extern int cvm_ctx_trace(cvm_ctx_t *ctx, cvm_profile_t *profile, int32_t **output, int32_t *input) {
+	return ctx_profile(ctx, profile, output, input, 1);
+}
 
-		// undefined instruction
-		if (opcode == C_UNDF) {
-			hashtab_free(hashtab);
-			return 1;
-		}
+static int ctx_profile(cvm_ctx_t *ctx, cvm_profile_t *profile, int32_t **output, int32_t *input, int trace) {
+	vmprofile_t prof;
+	vmstack_t stack;
+	int retcode;
 
-		// if comment or void string
-		if(opcode == C_CMNT || opcode == C_VOID) {
-			continue;
-		}
+	memset(profile, 0, sizeof(*profile));
+	memset(&prof, 0, sizeof(prof));
 
-		switch(opcode) {
-			// label instruction -> save current address
-			case C_LABL:
-				if (strlen(arg) == 0 || str_is_number(arg)) {
-					hashtab_free(hashtab);
-					return 2;
-				}
-				hashtab_set(hashtab, arg, &bindex, sizeof(bindex));
-			break;
-			// push instruction -> +5 bytes 
-			case C_PUSH:
-				bindex += 5;
-			break;
-			// another instruction -> +1 byte
-			default:
-				bindex += 1;
-			break;
-		}
+	profile->tsc = CVM_KERNEL_PTSC;
+	profile->size = ctx->cmused;
+	profile->addrs = (uint64_t*)calloc((size_t)ctx->cmused+1, sizeof(uint64_t));
+	profile->frames = (cvm_frame_t*)malloc(sizeof(cvm_frame_t)*CVM_KERNEL_PDEPTH);
+
+	if (profile->addrs == NULL || profile->frames == NULL) {
+		cvm_profile_free(profile);
+		return wrap_return(C_PUSH, 1);
 	}
 
-	// read file from the beginning 
-	fseek(input, 0, SEEK_SET);
+	// frame of program
+	profile->frames[0] = (cvm_frame_t){ .addr = 0, .parent = -1, .child = -1, .next = -1 };
+	profile->nframes = 1;
+	prof.out = profile;
+	prof.capframes = CVM_KERNEL_PDEPTH;
+	prof.ret = -1;
+	prof.trace = trace;
+	prof.start = profile_ns();
+	profile_event(&prof, 0, 1);
 
-	// write byte codes with saved label addresses
-	while(fgets(buffer, BUFSIZ, input) != NULL) {
-		arg = read_opcode(buffer, &opcode);
-		switch (opcode) {
-			// pass null and pseudo instructions
-			case C_VOID: case C_CMNT: case C_LABL:
-			break;
-			// push instruction = 5 bytes 
-			case C_PUSH: 
-				if (strlen(arg) == 0) {
-					hashtab_free(hashtab);
-					return 3;
-				}
-				compile_push(output, hashtab, arg);
-			break;
-			// another instruction = 1 byte
-			default:
-				fprintf(output, "%c", opcode);
-			break;
-		}
+	ctx->runmi = -1;
+	if (ctx_input(&stack, &ctx->stack, input) != 0) {
+		retcode = wrap_return(C_PUSH, 1);
+	} else {
+		ctx->profile = &prof;
+		retcode = vm_loop_profile(ctx, &stack, 0, NULL);
+		profile_time(&prof);
+		ctx->profile = NULL;
+	}
+
+	// program ends in all open calls
+	while (prof.ncalls > 0) {
+		profile_leave(&prof);
 	}
+	profile_event(&prof, 0, 0);
 
-	hashtab_free(hashtab);
+	free(prof.calls);
+
+	if (retcode != 0) {
+		return retcode;
+	}
+
+	ctx_output(&stack, output);
 	return 0;
 }
 
-// load value from hashtab (if exists) 
-// and convert int32->bytes[4]
-static void compile_push(FILE *output, hashtab_t *hashtab, char *arg) {
-	uint8_t bytes[4];
-	int32_t *temp;
-	int32_t num;
+extern int cvm_profile(cvm_profile_t *profile, int32_t **output, int32_t *input) {
+	return cvm_ctx_profile(&VM, profile, output, input);
+}
 
-	temp = hashtab_get(hashtab, arg);
-	if (temp == NULL) {
-		num = atoi(arg);
-	} else {
-		num = *temp;
-	}
+extern int cvm_trace(cvm_profile_t *profile, int32_t **output, int32_t *input) {
+	return cvm_ctx_trace(&VM, profile, output, input);
+}
+
+extern void cvm_profile_free(cvm_profile_t *profile) {
+	free(profile->addrs);
+	free(profile->frames);
+	free(profile->events);
+
+	profile->addrs = NULL;
+	profile->frames = NULL;
+	profile->nframes = 0;
+	profile->events = NULL;
+	profile->nevents = 0;
+}
 
-	split_32bits_to_8bits((uint32_t)num, bytes);
-	fprintf(output, "%c%c%c%c%c", C_PUSH, bytes[0], bytes[1], bytes[2], bytes[3]);
+// mnemonic of opcode or of instructions of superinstruction
+// ("push,load"), NULL if there is no such instruction
+extern const char *cvm_opcode_name(uint8_t opcode) {
+	switch(opcode) {
+		case C_PUSH: return "push";
+		case C_POP:  return "pop";
+		case C_INC:  return "inc";
+		case C_DEC:  return "dec";
+		case C_JMP:  return "jmp";
+		case C_JG:   return "jg";
+		case C_STOR: return "stor";
+		case C_LOAD: return "load";
+		case C_CALL: return "call";
+		case C_HLT:  return "hlt";
+	#ifdef CVM_KERNEL_IAPPEND
+		case C_ADD:  return "add";
+		case C_SUB:  return "sub";
+		case C_MUL:  return "mul";
+		case C_DIV:  return "div";
+		case C_MOD:  return "mod";
+		case C_SHR:  return "shr";
+		case C_SHL:  return "shl";
+		case C_XOR:  return "xor";
+		case C_AND:  return "and";
+		case C_OR:   return "or";
+		case C_NOT:  return "not";
+		case C_JE:   return "je";
+		case C_JL:   return "jl";
+		case C_JNE:  return "jne";
+		case C_JLE:  return "jle";
+		case C_JGE:  return "jge";
+		case C_ALLC: return "allc";
+		case C_FCAL: return "fcal";
+		case C_RET:  return "ret";
+		case C_FLD:  return "fld";
+		case C_FST:  return "fst";
+		case C_PJE:  return "push,je";
+		case C_PJL:  return "push,jl";
+		case C_PJNE: return "push,jne";
+		case C_PJLE: return "push,jle";
+		case C_PJGE: return "push,jge";
+		case C_PFCL: return "push,fcal";
+	#endif
+		case C_PLOD: return "push,load";
+		case C_PSTR: return "push,push,stor";
+		case C_PSTP: return "push,push,stor,pop";
+		case C_PJMP: return "push,jmp";
+		case C_PCAL: return "push,call";
+		case C_PJG:  return "push,jg";
+		default:     return NULL;
+	}
 }
 
-// read opcode from string and return
-// pointer to first argument if exists
-static char *read_opcode(char *line, uint8_t *opcode) {
-	char *ptr;
+// count instruction ip (all instructions of superinstruction)
+// at its byte, in its frame and time of previous handler
+static void profile_step(cvm_ctx_t *ctx, const cvm_insn_t *scratch, const cvm_insn_t *ip) {
+	vmprofile_t *prof;
+	cvm_profile_t *out;
+	int32_t ci, mi, count;
 
-	// get first word in line
-	line = str_trim_spaces(line);
-	ptr = str_set_end(line);
+	prof = ctx->profile;
+	out = prof->out;
+	profile_time(prof);
 
-	// get opcode from word
-	*opcode = find_opcode(line);
-	switch(*opcode) {
-		case C_PUSH: case C_LABL:
-			break;
-		default:
-			return NULL;
+	// go to byte after jump inside of instruction
+	if (ip->opcode == C_SYNC) {
+		return;
 	}
 
-	// get second word in line
-	line = str_trim_spaces(++ptr);
-	str_set_end(line);
+	// instruction decoded from jump inside of instruction
+	ci = -1;
+	if (ip == &scratch[0]) {
+		mi = insn_byte(ctx, scratch, ip);
+	} else {
+		ci = ip - ctx->code;
+		mi = ctx->bytes[ci];
+	}
 
-	// pointer to first arg
-	return line;
-}
+	// called function starts after call, it ends at return address
+	if (prof->ret >= 0) {
+		profile_call(prof, mi, ctx->stack.max);
+	} else if (prof->ncalls > 0 && mi == prof->calls[prof->ncalls-1].ret) {
+		profile_leave(prof);
+	}
 
-// get instruction by mnemonic
-// example: "push" -> C_PUSH
-static uint8_t find_opcode(char *str) {
-	uint8_t opcode;
+	prof->opcode = ip->opcode;
+	prof->ret = -1;
+	if (ip->opcode == C_CALL) {
+		prof->ret = ip->arg;
+	}
+	if (ip->opcode == C_PCAL) {
+		prof->ret = ip[1].arg;
+	}
+#ifdef CVM_KERNEL_IAPPEND
+	if (ip->opcode == C_FCAL) {
+		prof->ret = ip->arg;
+	}
+	if (ip->opcode == C_PFCL) {
+		prof->ret = ip[1].arg;
+	}
+#endif
 
-	// default value
-	opcode = C_UNDF;
+	count = insn_count(ip->opcode);
+	out->execs[ip->opcode] += 1;
+	out->frames[prof->frame].count += count;
+	for (int32_t i = 0; i < count; ++i) {
+		out->insns[insn_opcode(ip[i].opcode)] += 1;
+		out->addrs[(ci >= 0) ? ctx->bytes[ci+i] : mi] += 1;
+	}
+}
 
-	// opcode from word
-	for (int i = 0; i < CVM_KERNEL_ISIZE; ++i) {
-		if (strcmp(str_to_lower(str), VM.bclist[i].mnem) == 0) {
-			opcode = VM.bclist[i].bcode;
-			break;
+// go to frame of function at byte mi called from current frame,
+// calls over limit of stack (their return addresses were removed)
+// are not followed
+static void profile_call(vmprofile_t *prof, int32_t mi, int32_t max) {
+	vmcall_t *calls;
+	int32_t cap;
+
+	if (prof->ncalls == prof->capcalls) {
+		if (prof->capcalls >= max) {
+			return;
+		}
+		cap = prof->capcalls ? prof->capcalls * 2 : CVM_KERNEL_PDEPTH;
+		calls = (vmcall_t*)realloc(prof->calls, sizeof(vmcall_t)*cap);
+		if (calls == NULL) {
+			return;
 		}
+		prof->calls = calls;
+		prof->capcalls = cap;
 	}
 
-	return opcode;
+	prof->calls[prof->ncalls].frame = prof->frame;
+	prof->calls[prof->ncalls].ret = prof->ret;
+	prof->calls[prof->ncalls].addr = mi;
+	prof->calls[prof->ncalls].traced = profile_event(prof, mi, 1);
+	prof->ncalls += 1;
+
+	if (prof->ncalls < CVM_KERNEL_PDEPTH) {
+		prof->frame = profile_frame(prof, prof->frame, mi);
+	}
 }
 
-// example: "PUSH" -> "push"
-static char *str_to_lower(char *str) {
-	int len = strlen(str);
+// return from the last call to frame of its caller
+static void profile_leave(vmprofile_t *prof) {
+	vmcall_t *call;
 
-	for (int i = 0; i < len; ++i) {
-		str[i] = tolower(str[i]);
+	call = &prof->calls[--prof->ncalls];
+	if (call->traced) {
+		profile_event(prof, call->addr, 0);
 	}
-
-	return str;
+	prof->frame = call->frame;
 }
 
-// example: "12345" -> true
-// example: "a12345", "12345a" -> false
-static int str_is_number(char *str) {
-	int len = strlen(str);
-	if (len == 0) {
+// append event of entry (enter = 1) or leave of function at byte mi
+// to trace, return 1 if it was appended; every entry keeps place
+// for its leave, so leaves are always appended
+static int profile_event(vmprofile_t *prof, int32_t mi, int enter) {
+	cvm_profile_t *out;
+	cvm_event_t *events;
+	int32_t cap;
+
+	out = prof->out;
+	if (!prof->trace || (enter && out->nevents + prof->nopen + 2 > CVM_KERNEL_PEVENTS)) {
 		return 0;
 	}
 
-	for (int i = 0; i < len; ++i) {
-		if (!isdigit(str[i])) {
+	if (enter && out->nevents + prof->nopen + 2 > prof->capevents) {
+		cap = prof->capevents ? prof->capevents * 2 : 1024;
+		events = (cvm_event_t*)realloc(out->events, sizeof(cvm_event_t)*cap);
+		if (events == NULL) {
 			return 0;
 		}
+		out->events = events;
+		prof->capevents = cap;
 	}
 
-	return 1; 
+	out->events[out->nevents].addr = mi;
+	out->events[out->nevents].enter = enter;
+	out->events[out->nevents].time = profile_ns() - prof->start;
+	out->nevents += 1;
+	prof->nopen += enter ? 1 : -1;
+	return 1;
 }
 
-// example: "  word1 word2 word3" -> "word1 word2 word3"
-static char *str_trim_spaces(char *str) {
-	while(isspace(*str)) {
-		++str;
+// frame of function at byte mi called from frame parent,
+// return parent if there is no memory for new frame
+static int32_t profile_frame(vmprofile_t *prof, int32_t parent, int32_t mi) {
+	cvm_frame_t *frames;
+	int32_t fi;
+
+	frames = prof->out->frames;
+	for (fi = frames[parent].child; fi >= 0; fi = frames[fi].next) {
+		if (frames[fi].addr == mi) {
+			return fi;
+		}
+	}
+
+	if (prof->out->nframes == prof->capframes) {
+		frames = (cvm_frame_t*)realloc(frames, sizeof(cvm_frame_t)*prof->capframes*2);
+		if (frames == NULL) {
+			return parent;
+		}
+		prof->out->frames = frames;
+		prof->capframes *= 2;
 	}
 
-	return str;
+	fi = prof->out->nframes++;
+	frames[fi] = (cvm_frame_t){ .addr = mi, .parent = parent, .child = -1, .next = frames[parent].child };
+	frames[parent].child = fi;
+	return fi;
 }
 
-// example: "word1 word2 word3" -> "word1\0word2 word3"
-static char *str_set_end(char *str) {
-	char *ptr = str;
+// add time from start of last handler to its opcode
+static void profile_time(vmprofile_t *prof) {
+	uint64_t now;
 
-	while(!isspace(*ptr)) {
-		++ptr;
+#if CVM_KERNEL_PTSC
+	now = __builtin_ia32_rdtsc();
+#else
+	now = profile_ns();
+#endif
+
+	if (prof->last != 0) {
+		prof->out->ticks[prof->opcode] += now - prof->last;
 	}
+	prof->last = now;
+}
 
-	*ptr = '\0';
-	return ptr;
+// monotonic time in nanoseconds
+static uint64_t profile_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
 }
+#endif
 
-// return (x[0], x[1], x[2], x[3])
-static void split_32bits_to_8bits(uint32_t num, uint8_t *bytes) {
-	for (int i = 0; i < 4; ++i) {
-		bytes[i] = (uint8_t)(num >> (24 - i * 8));
+// run code of ctx for n inputs by pool of threads workers (calling
+// thread is one of them), every worker has its own stack:
+// outputs[i] and retcodes[i] are results of cvm_ctx_run for inputs[i],
+// outputs[i] = NULL if retcodes[i] != 0
+extern int cvm_ctx_run_batch(cvm_ctx_t *ctx, int32_t **outputs, int32_t **inputs,
+		int32_t *retcodes, int32_t n, int threads) {
+	batch_t batch;
+#ifdef CVM_KERNEL_THREADS
+	pthread_t *workers;
+	int started;
+#endif
+
+	if (n < 0) {
+		return 1;
 	}
-}
 
+	// stack of ctx is used by calling thread
+	ctx->runmi = -1;
 
+	batch.ctx = ctx;
+	batch.outputs = outputs;
+	batch.inputs = inputs;
+	batch.retcodes = retcodes;
+	batch.njobs = n;
+	batch.next = 0;
 
-/// SECTION: LOAD
+#ifdef CVM_KERNEL_THREADS
+	if (threads > (n + CVM_KERNEL_BCHUNK - 1) / CVM_KERNEL_BCHUNK) {
+		threads = (n + CVM_KERNEL_BCHUNK - 1) / CVM_KERNEL_BCHUNK;
+	}
 
-// load byte codes to static memory of virtual machine
-extern int cvm_load(uint8_t *memory, int32_t msize) {
-	if (msize < 0 || msize >= CVM_KERNEL_CMEMORY) {
-		return 1;
+	// jobs of threads which were not started are done by others
+	workers = NULL;
+	started = 0;
+	if (threads > 1) {
+		workers = (pthread_t*)malloc(sizeof(pthread_t)*(threads-1));
+	}
+	pthread_mutex_init(&batch.lock, NULL);
+	for (int i = 0; workers != NULL && i < threads-1; ++i) {
+		if (pthread_create(&workers[started], NULL, batch_thread, &batch) == 0) {
+			started += 1;
+		}
 	}
+#else
+	(void)threads;
+#endif
+
+	batch_work(&batch, &ctx->stack);
 
-	memcpy(VM.memory, memory, msize);
-	VM.cmused = msize;
+#ifdef CVM_KERNEL_THREADS
+	for (int i = 0; i < started; ++i) {
+		pthread_join(workers[i], NULL);
+	}
+	pthread_mutex_destroy(&batch.lock);
+	free(workers);
+#endif
 
 	return 0;
 }
 
+// batch run in static memory of virtual machine
+extern int cvm_run_batch(int32_t **outputs, int32_t **inputs,
+		int32_t *retcodes, int32_t n, int threads) {
+	return cvm_ctx_run_batch(&VM, outputs, inputs, retcodes, n, threads);
+}
 
+// every worker runs its jobs one by one on its stack
+static void batch_work(batch_t *batch, vmmemory_t *memory) {
+	int32_t begin, end;
 
-/// SECTION: RUN
+	while(batch_take(batch, &begin, &end)) {
+		for (int32_t i = begin; i < end; ++i) {
+			batch->retcodes[i] = ctx_run(batch->ctx, memory, &batch->outputs[i], batch->inputs[i]);
+			if (batch->retcodes[i] != 0) {
+				batch->outputs[i] = NULL;
+			}
+		}
+	}
+}
 
-// byte code interpretation 
-extern int cvm_run(int32_t **output, int32_t *input) {
-	stack_t *stack;
-	uint8_t opcode;
-	int32_t mi;
-	int retcode;
+// take next jobs begin ... end-1, return 0 if all jobs are taken
+static int batch_take(batch_t *batch, int32_t *begin, int32_t *end) {
+#ifdef CVM_KERNEL_THREADS
+	pthread_mutex_lock(&batch->lock);
+#endif
 
-	stack = stack_new(CVM_KERNEL_SMEMORY, sizeof(int32_t));
-	for (int i = 1; i <= input[0]; ++i) {
-		stack_push(stack, &input[i]);
+	*begin = batch->next;
+	*end = batch->next + CVM_KERNEL_BCHUNK;
+	if (*end > batch->njobs) {
+		*end = batch->njobs;
 	}
+	batch->next = *end;
 
-	mi = 0;
-	while(mi < VM.cmused) {
-		opcode = VM.memory[mi++];
+#ifdef CVM_KERNEL_THREADS
+	pthread_mutex_unlock(&batch->lock);
+#endif
 
-		switch(opcode) {
-		#ifdef CVM_KERNEL_IAPPEND
-			case C_MUL: case C_DIV:
-			case C_MOD: case C_AND: 
-			case C_OR:  case C_XOR:
-			case C_SHR: case C_SHL: 
-			case C_ADD: case C_SUB: 
-				retcode = exec_binop(stack, opcode);
-			break;
-			case C_NOT:
-				retcode = exec_not(stack);
-			break;
-			case C_ALLC: 
-				retcode = exec_allc(stack);
-			break;
-		#endif
-		#ifdef CVM_KERNEL_IAPPEND
-			case C_JGE: case C_JLE: case C_JNE: case C_JL: case C_JE: 
-		#endif 
-			case C_JG: 
-				retcode = exec_jmpif(stack, opcode, &mi);
-			break;
-			case C_JMP: 
-				retcode = exec_jmp(stack, &mi);
-			break;
-			case C_CALL: 
-				retcode = exec_call(stack, &mi);
-			break;
-			case C_PUSH:
-				retcode = exec_push(stack, &mi);
-			break;
-			case C_POP:
-				retcode = exec_pop(stack);
-			break;
-			case C_INC: case C_DEC:
-				retcode = exec_incdec(stack, opcode);
-			break;
-			case C_STOR: 
-				retcode = exec_stor(stack);
-			break;
-			case C_LOAD: 
-				retcode = exec_load(stack);
-			break;
-			case C_HLT:
-				mi = VM.cmused;
-				retcode = 0;
-			break;
-			default: 
-				retcode = wrap_return(C_UNDF, 1);
-			break;
-		}
-	
-		if (retcode != 0) {
-			stack_free(stack);
-			return retcode;
+	return *begin < *end;
+}
+
+#ifdef CVM_KERNEL_THREADS
+	// worker without stack leaves its jobs to others
+	static void *batch_thread(void *arg) {
+		batch_t *batch;
+		vmmemory_t memory;
+		vmstack_t stack;
+
+		batch = (batch_t*)arg;
+		memory.values = NULL;
+		memory.cap = 0;
+		memory.frames = NULL;
+		memory.capframes = 0;
+		memory.max = batch->ctx->stack.max;
+
+		stack.memory = &memory;
+		if (vmstack_grow(&stack, 0) == 0) {
+			batch_work(batch, &memory);
 		}
+
+		free(memory.values);
+		free(memory.frames);
+		return NULL;
 	}
+#endif
 
-	mi = stack_size(stack);
+// memory holds at least size values (at most its limit), capacity
+// is doubled from CVM_KERNEL_SGROW values, return 1 if size
+// is over limit or there is no memory
+static int vmmemory_grow(vmmemory_t *memory, int32_t size) {
+	int32_t *values;
+	int32_t cap;
+
+	if (memory->values != NULL && size <= memory->cap) {
+		return 0;
+	}
+	if (size > memory->max) {
+		return 1;
+	}
 
-	*output = (int32_t*)malloc(sizeof(int32_t)*(mi+1));
-	(*output)[0] = mi;
+	cap = (memory->cap > 0) ? memory->cap : CVM_KERNEL_SGROW;
+	while (cap < size) {
+		cap *= 2;
+	}
+	if (cap > memory->max) {
+		cap = memory->max;
+	}
 
-	for (int i = 1; i <= mi; ++i) {
-		(*output)[i] = *(int32_t*)stack_pop(stack);
+	// values[0] is written by push into empty stack
+	values = (int32_t*)realloc(memory->values, sizeof(int32_t)*((size_t)cap+1));
+	if (values == NULL) {
+		return 1;
 	}
 
-	stack_free(stack);
+	memory->values = values;
+	memory->cap = cap;
 	return 0;
 }
 
-// append new value in stack
-static int exec_push(stack_t *stack, int32_t *mi) {
+// memory holds at least depth frames of fcal (at most limit of
+// stack), capacity is doubled from CVM_KERNEL_SGROW frames
+static int vmframes_grow(vmmemory_t *memory, int32_t depth) {
+	vmframe_t *frames;
+	int32_t cap;
+
+	if (depth <= memory->capframes) {
+		return 0;
+	}
+	if (depth > memory->max) {
+		return 1;
+	}
+
+	cap = (memory->capframes > 0) ? memory->capframes : CVM_KERNEL_SGROW;
+	while (cap < depth) {
+		cap *= 2;
+	}
+	if (cap > memory->max) {
+		cap = memory->max;
+	}
+
+	frames = (vmframe_t*)realloc(memory->frames, sizeof(vmframe_t)*(size_t)cap);
+	if (frames == NULL) {
+		return 1;
+	}
+
+	memory->frames = frames;
+	memory->capframes = cap;
+	return 0;
+}
+
+// stack can hold size values, its memory is not passed by address of
+// stack, so local stack of interpreter loop stays in registers
+VM_INLINE int vmstack_grow(vmstack_t *stack, int32_t size) {
+	if (vmmemory_grow(stack->memory, size) != 0) {
+		return 1;
+	}
+
+	stack->base = stack->memory->values + 1;
+	stack->cap = stack->memory->cap;
+	return 0;
+}
+
+// append value, top value goes from register to memory
+VM_INLINE void vmstack_push(vmstack_t *stack, int32_t num) {
+	stack->base[stack->size-1] = stack->tos;
+	stack->tos = num;
+	stack->size += 1;
+}
+
+// delete last value, then base[] holds all values
+VM_INLINE int32_t vmstack_pop(vmstack_t *stack) {
 	int32_t num;
-	uint8_t bytes[4];
 
-	if (stack_size(stack) == CVM_KERNEL_SMEMORY) {
-		return wrap_return(C_PUSH, 1);
+	num = stack->tos;
+	stack->size -= 1;
+	stack->tos = stack->base[stack->size-1];
+
+	return num;
+}
+
+// set value by index when base[] holds all values
+VM_INLINE void vmstack_set(vmstack_t *stack, int32_t index, int32_t num) {
+	stack->base[index] = num;
+	if (index == stack->size-1) {
+		stack->tos = num;
 	}
+}
 
-	memcpy(bytes, VM.memory + *mi, 4); *mi += 4;
-	num = (int32_t)join_8bits_to_32bits(bytes);
-	stack_push(stack, &num);
+// append new value in stack
+VM_INLINE int exec_push(vmstack_t *stack, int32_t num, int checked) {
+	if (checked && stack->size == stack->cap && vmstack_grow(stack, stack->size+1) != 0) {
+		return wrap_return(C_PUSH, 1);
+	}
 
+	vmstack_push(stack, num);
 	return 0;
 }
 
 // delete last value from stack
-static int exec_pop(stack_t *stack) {
-	if (stack_size(stack) == 0) {
+VM_INLINE int exec_pop(vmstack_t *stack, int checked) {
+	if (checked && stack->size == 0) {
 		return wrap_return(C_POP, 1);
 	}
 
-	stack_pop(stack);
+	vmstack_pop(stack);
 	return 0;
 }
 
 // increment or decrement operation
-static int exec_incdec(stack_t *stack, uint8_t opcode) {
+VM_INLINE int exec_incdec(vmstack_t *stack, uint8_t opcode, int checked) {
 	int32_t x;
 
-	if (stack_size(stack) == 0) {
+	if (checked && stack->size == 0) {
 		return wrap_return(opcode, 1);
 	}
 
-	x = *(int32_t*)stack_pop(stack);
+	x = vmstack_pop(stack);
 
 	switch(opcode) {
-		case C_INC: ++x; break;
-		case C_DEC: --x; break;
+		case C_INC: x = (int32_t)((uint32_t)x + 1); break;
+		case C_DEC: x = (int32_t)((uint32_t)x - 1); break;
 		default: 	return wrap_return(opcode, 2);
 	}
 
-	stack_push(stack, &x);
+	vmstack_push(stack, x);
 	return 0;
 }
 
 #ifdef CVM_KERNEL_IAPPEND
 	// bitwise negation 
-	static int exec_not(stack_t *stack) {
+	VM_INLINE int exec_not(vmstack_t *stack, int checked) {
 		int32_t x;
 
-		if (stack_size(stack) == 0) {
+		if (checked && stack->size == 0) {
 			return wrap_return(C_NOT, 1);
 		}
 
-		x = ~*(int32_t*)stack_pop(stack);
-		stack_push(stack, &x);
+		x = ~vmstack_pop(stack);
+		vmstack_push(stack, x);
 
 		return 0;
 	}
 
-	// binary operation @ -> y = y @ x
-	static int exec_binop(stack_t *stack, uint8_t opcode) {
+	// binary operation @ -> y = y @ x, integer overflow wraps and
+	// shift count is taken modulo 32 (as native code does it)
+	VM_INLINE int exec_binop(vmstack_t *stack, uint8_t opcode, int checked) {
 		int32_t x, y;
 
-		if (stack_size(stack) < 2) {
+		if (checked && stack->size < 2) {
 			return wrap_return(opcode, 1);
 		}
 
-		x = *(int32_t*)stack_pop(stack);
-		y = *(int32_t*)stack_pop(stack);
+		x = vmstack_pop(stack);
+		y = vmstack_pop(stack);
 
 		switch(opcode) {
-			case C_ADD:	y += x;		break;
-			case C_SUB:	y -= x;		break;
-			case C_MUL:	y *= x;		break;
+			case C_ADD:	y = (int32_t)((uint32_t)y + (uint32_t)x);	break;
+			case C_SUB:	y = (int32_t)((uint32_t)y - (uint32_t)x);	break;
+			case C_MUL:	y = (int32_t)((uint32_t)y * (uint32_t)x);	break;
 			case C_DIV:	y /= x;		break;
 			case C_MOD: y %= x;		break;
 			case C_AND: y &= x;		break;
 			case C_OR: 	y |= x;		break;
 			case C_XOR: y ^= x;		break;
-			case C_SHR:	y >>= x;	break;
-			case C_SHL:	y <<= x;	break;
+			case C_SHR:	y >>= (x & 31);	break;
+			case C_SHL:	y = (int32_t)((uint32_t)y << (x & 31));	break;
 			default: 	return wrap_return(opcode, 2);
 		}
 
-		stack_push(stack, &y);
+		vmstack_push(stack, y);
 		return 0;
 	}
 
 	// allocate N values = 0 in stack
-	static int exec_allc(stack_t *stack) {
+	VM_INLINE int exec_allc(vmstack_t *stack, int checked) {
 		int32_t num, null;
 
-		if (stack_size(stack) == 0) {
+		if (checked && stack->size == 0) {
 			return wrap_return(C_ALLC, 1);
 		}
 
-		num = *(int32_t*)stack_pop(stack);
-		if (num < 0) {
+		num = vmstack_pop(stack);
+		if (checked && num < 0) {
 			return wrap_return(C_ALLC, 2);
 		}
 
-		if (stack_size(stack)+num >= CVM_KERNEL_SMEMORY) {
+		if (checked && num >= stack->memory->max - stack->size) {
+			return wrap_return(C_ALLC, 3);
+		}
+		if (checked && num > stack->cap - stack->size && vmstack_grow(stack, stack->size+num) != 0) {
 			return wrap_return(C_ALLC, 3);
 		}
 
 		null = 0;
 		for (int i = 0; i < num; ++i) {
-			stack_push(stack, &null);
+			vmstack_push(stack, null);
 		}
 
 		return 0;
@@ -563,82 +5810,82 @@ static int exec_incdec(stack_t *stack, uint8_t opcode) {
 
 // store value in stack by two addresses
 // where first address = in, second address = out
-static int exec_stor(stack_t *stack) {
+VM_INLINE int exec_stor(vmstack_t *stack, int checked) {
 	int32_t num1, num2;
 
-	if (stack_size(stack) < 2) {
+	if (checked && stack->size < 2) {
 		return wrap_return(C_STOR, 1);
 	}
 
-	num1 = *(int32_t*)stack_pop(stack);
-	num2 = *(int32_t*)stack_pop(stack);
+	num1 = vmstack_pop(stack);
+	num2 = vmstack_pop(stack);
 
 	if (num1 < 0) {
-		num1 = stack_size(stack) + num1;
+		num1 = stack->size + num1;
 		if (num1 < 0) {
 			return wrap_return(C_STOR, 2);
 		}
 	} else {
-		if (num1 >= stack_size(stack)) {
+		if (num1 >= stack->size) {
 			return wrap_return(C_STOR, 3);
 		}
 	}
 
 	if (num2 < 0) {
-		num2 = stack_size(stack) + num2;
+		num2 = stack->size + num2;
 		if (num2 < 0) {
 			return wrap_return(C_STOR, 4);
 		}
 	} else {
-		if (num2 >= stack_size(stack)) {
+		if (num2 >= stack->size) {
 			return wrap_return(C_STOR, 5);
 		}
 	}
 
-	num2 = *(int32_t*)stack_get(stack, num2);
-	stack_set(stack, num1, &num2);
+	num2 = stack->base[num2];
+	vmstack_set(stack, num1, num2);
 
 	return 0;
 }
 
 // load value in stack by address
 // where address is last value in stack
-static int exec_load(stack_t *stack) {
+VM_INLINE int exec_load(vmstack_t *stack, int checked) {
 	int32_t num;
 
-	if (stack_size(stack) == 0) {
+	if (checked && stack->size == 0) {
 		return wrap_return(C_LOAD, 1);
 	}
 
-	num = *(int32_t*)stack_pop(stack);
+	num = vmstack_pop(stack);
 	if (num < 0) {
-		num = stack_size(stack) + num;
+		num = stack->size + num;
 		if (num < 0) {
 			return wrap_return(C_LOAD, 2);
 		}
 	} else {
-		if (num >= stack_size(stack)) {
+		if (num >= stack->size) {
 			return wrap_return(C_LOAD, 3);
 		}
 	}
 
-	num = *(int32_t*)stack_get(stack, num);
-	stack_push(stack, &num);
+	num = stack->base[num];
+	vmstack_push(stack, num);
 
 	return 0;
 }
 
 // jump to address in code memory
 // where address is last value in stack
-extern int exec_jmp(stack_t *stack, int32_t *mi) {
+VM_INLINE int exec_jmp(cvm_ctx_t *ctx, vmstack_t *stack, int32_t *mi, int checked) {
 	int32_t num;
 
-	if (stack_size(stack) == 0) {
+	if (checked && stack->size == 0) {
 		return wrap_return(C_JMP, 1);
 	}
 
-	num = *(int32_t*)stack_pop(stack);
-	if (num < 0 || num >= VM.cmused) {
+	num = vmstack_pop(stack);
+	if (checked && (num < 0 || num >= ctx->cmused)) {
 		return wrap_return(C_JMP, 2);
 	}
 
@@ -647,20 +5894,20 @@ extern int exec_jmp(stack_t *stack, int32_t *mi) {
 }
 
 // jump to address in code memory if condition = true
-static int exec_jmpif(stack_t *stack, uint8_t opcode, int32_t *mi) {
+VM_INLINE int exec_jmpif(cvm_ctx_t *ctx, vmstack_t *stack, uint8_t opcode, int32_t *mi, int checked) {
 	int32_t num, x, y;
 
-	if (stack_size(stack) < 3) {
+	if (checked && stack->size < 3) {
 		return wrap_return(opcode, 1);
 	}
 
-	num = *(int32_t*)stack_pop(stack);
-	if (num < 0 || num >= VM.cmused) {
+	num = vmstack_pop(stack);
+	if (checked && (num < 0 || num >= ctx->cmused)) {
 		return wrap_return(opcode, 2);
 	}
 
-	x = *(int32_t*)stack_pop(stack);
-	y = *(int32_t*)stack_pop(stack);
+	x = vmstack_pop(stack);
+	y = vmstack_pop(stack);
 
 	switch(opcode) {
 		case C_JG: 	if(y >  x) {*mi = num;} break;
@@ -678,25 +5925,119 @@ static int exec_jmpif(stack_t *stack, uint8_t opcode, int32_t *mi) {
 }
 
 // exec jmp instruction with save current position in stack
-static int exec_call(stack_t *stack, int32_t *mi) {
+VM_INLINE int exec_call(cvm_ctx_t *ctx, vmstack_t *stack, int32_t num, int32_t *mi, int checked) {
 	int retcode;
-	int32_t num;
 
-	num = *mi;
-	
-	retcode = exec_jmp(stack, mi);
+	retcode = exec_jmp(ctx, stack, mi, checked);
 	if (retcode != 0) {
 		return wrap_return(C_CALL, retcode & 0xFF);
 	}
 
-	stack_push(stack, &num);	
+	vmstack_push(stack, num);
 	return 0;
 }
 
+#ifdef CVM_KERNEL_IAPPEND
+	// exec jmp instruction with save current position and size
+	// of stack in new frame, values pushed by caller before address
+	// are at -1, -2, ... of frame
+	VM_INLINE int exec_fcal(cvm_ctx_t *ctx, vmstack_t *stack, int32_t num, int32_t *mi, int checked) {
+		vmmemory_t *memory;
+		int retcode;
+
+		retcode = exec_jmp(ctx, stack, mi, checked);
+		if (retcode != 0) {
+			return wrap_return(C_FCAL, retcode & 0xFF);
+		}
+
+		memory = stack->memory;
+		if (stack->depth == memory->capframes && vmframes_grow(memory, stack->depth+1) != 0) {
+			return wrap_return(C_FCAL, 3);
+		}
+
+		memory->frames[stack->depth].ret = num;
+		memory->frames[stack->depth].base = stack->size;
+		stack->depth += 1;
+		stack->frame = stack->size;
+		return 0;
+	}
+
+	// jump to return address of the last frame, values of
+	// stack are left to caller
+	VM_INLINE int exec_ret(vmstack_t *stack, int32_t *mi) {
+		vmframe_t *frames;
+
+		if (stack->depth == 0) {
+			return wrap_return(C_RET, 1);
+		}
+
+		frames = stack->memory->frames;
+		stack->depth -= 1;
+		*mi = frames[stack->depth].ret;
+		stack->frame = (stack->depth > 0) ? frames[stack->depth-1].base : 0;
+		return 0;
+	}
+
+	// load value in stack by address relative to frame
+	// where address is last value in stack
+	VM_INLINE int exec_fld(vmstack_t *stack) {
+		int32_t num;
+
+		if (stack->size == 0) {
+			return wrap_return(C_FLD, 1);
+		}
+
+		num = vmstack_pop(stack);
+		if (num < -stack->frame) {
+			return wrap_return(C_FLD, 2);
+		}
+		if (num >= stack->size - stack->frame) {
+			return wrap_return(C_FLD, 3);
+		}
+
+		num = stack->base[stack->frame + num];
+		vmstack_push(stack, num);
+
+		return 0;
+	}
+
+	// store value in stack by two addresses relative to frame
+	// where first address = in, second address = out
+	VM_INLINE int exec_fst(vmstack_t *stack) {
+		int32_t num1, num2;
+
+		if (stack->size < 2) {
+			return wrap_return(C_FST, 1);
+		}
+
+		num1 = vmstack_pop(stack);
+		num2 = vmstack_pop(stack);
+
+		if (num1 < -stack->frame) {
+			return wrap_return(C_FST, 2);
+		}
+		if (num1 >= stack->size - stack->frame) {
+			return wrap_return(C_FST, 3);
+		}
+		if (num2 < -stack->frame) {
+			return wrap_return(C_FST, 4);
+		}
+		if (num2 >= stack->size - stack->frame) {
+			return wrap_return(C_FST, 5);
+		}
+
+		num2 = stack->base[stack->frame + num2];
+		vmstack_set(stack, stack->frame + num1, num2);
+
+		return 0;
+	}
+#endif
+
 // return (x[0] || x[1] || x[2] || x[3])
 static uint32_t join_8bits_to_32bits(uint8_t *bytes) {
 	uint32_t num;
 
+	num = 0;
 	for (uint8_t *ptr = bytes; ptr < bytes + 4; ++ptr) {
 		num = (num << 8) | *ptr;
 	}
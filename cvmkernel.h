@@ -7,13 +7,144 @@
 // Comment this line if you are need use only main inctructions.
 #define CVM_KERNEL_IAPPEND
 
-// Memory settings.
+// Comment this line if you are need use switch dispatch in cvm_run
+// instead of threaded dispatch (computed goto, GCC and Clang only).
+#define CVM_KERNEL_THREADED
+
+// Comment this line if you are need only interpretation in cvm_run
+// instead of translation of loaded code to x86-64 (x86-64 hosts only).
+#define CVM_KERNEL_JIT
+
+// Comment this line if you are need cvm_run_batch without
+// pool of threads (POSIX threads only).
+#define CVM_KERNEL_THREADS
+
+// Uncomment this line if you are need profiler of cvm_run (cvm profile),
+// without it the profiler is not compiled.
+// #define CVM_KERNEL_PROFILE
+
+// Comment this line if you are need cvm_load_file to read file
+// into memory instead of mapping it (POSIX only).
+#define CVM_KERNEL_MMAP
+
+// Memory settings: default limits of context, cvm_ctx_limits
+// changes them up to CVM_KERNEL_LIMIT. Code memory is allocated for
+// loaded program, stack grows on demand up to its limit.
 #define CVM_KERNEL_SMEMORY (1 << 10) // Stack = 1024 INT32
 #define CVM_KERNEL_CMEMORY (4 << 10) // Code  = 4096 BYTE
+#define CVM_KERNEL_LIMIT   (1 << 28)
+
+// Superinstructions made by cvm_ctx_load.
+enum {
+	CVM_FUSE_LOAD,  // push; load
+	CVM_FUSE_STOR,  // push; push; stor
+	CVM_FUSE_STORP, // push; push; stor; pop
+	CVM_FUSE_JMP,   // push; jmp
+	CVM_FUSE_CALL,  // push; call
+	CVM_FUSE_JCC,   // push; jg|je|jl|jne|jle|jge
+	CVM_FUSE_FCAL,  // push; fcal
+	CVM_FUSE_COUNT,
+};
+
+// Function of C code made by cvm_ctx_aot, it works as cvm_run.
+#define CVM_AOT_SYMBOL "cvm_aot_run"
+
+// Results of cvm_run_for, cvm_run_until and cvm_resume: program stopped
+// and can be continued by cvm_resume, or there is no program to continue.
+#define CVM_YIELD 1
+#define CVM_IDLE  2
+
+// Virtual machine context. Each context owns its code memory
+// and stack, so different contexts can be used from different threads.
+typedef struct cvm_ctx_t cvm_ctx_t;
+
+#ifdef CVM_KERNEL_PROFILE
+// Function called by program: frames[0] is program itself,
+// other frames are calls of function at addr from frame parent.
+typedef struct cvm_frame_t {
+	int32_t addr;
+	int32_t parent;
+	int32_t child;   // first frame called from it or -1
+	int32_t next;    // next frame of the same parent or -1
+	uint64_t count;  // instructions done in frame itself
+} cvm_frame_t;
+
+// Event of trace of cvm_ctx_trace: function at addr is entered
+// (enter = 1) or left at time in ns from start of program.
+typedef struct cvm_event_t {
+	int32_t addr;
+	int32_t enter;
+	uint64_t time;
+} cvm_event_t;
+
+// Profile of cvm_ctx_profile. Superinstructions have their own
+// handlers (see cvm_opcode_name), but insns and addrs count
+// every instruction of them.
+typedef struct cvm_profile_t {
+	uint64_t insns[256];  // instructions by opcode
+	uint64_t execs[256];  // runs of handlers by code
+	uint64_t ticks[256];  // time of handlers by code
+	int tsc;              // time is in cycles of rdtsc, else in ns
+	uint64_t *addrs;      // instructions by byte of code, size+1 bytes
+	int32_t size;
+	cvm_frame_t *frames;
+	int32_t nframes;
+	cvm_event_t *events;  // events of cvm_ctx_trace or NULL
+	int32_t nevents;
+} cvm_profile_t;
+#endif
 
 // Interface functions.
 extern int cvm_compile(FILE *output, FILE *input);
+extern int cvm_compile_opt(FILE *output, FILE *input);
+extern int cvm_compile_debug(FILE *output, FILE *input, int optimize);
+extern int cvm_compile_mem(const char *src, size_t len, uint8_t **output, size_t *outlen);
+extern int cvm_limits(int32_t cmemory, int32_t smemory);
 extern int cvm_load(uint8_t *memory, int32_t msize);
+extern int cvm_load_file(const char *filename);
+extern int32_t cvm_symbol(const char *name);
+extern int32_t cvm_label(int32_t mi, char *name, size_t size);
+extern int32_t cvm_line(int32_t mi);
 extern int cvm_run(int32_t **output, int32_t *input);
+extern int cvm_run_buf(int32_t *output, int32_t cap, int32_t *input);
+extern int cvm_run_for(int32_t **output, int32_t *input, int64_t max);
+extern int cvm_resume(int32_t **output, int64_t max);
+extern int cvm_run_until(int32_t **output, int32_t *input, int32_t mi);
+extern int cvm_snapshot(FILE *output);
+extern int cvm_restore(uint8_t *memory, size_t msize, int32_t *input);
+extern int cvm_restore_file(const char *filename, int32_t *input);
+extern int cvm_run_batch(int32_t **outputs, int32_t **inputs, int32_t *retcodes, int32_t n, int threads);
+
+// Context functions.
+extern cvm_ctx_t *cvm_ctx_new(void);
+extern void cvm_ctx_free(cvm_ctx_t *ctx);
+extern int cvm_ctx_limits(cvm_ctx_t *ctx, int32_t cmemory, int32_t smemory);
+extern int cvm_ctx_load(cvm_ctx_t *ctx, uint8_t *memory, int32_t msize);
+extern int cvm_ctx_load_file(cvm_ctx_t *ctx, const char *filename);
+extern int32_t cvm_ctx_symbol(cvm_ctx_t *ctx, const char *name);
+extern int32_t cvm_ctx_label(cvm_ctx_t *ctx, int32_t mi, char *name, size_t size);
+extern int32_t cvm_ctx_line(cvm_ctx_t *ctx, int32_t mi);
+extern int cvm_ctx_run(cvm_ctx_t *ctx, int32_t **output, int32_t *input);
+extern int cvm_ctx_run_buf(cvm_ctx_t *ctx, int32_t *output, int32_t cap, int32_t *input);
+extern int cvm_ctx_run_for(cvm_ctx_t *ctx, int32_t **output, int32_t *input, int64_t max);
+extern int cvm_ctx_resume(cvm_ctx_t *ctx, int32_t **output, int64_t max);
+extern int cvm_ctx_run_until(cvm_ctx_t *ctx, int32_t **output, int32_t *input, int32_t mi);
+extern int cvm_ctx_snapshot(cvm_ctx_t *ctx, FILE *output);
+extern int cvm_ctx_restore(cvm_ctx_t *ctx, uint8_t *memory, size_t msize, int32_t *input);
+extern int cvm_ctx_restore_file(cvm_ctx_t *ctx, const char *filename, int32_t *input);
+extern int cvm_ctx_run_batch(cvm_ctx_t *ctx, int32_t **outputs, int32_t **inputs, int32_t *retcodes, int32_t n, int threads);
+extern void cvm_ctx_fused(cvm_ctx_t *ctx, int32_t fused[CVM_FUSE_COUNT]);
+extern int cvm_ctx_verified(cvm_ctx_t *ctx, int32_t *minargs, int32_t *maxdepth);
+extern int cvm_ctx_aot(cvm_ctx_t *ctx, FILE *output);
+
+#ifdef CVM_KERNEL_PROFILE
+// Profiler functions.
+extern int cvm_profile(cvm_profile_t *profile, int32_t **output, int32_t *input);
+extern int cvm_trace(cvm_profile_t *profile, int32_t **output, int32_t *input);
+extern int cvm_ctx_profile(cvm_ctx_t *ctx, cvm_profile_t *profile, int32_t **output, int32_t *input);
+extern int cvm_ctx_trace(cvm_ctx_t *ctx, cvm_profile_t *profile, int32_t **output, int32_t *input);
+extern void cvm_profile_free(cvm_profile_t *profile);
+extern const char *cvm_opcode_name(uint8_t opcode);
+#endif
 
 #endif /* CVM_KERNEL_H */ 
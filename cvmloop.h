@@ -0,0 +1,301 @@
+// Interpreter loop of cvm_ctx_run, included by cvmkernel.c
+// once for every mode of execution:
+//   VM_LOOP    - name of function
+//   VM_CHECKED - 0 if instructions can skip checks of stack and
+//                jumps (program was proven by verifier of cvm_ctx_load)
+//   VM_FUEL    - 1 if program stops after fuel->left instructions or
+//                before fuel->stop, then it returns CVM_YIELD and byte of
+//                next instruction in fuel->mi (superinstructions are split
+//                when fewer instructions are left)
+//   VM_PROFILE - 1 if every instruction is counted by profiler ctx->profile
+
+static int VM_LOOP(cvm_ctx_t *ctx, vmstack_t *vmstack, int32_t mi, vmfuel_t *fuel) {
+#ifdef CVM_KERNEL_THREADED
+	static const void *dispatch[256] = {
+		[0 ... 255] = &&L_DEFAULT,
+	#ifdef CVM_KERNEL_IAPPEND
+		[C_ADD]  = &&L_C_ADD,  [C_SUB]  = &&L_C_SUB,
+		[C_MUL]  = &&L_C_MUL,  [C_DIV]  = &&L_C_DIV,
+		[C_MOD]  = &&L_C_MOD,  [C_SHR]  = &&L_C_SHR,
+		[C_SHL]  = &&L_C_SHL,  [C_XOR]  = &&L_C_XOR,
+		[C_AND]  = &&L_C_AND,  [C_OR]   = &&L_C_OR,
+		[C_NOT]  = &&L_C_NOT,  [C_ALLC] = &&L_C_ALLC,
+		[C_JE]   = &&L_C_JE,   [C_JL]   = &&L_C_JL,
+		[C_JNE]  = &&L_C_JNE,  [C_JLE]  = &&L_C_JLE,
+		[C_JGE]  = &&L_C_JGE,  [C_FCAL] = &&L_C_FCAL,
+		[C_RET]  = &&L_C_RET,  [C_FLD]  = &&L_C_FLD,
+		[C_FST]  = &&L_C_FST,
+	#endif
+		[C_PUSH] = &&L_C_PUSH, [C_POP]  = &&L_C_POP,
+		[C_INC]  = &&L_C_INC,  [C_DEC]  = &&L_C_DEC,
+		[C_JMP]  = &&L_C_JMP,  [C_JG]   = &&L_C_JG,
+		[C_STOR] = &&L_C_STOR, [C_LOAD] = &&L_C_LOAD,
+		[C_CALL] = &&L_C_CALL, [C_HLT]  = &&L_C_HLT,
+		[C_SYNC] = &&L_C_SYNC,
+		[C_PLOD] = &&L_C_PLOD, [C_PSTR] = &&L_C_PSTR,
+		[C_PSTP] = &&L_C_PSTP, [C_PJMP] = &&L_C_PJMP,
+		[C_PCAL] = &&L_C_PCAL, [C_PJG]  = &&L_C_PJG,
+	#ifdef CVM_KERNEL_IAPPEND
+		[C_PJE]  = &&L_C_PJE,  [C_PJL]  = &&L_C_PJL,
+		[C_PJNE] = &&L_C_PJNE, [C_PJLE] = &&L_C_PJLE,
+		[C_PJGE] = &&L_C_PJGE, [C_PFCL] = &&L_C_PFCL,
+	#endif
+	};
+#endif
+	cvm_insn_t scratch[CVM_KERNEL_DECODE+2];
+	const cvm_insn_t *ip;
+	const cvm_insn_t *stop;
+	vmstack_t local, *stack;
+	int64_t left;
+	int32_t split;
+	int retcode;
+
+	// local copy of stack is not aliased by stack memory
+	local = *vmstack;
+	stack = &local;
+	left = VM_FUEL ? fuel->left : 0;
+	stop = VM_FUEL ? fuel->stop : NULL;
+
+	// start at byte mi
+	ip = (mi < ctx->cmused) ? insn_at(ctx, scratch, mi) : ctx->code + ctx->ncode;
+	retcode = 0;
+	VM_SPLIT();
+	VM_PROBE();
+
+#ifdef CVM_KERNEL_THREADED
+	VM_DISPATCH();
+	{
+#else
+vm_switch:
+	switch(ip->opcode) {
+#endif
+	#ifdef CVM_KERNEL_IAPPEND
+		VM_TARGET(C_ADD)
+			VM_CHECK(exec_binop(stack, C_ADD, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_SUB)
+			VM_CHECK(exec_binop(stack, C_SUB, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_MUL)
+			VM_CHECK(exec_binop(stack, C_MUL, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_DIV)
+			VM_CHECK(exec_binop(stack, C_DIV, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_MOD)
+			VM_CHECK(exec_binop(stack, C_MOD, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_SHR)
+			VM_CHECK(exec_binop(stack, C_SHR, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_SHL)
+			VM_CHECK(exec_binop(stack, C_SHL, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_XOR)
+			VM_CHECK(exec_binop(stack, C_XOR, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_AND)
+			VM_CHECK(exec_binop(stack, C_AND, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_OR)
+			VM_CHECK(exec_binop(stack, C_OR, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_NOT)
+			VM_CHECK(exec_not(stack, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_ALLC)
+			VM_CHECK(exec_allc(stack, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_JE)
+			mi = -1;
+			VM_CHECK(exec_jmpif(ctx, stack, C_JE, &mi, VM_CHECKED));
+		VM_JUMP(mi, 1);
+		VM_TARGET(C_JL)
+			mi = -1;
+			VM_CHECK(exec_jmpif(ctx, stack, C_JL, &mi, VM_CHECKED));
+		VM_JUMP(mi, 1);
+		VM_TARGET(C_JNE)
+			mi = -1;
+			VM_CHECK(exec_jmpif(ctx, stack, C_JNE, &mi, VM_CHECKED));
+		VM_JUMP(mi, 1);
+		VM_TARGET(C_JLE)
+			mi = -1;
+			VM_CHECK(exec_jmpif(ctx, stack, C_JLE, &mi, VM_CHECKED));
+		VM_JUMP(mi, 1);
+		VM_TARGET(C_JGE)
+			mi = -1;
+			VM_CHECK(exec_jmpif(ctx, stack, C_JGE, &mi, VM_CHECKED));
+		VM_JUMP(mi, 1);
+		VM_TARGET(C_FCAL)
+			VM_FRAME();
+			VM_CHECK(exec_fcal(ctx, stack, ip->arg, &mi, VM_CHECKED));
+		VM_JUMP(mi, 1);
+		VM_TARGET(C_RET)
+			VM_CHECK(exec_ret(stack, &mi));
+			if (mi >= ctx->cmused) {
+				goto vm_end;
+			}
+		VM_JUMP(mi, 1);
+		VM_TARGET(C_FLD)
+			VM_CHECK(exec_fld(stack));
+		VM_NEXT(1);
+		VM_TARGET(C_FST)
+			VM_CHECK(exec_fst(stack));
+		VM_NEXT(1);
+	#endif
+		VM_TARGET(C_JG)
+			mi = -1;
+			VM_CHECK(exec_jmpif(ctx, stack, C_JG, &mi, VM_CHECKED));
+		VM_JUMP(mi, 1);
+		VM_TARGET(C_JMP)
+			VM_CHECK(exec_jmp(ctx, stack, &mi, VM_CHECKED));
+		VM_JUMP(mi, 1);
+		VM_TARGET(C_CALL)
+			VM_CHECK(exec_call(ctx, stack, ip->arg, &mi, VM_CHECKED));
+		VM_JUMP(mi, 1);
+		VM_TARGET(C_PUSH)
+			VM_CHECK(exec_push(stack, ip->arg, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_POP)
+			VM_CHECK(exec_pop(stack, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_INC)
+			VM_CHECK(exec_incdec(stack, C_INC, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_DEC)
+			VM_CHECK(exec_incdec(stack, C_DEC, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_STOR)
+			VM_CHECK(exec_stor(stack, VM_CHECKED));
+		VM_NEXT(1);
+		VM_TARGET(C_LOAD)
+			VM_CHECK(exec_load(stack, VM_CHECKED));
+		VM_NEXT(1);
+		// superinstructions = push + next instructions
+		VM_TARGET(C_PLOD)
+			VM_CHECK(exec_push(stack, ip->arg, VM_CHECKED));
+			VM_CHECK(exec_load(stack, VM_CHECKED));
+		VM_NEXT(2);
+		VM_TARGET(C_PSTR)
+			VM_CHECK(exec_push(stack, ip[0].arg, VM_CHECKED));
+			VM_CHECK(exec_push(stack, ip[1].arg, VM_CHECKED));
+			VM_CHECK(exec_stor(stack, VM_CHECKED));
+		VM_NEXT(3);
+		VM_TARGET(C_PSTP)
+			VM_CHECK(exec_push(stack, ip[0].arg, VM_CHECKED));
+			VM_CHECK(exec_push(stack, ip[1].arg, VM_CHECKED));
+			VM_CHECK(exec_stor(stack, VM_CHECKED));
+			VM_CHECK(exec_pop(stack, VM_CHECKED));
+		VM_NEXT(4);
+		VM_TARGET(C_PJMP)
+			VM_CHECK(exec_push(stack, ip->arg, VM_CHECKED));
+			VM_CHECK(exec_jmp(ctx, stack, &mi, VM_CHECKED));
+		VM_JUMP(mi, 2);
+		VM_TARGET(C_PCAL)
+			VM_CHECK(exec_push(stack, ip[0].arg, VM_CHECKED));
+			VM_CHECK(exec_call(ctx, stack, ip[1].arg, &mi, VM_CHECKED));
+		VM_JUMP(mi, 2);
+	#ifdef CVM_KERNEL_IAPPEND
+		VM_TARGET(C_PJE)
+			mi = -1;
+			VM_CHECK(exec_push(stack, ip->arg, VM_CHECKED));
+			VM_CHECK(exec_jmpif(ctx, stack, C_JE, &mi, VM_CHECKED));
+		VM_JUMP(mi, 2);
+		VM_TARGET(C_PJL)
+			mi = -1;
+			VM_CHECK(exec_push(stack, ip->arg, VM_CHECKED));
+			VM_CHECK(exec_jmpif(ctx, stack, C_JL, &mi, VM_CHECKED));
+		VM_JUMP(mi, 2);
+		VM_TARGET(C_PJNE)
+			mi = -1;
+			VM_CHECK(exec_push(stack, ip->arg, VM_CHECKED));
+			VM_CHECK(exec_jmpif(ctx, stack, C_JNE, &mi, VM_CHECKED));
+		VM_JUMP(mi, 2);
+		VM_TARGET(C_PJLE)
+			mi = -1;
+			VM_CHECK(exec_push(stack, ip->arg, VM_CHECKED));
+			VM_CHECK(exec_jmpif(ctx, stack, C_JLE, &mi, VM_CHECKED));
+		VM_JUMP(mi, 2);
+		VM_TARGET(C_PJGE)
+			mi = -1;
+			VM_CHECK(exec_push(stack, ip->arg, VM_CHECKED));
+			VM_CHECK(exec_jmpif(ctx, stack, C_JGE, &mi, VM_CHECKED));
+		VM_JUMP(mi, 2);
+		VM_TARGET(C_PFCL)
+			VM_FRAME();
+			VM_CHECK(exec_push(stack, ip[0].arg, VM_CHECKED));
+			VM_CHECK(exec_fcal(ctx, stack, ip[1].arg, &mi, VM_CHECKED));
+		VM_JUMP(mi, 2);
+	#endif
+		VM_TARGET(C_PJG)
+			mi = -1;
+			VM_CHECK(exec_push(stack, ip->arg, VM_CHECKED));
+			VM_CHECK(exec_jmpif(ctx, stack, C_JG, &mi, VM_CHECKED));
+		VM_JUMP(mi, 2);
+		VM_TARGET(C_SYNC)
+			if (ip->arg >= ctx->cmused) {
+				goto vm_end;
+			}
+		VM_JUMP(ip->arg, 1);
+		VM_TARGET(C_HLT)
+			goto vm_end;
+		VM_DEFAULT
+			retcode = wrap_return(C_UNDF, 1);
+			goto vm_error;
+	}
+
+vm_split:
+	// instructions of superinstruction up to the next instruction of
+	// byte code; compact instruction is run whole only as the first
+	// instruction of run, else program stops before it
+	split = insn_split(ctx, scratch, ip);
+	if (VM_FUEL && split > left && left < fuel->left) {
+		goto vm_yield;
+	}
+	switch(split) {
+		case 1:
+			VM_CHECK(exec_push(stack, ip->arg, VM_CHECKED));
+			VM_NEXT(1);
+		case 3:
+			// compact push; push; stor before pop
+			VM_CHECK(exec_push(stack, ip[0].arg, VM_CHECKED));
+			VM_CHECK(exec_push(stack, ip[1].arg, VM_CHECKED));
+			VM_CHECK(exec_stor(stack, VM_CHECKED));
+			VM_NEXT(3);
+		default:
+			VM_DISPATCH();
+	}
+
+vm_error:
+	return retcode;
+
+vm_yield:
+	if (VM_FUEL) {
+		fuel->left = left;
+		fuel->mi = insn_byte(ctx, scratch, ip);
+		*vmstack = local;
+		return CVM_YIELD;
+	}
+
+vm_end:
+	*vmstack = local;
+	return 0;
+
+#ifdef CVM_KERNEL_IAPPEND
+vm_checked:
+	// verified program continues with checks from instruction ip
+	mi = insn_byte(ctx, scratch, ip);
+	*vmstack = local;
+	if (VM_FUEL) {
+		ctx->runverified = 0;
+		fuel->left = left;
+		return vm_loop_fuel_checked(ctx, vmstack, mi, fuel);
+	}
+	return vm_loop_checked(ctx, vmstack, mi, NULL);
+#endif
+}
+
+#undef VM_LOOP
+#undef VM_CHECKED
+#undef VM_FUEL
+#undef VM_PROFILE
@@ -0,0 +1,1201 @@
+// Tests of virtual machine: examples, programs with frames and
+// generated programs are run by cvm_ctx_run and checked against
+// cvm_ctx_run_for with cvm_ctx_resume, cvm_ctx_run_buf and
+// cvm_ctx_run_batch of the same build (and programs which jump
+// only to labels against their code without -O). Results of
+// cvm_ctx_run are printed, make test compares them between builds
+// (native code, interpreter, switch dispatch) and C code of cvm_ctx_aot.
+// Interface functions are checked by check_* once in every build,
+// they print only failures.
+// $ make test
+// $ ./tests/test [-aot file.c | -so file.so] examples/*.asm
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../cvmkernel.h"
+#include "../typeslib/symtab.h"
+
+#define TEST_PROGRAMS 400    // generated programs
+#define TEST_LINES    30     // lines of generated program at most
+#define TEST_SOURCE   4096   // bytes of generated program at most
+#define TEST_FUEL     100000 // instructions of program for one input at most
+#define TEST_STACK    24     // small limit of stack
+#define TEST_BATCH    40     // inputs of cvm_ctx_run_batch (3 chunks)
+#define TEST_BUF      3      // values of output of cvm_ctx_run_buf
+#define TEST_LABELS   50000  // labels of program of check_symtab
+#define TEST_SNAPSHOT "\tpush 5\n\tadd\n\tpush 3\n\tmul\n\thlt\n"
+#define TEST_PROFILE  "examples/fact10.asm"
+#define TEST_MAIN     "labl start\n\tpush 5\n\tinc\n\thlt\n" // only main instructions
+
+// Program of test: it is run for every input with limit of stack,
+// optimize = 1 if it is compiled by cvm_compile_opt, labels = 1
+// if it jumps only to labels (then -O gives the same results).
+typedef struct test_t {
+	char name[64];
+	char *source;
+	int32_t stack;
+	int optimize;
+	int labels;
+	cvm_ctx_t *ctx;
+} test_t;
+
+// Function of C code of cvm_ctx_aot.
+typedef int (*test_aot_t)(int32_t **output, int32_t *input);
+
+static int32_t test_inputs[][6] = {
+	{0},
+	{2, 3, -1},
+	{4, 1, 2, 3, 4},
+	{5, INT32_MIN, -1, 0, 7, INT32_MAX},
+};
+
+// procedures of fcal, %d is argument
+static const char *test_frames[] = {
+	// fact(n)
+	"\tpush %d\n\tpush fact\n\tfcal\n\thlt\n"
+	"labl fact\n\tpush -1\n\tfld\n\tpush 1\n\tpush rec\n\tjg\n\tpop\n\tpush 1\n\tret\n"
+	"labl rec\n\tpush -1\n\tfld\n\tdec\n\tpush fact\n\tfcal\n\tmul\n\tret\n",
+	// fib(n) with two calls
+	"\tpush %d\n\tpush fib\n\tfcal\n\thlt\n"
+	"labl fib\n\tpush -1\n\tfld\n\tpush 2\n\tpush go\n\tjge\n\tret\n"
+	"labl go\n\tpush -1\n\tfld\n\tdec\n\tpush fib\n\tfcal\n"
+	"\tpush -2\n\tfld\n\tpush 2\n\tsub\n\tpush fib\n\tfcal\n\tadd\n\tret\n",
+	// fst copies value of caller to frame, then calls itself
+	"\tpush 7\n\tpush %d\n\tpush copy\n\tfcal\n\thlt\n"
+	"labl copy\n\tpush -1\n\tfld\n\tpush -2\n\tpush 0\n\tfst\n\tpush 0\n\tfld\n"
+	"\tpush 0\n\tpush done\n\tjle\n\tpush -1\n\tfld\n\tdec\n\tpush copy\n\tfcal\n"
+	"labl done\n\tret\n",
+	// recursion without end
+	"\tpush %d\n\tpush deep\n\tfcal\n\thlt\n"
+	"labl deep\n\tpush 1\n\tpush deep\n\tfcal\n\tret\n",
+	// ret of program and fld out of frame
+	"\tpush %d\n\tpush out\n\tfcal\n\tret\n"
+	"labl out\n\tpush 0\n\tfld\n\tret\n",
+};
+
+// instructions of generated programs without operands
+static const char *test_ops[] = {
+	"pop", "inc", "dec", "add", "sub", "mul", "and", "or", "xor",
+	"not", "load", "allc",
+};
+
+// instructions which stop program or need frame, they are rare
+static const char *test_stops[] = {
+	"hlt", "ret", "fst", "fld",
+};
+
+static const char *test_jumps[] = {
+	"jmp", "jg", "je", "jl", "jne", "jle", "jge", "call", "fcal",
+};
+
+static const int32_t test_values[] = {
+	0, 1, 2, 3, -1, -2, -3, 5, 127, 128, -128, -129,
+	32767, 32768, -32768, 100000, INT32_MAX, INT32_MIN,
+};
+
+// divisors of div and mod (not 0 and -1)
+static const int32_t test_divisors[] = {2, 3, 7, -2, -5};
+
+#define COUNT(a) ((int32_t)(sizeof(a) / sizeof((a)[0])))
+
+static uint32_t test_seed;
+
+static int add_tests(test_t **tests, int32_t *count, char *argv[], int argc);
+static int add_test(test_t **tests, int32_t *count, const char *name, char *source, int labels);
+static char *gen_program(int32_t seed);
+static char *read_source(const char *filename);
+static char *concat(const char *format, ...);
+static uint32_t rnd(void);
+static int load_code(cvm_ctx_t **ctx, const char *source, int32_t stack, int optimize);
+static int compile_stream(const char *source, int optimize, int debug, uint8_t **code, size_t *codelen);
+static int stops(test_t *test);
+static int run_test(test_t *test);
+static int check_test(test_t *test, int32_t input, int retcode, int32_t *output);
+static int check_plain(test_t *test, cvm_ctx_t *plain, int32_t input, int retcode, int32_t *output);
+static int check_batch(test_t *test, int threads);
+static int same(int retcode1, int32_t *output1, int retcode2, int32_t *output2);
+static void print_result(test_t *test, int32_t input, int retcode, int32_t *output);
+static int check_symtab(void);
+static int check_snapshot(void);
+static int check_container(void);
+static int check_limits(void);
+static int check_load_file(void);
+static int write_file(char *filename, uint8_t *data, size_t size);
+#ifdef CVM_KERNEL_PROFILE
+static int check_profile(const char *filename);
+#endif
+static int load_run(cvm_ctx_t *ctx, uint8_t *code, size_t codelen, int32_t *expected);
+static int restore_mem(cvm_ctx_t *ctx, uint8_t *memory, size_t msize, int32_t *input, int32_t *expected);
+static int write_aot(FILE *output, test_t *test, int32_t n);
+static int run_aot(void *handle, test_t *test, int32_t n);
+
+int main(int argc, char *argv[]) {
+	const char *aotf, *sof;
+	test_t *tests;
+	int32_t count, n;
+	FILE *aot;
+	void *handle;
+	int retcode;
+
+	aotf = NULL;
+	sof = NULL;
+	if (argc > 2 && strcmp(argv[1], "-aot") == 0) {
+		aotf = argv[2];
+	} else if (argc > 2 && strcmp(argv[1], "-so") == 0) {
+		sof = argv[2];
+	}
+	if (aotf != NULL || sof != NULL) {
+		argc -= 2;
+		argv += 2;
+	}
+
+	tests = NULL;
+	count = 0;
+	if (add_tests(&tests, &count, argv+1, argc-1) != 0) {
+		fprintf(stderr, "error: make tests\n");
+		return 1;
+	}
+
+	aot = NULL;
+	handle = NULL;
+	if (aotf != NULL) {
+		aot = fopen(aotf, "w");
+		if (aot == NULL) {
+			fprintf(stderr, "error: open %s\n", aotf);
+			return 2;
+		}
+	}
+	if (sof != NULL) {
+		handle = dlopen(sof, RTLD_NOW);
+		if (handle == NULL) {
+			fprintf(stderr, "error: open %s\n", sof);
+			return 2;
+		}
+	}
+
+	// programs which don't stop (or stop by signal) in the
+	// interpreter are skipped by all builds in the same way
+	retcode = 0;
+	n = 0;
+	for (int32_t i = 0; i < count; ++i) {
+		if (load_code(&tests[i].ctx, tests[i].source, tests[i].stack, tests[i].optimize) != 0) {
+			printf("%s: not loaded\n", tests[i].name);
+		} else if (!stops(&tests[i])) {
+			printf("%s: skipped\n", tests[i].name);
+		} else if (aot != NULL) {
+			retcode |= write_aot(aot, &tests[i], n++);
+		} else if (handle != NULL) {
+			retcode |= run_aot(handle, &tests[i], n++);
+		} else {
+			retcode |= run_test(&tests[i]);
+		}
+		cvm_ctx_free(tests[i].ctx);
+		free(tests[i].source);
+	}
+	free(tests);
+
+	if (aot == NULL && handle == NULL) {
+		retcode |= check_symtab();
+		retcode |= check_snapshot();
+		retcode |= check_container();
+		retcode |= check_limits();
+		retcode |= check_load_file();
+	#ifdef CVM_KERNEL_PROFILE
+		retcode |= check_profile(TEST_PROFILE);
+	#endif
+	}
+
+	if (aot != NULL) {
+		fclose(aot);
+	}
+	if (handle != NULL) {
+		dlclose(handle);
+	}
+	return retcode;
+}
+
+// examples given by files, procedures with frames and generated
+// programs, each with default and small limit of stack and by -O
+static int add_tests(test_t **tests, int32_t *count, char *argv[], int argc) {
+	char name[64];
+
+	for (int i = 0; i < argc; ++i) {
+		if (add_test(tests, count, argv[i], read_source(argv[i]), 1) != 0) {
+			return 1;
+		}
+	}
+
+	for (int32_t i = 0; i < COUNT(test_frames); ++i) {
+		for (int32_t arg = 0; arg <= 12; arg += 4) {
+			snprintf(name, sizeof(name), "frames/%d(%d)", i, arg);
+			if (add_test(tests, count, name, concat(test_frames[i], arg), 1) != 0) {
+				return 1;
+			}
+		}
+	}
+
+	for (int32_t seed = 0; seed < TEST_PROGRAMS; ++seed) {
+		snprintf(name, sizeof(name), "gen/%d", seed);
+		if (add_test(tests, count, name, gen_program(seed), 0) != 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// three tests of source: default and small limit of stack,
+// code of -O with default limit
+static int add_test(test_t **tests, int32_t *count, const char *name, char *source, int labels) {
+	test_t *grown, *test;
+	int failed;
+
+	if (source == NULL) {
+		return 1;
+	}
+
+	grown = (test_t*)realloc(*tests, sizeof(test_t)*(*count+3));
+	if (grown == NULL) {
+		free(source);
+		return 1;
+	}
+	*tests = grown;
+
+	failed = 0;
+	for (int i = 0; i < 3; ++i) {
+		test = &grown[*count+i];
+		test->stack = (i == 1) ? TEST_STACK : CVM_KERNEL_SMEMORY;
+		test->optimize = (i == 2);
+		test->labels = labels;
+		snprintf(test->name, sizeof(test->name), "%s%s/%d", name, test->optimize ? "/O" : "", test->stack);
+		test->source = i ? strdup(source) : source;
+		test->ctx = NULL;
+		failed |= (test->source == NULL);
+	}
+
+	*count += 3;
+	return failed;
+}
+
+// random program: values, jumps to labels and to any byte of code
+// (also inside of instructions), procedures and all instructions;
+// div, mod and shifts take constants, as their results for other
+// operands are not defined in C (division by 0, shift by 32)
+static char *gen_program(int32_t seed) {
+	char source[TEST_SOURCE];
+	int32_t lines, labels, at[4];
+	size_t len;
+	int r;
+
+	test_seed = (uint32_t)seed * 2654435761u + 1;
+	lines = 5 + rnd() % TEST_LINES;
+	labels = 1 + rnd() % 4;
+	for (int32_t i = 0; i < labels; ++i) {
+		at[i] = rnd() % (lines+1);
+	}
+
+	len = 0;
+	for (int32_t i = 0; i <= lines; ++i) {
+		for (int32_t k = 0; k < labels; ++k) {
+			if (at[k] == i) {
+				len += snprintf(source + len, sizeof(source) - len, "labl L%d\n", k);
+			}
+		}
+		if (i == lines) {
+			break;
+		}
+
+		r = rnd() % 100;
+		if (r < 30) {
+			len += snprintf(source + len, sizeof(source) - len, "\tpush %d\n",
+				test_values[rnd() % COUNT(test_values)]);
+		} else if (r < 42) {
+			len += snprintf(source + len, sizeof(source) - len, "\tpush L%d\n\t%s\n",
+				rnd() % labels, test_jumps[rnd() % COUNT(test_jumps)]);
+		} else if (r < 44) {
+			len += snprintf(source + len, sizeof(source) - len, "\tpush %d\n\t%s\n",
+				rnd() % 64, test_jumps[rnd() % COUNT(test_jumps)]);
+		} else if (r < 48) {
+			len += snprintf(source + len, sizeof(source) - len, "\tpush %d\n\t%s\n",
+				test_divisors[rnd() % COUNT(test_divisors)], (rnd() % 2) ? "div" : "mod");
+		} else if (r < 51) {
+			len += snprintf(source + len, sizeof(source) - len, "\tpush %d\n\t%s\n",
+				rnd() % 32, (rnd() % 2) ? "shl" : "shr");
+		} else if (r < 56) {
+			len += snprintf(source + len, sizeof(source) - len, "\tpush %d\n\tload\n",
+				(int)(rnd() % 4) - 3);
+		} else if (r < 60) {
+			len += snprintf(source + len, sizeof(source) - len, "\tpush %d\n\tfld\n",
+				(int)(rnd() % 3));
+		} else if (r < 63) {
+			len += snprintf(source + len, sizeof(source) - len, "\tpush %d\n\tpush %d\n\tstor\n",
+				(int)(rnd() % 4) - 3, (int)(rnd() % 4) - 3);
+		} else if (r < 66) {
+			len += snprintf(source + len, sizeof(source) - len, "\t%s\n",
+				test_stops[rnd() % COUNT(test_stops)]);
+		} else {
+			len += snprintf(source + len, sizeof(source) - len, "\t%s\n",
+				test_ops[rnd() % COUNT(test_ops)]);
+		}
+	}
+
+	return strdup(source);
+}
+
+// source of file in memory allocated by malloc
+static char *read_source(const char *filename) {
+	FILE *input;
+	char *source;
+	long size;
+
+	input = fopen(filename, "rb");
+	if (input == NULL) {
+		return NULL;
+	}
+
+	source = NULL;
+	if (fseek(input, 0, SEEK_END) == 0 && (size = ftell(input)) >= 0 && fseek(input, 0, SEEK_SET) == 0) {
+		source = (char*)malloc(size+1);
+		if (source != NULL && fread(source, 1, size, input) != (size_t)size) {
+			free(source);
+			source = NULL;
+		}
+		if (source != NULL) {
+			source[size] = '\0';
+		}
+	}
+
+	fclose(input);
+	return source;
+}
+
+// string made by format in memory allocated by malloc
+static char *concat(const char *format, ...) {
+	va_list args;
+	char *string;
+	int n;
+
+	va_start(args, format);
+	n = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (n < 0) {
+		return NULL;
+	}
+
+	string = (char*)malloc(n+1);
+	if (string == NULL) {
+		return NULL;
+	}
+
+	va_start(args, format);
+	vsnprintf(string, n+1, format, args);
+	va_end(args);
+	return string;
+}
+
+// xorshift, programs are the same on all hosts
+static uint32_t rnd(void) {
+	test_seed ^= test_seed << 13;
+	test_seed ^= test_seed >> 17;
+	test_seed ^= test_seed << 5;
+	return test_seed;
+}
+
+// compile source (by cvm_compile_opt if optimize = 1) and load it
+// to new context *ctx with limit of stack, caller frees *ctx
+static int load_code(cvm_ctx_t **ctx, const char *source, int32_t stack, int optimize) {
+	uint8_t *code;
+	size_t codelen;
+	int retcode;
+
+	*ctx = cvm_ctx_new();
+	if (*ctx == NULL) {
+		return 1;
+	}
+
+	if (optimize) {
+		retcode = compile_stream(source, 1, 0, &code, &codelen);
+	} else {
+		retcode = cvm_compile_mem(source, strlen(source), &code, &codelen);
+	}
+	if (retcode != 0) {
+		return 1;
+	}
+
+	// limits are changed for loaded program
+	retcode = cvm_ctx_load(*ctx, code, (int32_t)codelen) != 0 ||
+		cvm_ctx_limits(*ctx, CVM_KERNEL_CMEMORY, stack) != 0;
+	free(code);
+	return retcode;
+}
+
+// cvm_compile (cvm_compile_opt if optimize = 1, cvm_compile_debug
+// if debug = 1) of source in memory, *code is allocated by malloc
+static int compile_stream(const char *source, int optimize, int debug, uint8_t **code, size_t *codelen) {
+	FILE *input, *output;
+	char *bytes;
+	size_t size;
+	int retcode;
+
+	input = fmemopen((void*)source, strlen(source), "r");
+	if (input == NULL) {
+		return 1;
+	}
+	output = open_memstream(&bytes, &size);
+	if (output == NULL) {
+		fclose(input);
+		return 1;
+	}
+
+	if (debug) {
+		retcode = cvm_compile_debug(output, input, optimize);
+	} else if (optimize) {
+		retcode = cvm_compile_opt(output, input);
+	} else {
+		retcode = cvm_compile(output, input);
+	}
+	fclose(input);
+	fclose(output);
+	if (retcode != 0) {
+		free(bytes);
+		return retcode;
+	}
+
+	*code = (uint8_t*)bytes;
+	*codelen = size;
+	return 0;
+}
+
+// program stops for all inputs in TEST_FUEL instructions,
+// it is run in child process as it may stop by signal
+static int stops(test_t *test) {
+	int32_t *output;
+	pid_t pid;
+	int status, retcode;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		return 0;
+	}
+
+	if (pid == 0) {
+		for (int32_t i = 0; i < COUNT(test_inputs); ++i) {
+			retcode = cvm_ctx_run_for(test->ctx, &output, test_inputs[i], TEST_FUEL);
+			if (retcode == CVM_YIELD) {
+				_exit(1);
+			}
+			if (retcode == 0) {
+				free(output);
+			}
+		}
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) != pid) {
+		return 0;
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// cvm_ctx_run for every input, other ways of run must give the same
+static int run_test(test_t *test) {
+	cvm_ctx_t *plain;
+	int32_t *output;
+	int retcode, failed;
+
+	failed = 0;
+	plain = NULL;
+	if (test->optimize && test->labels && load_code(&plain, test->source, test->stack, 0) != 0) {
+		fprintf(stderr, "%s: not loaded without -O\n", test->name);
+		failed = 1;
+	}
+
+	for (int32_t i = 0; i < COUNT(test_inputs); ++i) {
+		output = NULL;
+		retcode = cvm_ctx_run(test->ctx, &output, test_inputs[i]);
+		print_result(test, i, retcode, output);
+		failed |= check_test(test, i, retcode, output);
+		if (plain != NULL && !failed) {
+			failed |= check_plain(test, plain, i, retcode, output);
+		}
+		if (retcode == 0) {
+			free(output);
+		}
+	}
+	if (plain != NULL) {
+		cvm_ctx_free(plain);
+	}
+
+	failed |= check_batch(test, 1);
+	failed |= check_batch(test, 4);
+	return failed;
+}
+
+// cvm_ctx_run_for with cvm_ctx_resume by 1 and 7 instructions
+// and cvm_ctx_run_buf give result of cvm_ctx_run; every run which
+// yields has done max instructions, so runs by 1 instruction give
+// number of instructions n and there are n/7+1 runs by 7
+static int check_test(test_t *test, int32_t input, int retcode, int32_t *output) {
+	int32_t buf[TEST_BUF+1], *result;
+	int64_t runs[8];
+	int code, match, failed;
+
+	failed = 0;
+	for (int64_t max = 1; max <= 7; max += 6) {
+		result = NULL;
+		runs[max] = 1;
+		code = cvm_ctx_run_for(test->ctx, &result, test_inputs[input], max);
+		while (code == CVM_YIELD) {
+			runs[max] += 1;
+			code = cvm_ctx_resume(test->ctx, &result, max);
+		}
+		if (!same(retcode, output, code, result)) {
+			fprintf(stderr, "%s %d: cvm_ctx_run_for(%d) gives %04x\n", test->name, input, (int)max, code);
+			failed = 1;
+		}
+		if (code == 0) {
+			free(result);
+		}
+	}
+	// compact instructions of -O are not split
+	if (!test->optimize && runs[7] != (runs[1]-1)/7 + 1) {
+		fprintf(stderr, "%s %d: %d runs by 1 and %d runs by 7 instructions\n",
+			test->name, input, (int)runs[1], (int)runs[7]);
+		failed = 1;
+	}
+
+	code = cvm_ctx_run_buf(test->ctx, buf, TEST_BUF, test_inputs[input]);
+	if (code == 0 && retcode == 0) {
+		match = (buf[0] == output[0]);
+		for (int32_t i = 1; i <= buf[0] && i <= TEST_BUF; ++i) {
+			match &= (buf[i] == output[i]);
+		}
+	} else {
+		match = (code == retcode);
+	}
+	if (!match) {
+		fprintf(stderr, "%s %d: cvm_ctx_run_buf gives %04x\n", test->name, input, code);
+		failed = 1;
+	}
+
+	return failed;
+}
+
+// code of cvm_compile_opt gives result of code without -O
+static int check_plain(test_t *test, cvm_ctx_t *plain, int32_t input, int retcode, int32_t *output) {
+	int32_t *result;
+	int code, failed;
+
+	result = NULL;
+	code = cvm_ctx_run(plain, &result, test_inputs[input]);
+	failed = !same(retcode, output, code, result);
+	if (failed) {
+		fprintf(stderr, "%s %d: code without -O gives %04x\n", test->name, input, code);
+	}
+	if (code == 0) {
+		free(result);
+	}
+	return failed;
+}
+
+// cvm_ctx_run_batch of all inputs by threads gives results of cvm_ctx_run
+static int check_batch(test_t *test, int threads) {
+	int32_t *inputs[TEST_BATCH], *outputs[TEST_BATCH], *output;
+	int32_t retcodes[TEST_BATCH], ninputs;
+	int retcode, failed;
+
+	ninputs = COUNT(test_inputs);
+	for (int32_t i = 0; i < TEST_BATCH; ++i) {
+		inputs[i] = test_inputs[i % ninputs];
+	}
+
+	if (cvm_ctx_run_batch(test->ctx, outputs, inputs, retcodes, TEST_BATCH, threads) != 0) {
+		fprintf(stderr, "%s: cvm_ctx_run_batch fails\n", test->name);
+		return 1;
+	}
+
+	failed = 0;
+	for (int32_t i = 0; i < TEST_BATCH; ++i) {
+		output = NULL;
+		retcode = cvm_ctx_run(test->ctx, &output, inputs[i]);
+		if (!same(retcode, output, retcodes[i], outputs[i])) {
+			fprintf(stderr, "%s %d: cvm_ctx_run_batch(%d) gives %04x\n", test->name, i % ninputs, threads, retcodes[i]);
+			failed = 1;
+		}
+		if (retcode == 0) {
+			free(output);
+		}
+		if (retcodes[i] == 0) {
+			free(outputs[i]);
+		}
+	}
+
+	return failed;
+}
+
+// results are equal: the same error or the same values
+static int same(int retcode1, int32_t *output1, int retcode2, int32_t *output2) {
+	if (retcode1 != retcode2) {
+		return 0;
+	}
+	if (retcode1 != 0) {
+		return 1;
+	}
+	return output1[0] == output2[0] &&
+		memcmp(output1+1, output2+1, sizeof(int32_t)*output1[0]) == 0;
+}
+
+static void print_result(test_t *test, int32_t input, int retcode, int32_t *output) {
+	printf("%s %d: %04x", test->name, input, retcode);
+	if (retcode == 0) {
+		printf(" [");
+		for (int32_t i = 1; i <= output[0]; ++i) {
+			printf(" %d", output[i]);
+		}
+		printf(" ]");
+	}
+	printf("\n");
+}
+
+// symbol table of assembler keeps TEST_LABELS names with common
+// prefixes, program of as many labels defined after their use
+// (blocks in reverse order) runs through all of them
+static int check_symtab(void) {
+	char key[32];
+	symtab_t *symtab;
+	int32_t *output;
+	uint8_t *code;
+	size_t codelen, len, cap;
+	char *source;
+	cvm_ctx_t *ctx;
+	int *value, failed, n;
+
+	failed = 0;
+	symtab = symtab_new(512);
+	for (int i = 0; symtab != NULL && i < TEST_LABELS; ++i) {
+		n = snprintf(key, sizeof(key), "label_%d", i);
+		failed |= symtab_set(symtab, key, n, i) != 0;
+	}
+	for (int i = 0; symtab != NULL && i < TEST_LABELS; ++i) {
+		n = snprintf(key, sizeof(key), "label_%d", i);
+		value = symtab_get(symtab, key, n);
+		failed |= (value == NULL || *value != i);
+	}
+	failed |= (symtab == NULL || symtab_size(symtab) != TEST_LABELS ||
+		symtab_get(symtab, "label_", 6) != NULL ||
+		symtab_get(symtab, "label_1x", 8) != NULL);
+	symtab_free(symtab);
+	if (failed) {
+		fprintf(stderr, "symtab: %d keys are not kept\n", TEST_LABELS);
+		return 1;
+	}
+
+	cap = (size_t)TEST_LABELS * 64;
+	source = (char*)malloc(cap);
+	if (source == NULL) {
+		return 1;
+	}
+	len = (size_t)snprintf(source, cap, "\tpush 0\n\tpush b_0\n\tjmp\n");
+	for (int i = TEST_LABELS-1; i >= 0; --i) {
+		len += (size_t)snprintf(source + len, cap - len,
+			"labl b_%d\n\tinc\n\tpush b_%d\n\tjmp\n", i, i+1);
+	}
+	len += (size_t)snprintf(source + len, cap - len, "labl b_%d\n\thlt\n", TEST_LABELS);
+
+	output = NULL;
+	ctx = cvm_ctx_new();
+	failed = (ctx == NULL || cvm_compile_mem(source, len, &code, &codelen) != 0);
+	if (!failed) {
+		failed = cvm_ctx_limits(ctx, (int32_t)codelen, CVM_KERNEL_SMEMORY) != 0 ||
+			cvm_ctx_load(ctx, code, (int32_t)codelen) != 0 ||
+			cvm_ctx_run(ctx, &output, test_inputs[0]) != 0 ||
+			output[0] != 1 || output[1] != TEST_LABELS;
+		free(code);
+		free(output);
+	}
+	free(source);
+	cvm_ctx_free(ctx);
+
+	if (failed) {
+		fprintf(stderr, "symtab: program of %d labels fails\n", TEST_LABELS);
+	}
+	return failed;
+}
+
+// snapshot of program stopped after push is restored from memory
+// and from file with one and more arguments, snapshots which are
+// truncated or have any changed byte are refused
+static int check_snapshot(void) {
+	int32_t one[] = {1, 10}, more[] = {3, 10, 20, 30};
+	int32_t expected[] = {2, 45, 2}, shifted[] = {4, 150, 10, 5, 2};
+	char filename[] = "/tmp/cvm-snapshot-XXXXXX";
+	cvm_ctx_t *ctx, *restored;
+	int32_t *output;
+	uint8_t *memory;
+	char *bytes;
+	size_t size;
+	FILE *writer;
+	int failed, fd;
+
+	restored = cvm_ctx_new();
+	if (restored == NULL || load_code(&ctx, TEST_SNAPSHOT, CVM_KERNEL_SMEMORY, 0) != 0 ||
+		cvm_ctx_run_for(ctx, &output, (int32_t[]){1, 2}, 1) != CVM_YIELD) {
+		fprintf(stderr, "snapshot: program does not stop\n");
+		cvm_ctx_free(restored);
+		cvm_ctx_free(ctx);
+		return 1;
+	}
+
+	writer = open_memstream(&bytes, &size);
+	failed = (writer == NULL || cvm_ctx_snapshot(ctx, writer) != 0);
+	if (writer != NULL) {
+		fclose(writer);
+	}
+	cvm_ctx_free(ctx);
+	if (failed) {
+		fprintf(stderr, "snapshot: it is not written\n");
+		cvm_ctx_free(restored);
+		return 1;
+	}
+	memory = (uint8_t*)bytes;
+
+	if (restore_mem(restored, memory, size, one, expected) != 0 ||
+		restore_mem(restored, memory, size, more, shifted) != 0) {
+		fprintf(stderr, "snapshot: restored program gives wrong result\n");
+		failed = 1;
+	}
+
+	// version 2 has no checksum
+	memory[4] = 2;
+	if (restore_mem(restored, memory, size - 4, one, expected) != 0) {
+		fprintf(stderr, "snapshot: version 2 is not restored\n");
+		failed = 1;
+	}
+	memory[4] = 3;
+
+	for (size_t i = 0; i < size; ++i) {
+		if (cvm_ctx_restore(restored, memory, i, one) == 0) {
+			fprintf(stderr, "snapshot: truncated to %zu bytes is restored\n", i);
+			failed = 1;
+		}
+		memory[i] ^= 0x10;
+		if (cvm_ctx_restore(restored, memory, size, one) == 0) {
+			fprintf(stderr, "snapshot: changed byte %zu is restored\n", i);
+			failed = 1;
+		}
+		memory[i] ^= 0x10;
+	}
+
+	fd = mkstemp(filename);
+	if (fd < 0 || write(fd, memory, size) != (ssize_t)size) {
+		fprintf(stderr, "snapshot: file is not written\n");
+		failed = 1;
+	} else {
+		output = NULL;
+		if (cvm_ctx_restore_file(restored, filename, one) != 0 ||
+			cvm_ctx_resume(restored, &output, TEST_FUEL) != 0 ||
+			!same(0, output, 0, expected)) {
+			fprintf(stderr, "snapshot: file is not restored\n");
+			failed = 1;
+		}
+		free(output);
+	}
+	if (fd >= 0) {
+		close(fd);
+		unlink(filename);
+	}
+	if (cvm_ctx_restore_file(restored, filename, one) != 2) {
+		fprintf(stderr, "snapshot: missing file is restored\n");
+		failed = 1;
+	}
+
+	free(memory);
+	cvm_ctx_free(restored);
+	return failed;
+}
+
+// restore snapshot and resume it with result expected
+static int restore_mem(cvm_ctx_t *ctx, uint8_t *memory, size_t msize, int32_t *input, int32_t *expected) {
+	int32_t *output;
+	int retcode;
+
+	output = NULL;
+	retcode = cvm_ctx_restore(ctx, memory, msize, input);
+	if (retcode == 0) {
+		retcode = cvm_ctx_resume(ctx, &output, TEST_FUEL);
+	}
+	retcode = (retcode != 0 || !same(0, output, 0, expected));
+	free(output);
+	return retcode;
+}
+
+// container of plain build has no symbols and lines, of debug build
+// has them, both give result of byte code without container; flag
+// of additional instructions is set only for code with them, a
+// container with any changed byte after magic or truncated is refused
+static int check_container(void) {
+	int32_t expected[] = {2, 6, 2}, appended[] = {1, 21};
+	uint8_t *raw, *plain, *debug, *append;
+	size_t rawlen, plainlen, debuglen, appendlen;
+	cvm_ctx_t *ctx;
+	int failed;
+
+	ctx = cvm_ctx_new();
+	if (ctx == NULL || cvm_compile_mem(TEST_MAIN, strlen(TEST_MAIN), &raw, &rawlen) != 0) {
+		fprintf(stderr, "container: code is not compiled\n");
+		cvm_ctx_free(ctx);
+		return 1;
+	}
+	if (compile_stream(TEST_MAIN, 0, 0, &plain, &plainlen) != 0) {
+		plain = NULL;
+	}
+	if (compile_stream(TEST_MAIN, 0, 1, &debug, &debuglen) != 0) {
+		debug = NULL;
+	}
+	if (compile_stream(TEST_SNAPSHOT, 0, 0, &append, &appendlen) != 0) {
+		append = NULL;
+	}
+
+	failed = 0;
+	if (plain == NULL || debug == NULL || append == NULL) {
+		fprintf(stderr, "container: code is not compiled\n");
+		failed = 1;
+	}
+
+	if (!failed) {
+		if (load_run(ctx, raw, rawlen, expected) != 0 ||
+			cvm_ctx_symbol(ctx, "start") != -1) {
+			fprintf(stderr, "container: byte code without container fails\n");
+			failed = 1;
+		}
+		if (load_run(ctx, plain, plainlen, expected) != 0 ||
+			cvm_ctx_symbol(ctx, "start") != -1 || cvm_ctx_line(ctx, 0) != -1) {
+			fprintf(stderr, "container: plain build fails or has symbols\n");
+			failed = 1;
+		}
+		if (load_run(ctx, debug, debuglen, expected) != 0 ||
+			cvm_ctx_symbol(ctx, "start") != 0 || cvm_ctx_line(ctx, 0) != 2) {
+			fprintf(stderr, "container: debug build fails or has no symbols\n");
+			failed = 1;
+		}
+		if (plain[5] != 0 || append[5] != 0x01) {
+			fprintf(stderr, "container: wrong flags %02x and %02x\n", plain[5], append[5]);
+			failed = 1;
+		}
+	#ifdef CVM_KERNEL_IAPPEND
+		if (load_run(ctx, append, appendlen, appended) != 0) {
+	#else
+		if (cvm_ctx_load(ctx, append, (int32_t)appendlen) == 0) {
+	#endif
+			fprintf(stderr, "container: flag of additional instructions is not kept\n");
+			failed = 1;
+		}
+	}
+
+	for (size_t i = 4; !failed && i < plainlen; ++i) {
+		if (cvm_ctx_load(ctx, plain, (int32_t)i) == 0) {
+			fprintf(stderr, "container: truncated to %zu bytes is loaded\n", i);
+			failed = 1;
+		}
+		plain[i] ^= 0x10;
+		if (cvm_ctx_load(ctx, plain, (int32_t)plainlen) == 0) {
+			fprintf(stderr, "container: changed byte %zu is loaded\n", i);
+			failed = 1;
+		}
+		plain[i] ^= 0x10;
+	}
+
+	free(raw);
+	free(plain);
+	free(debug);
+	free(append);
+	cvm_ctx_free(ctx);
+	return failed;
+}
+
+// limits of context: wrong values are refused, loaded program stays
+static int check_limits(void) {
+	int32_t expected[] = {2, 6, 2};
+	int32_t *output;
+	uint8_t *code;
+	size_t codelen;
+	cvm_ctx_t *ctx;
+	int failed;
+
+	ctx = cvm_ctx_new();
+	if (ctx == NULL || compile_stream(TEST_MAIN, 0, 0, &code, &codelen) != 0) {
+		fprintf(stderr, "limits: code is not compiled\n");
+		cvm_ctx_free(ctx);
+		return 1;
+	}
+
+	failed = 0;
+	if (load_run(ctx, code, codelen, expected) != 0) {
+		fprintf(stderr, "limits: code is not loaded\n");
+		failed = 1;
+	}
+	if (!failed && (cvm_ctx_limits(ctx, 0, 1024) == 0 ||
+		cvm_ctx_limits(ctx, 1024, -1) == 0 ||
+		cvm_ctx_limits(ctx, CVM_KERNEL_LIMIT+1, 1024) == 0 ||
+		cvm_ctx_limits(ctx, 1024, CVM_KERNEL_LIMIT+1) == 0 ||
+		cvm_ctx_limits(ctx, 1, 1024) == 0)) {
+		fprintf(stderr, "limits: wrong limits are set\n");
+		failed = 1;
+	}
+
+	// program stays after refused and after set limits
+	output = NULL;
+	if (!failed && (cvm_ctx_run(ctx, &output, (int32_t[]){1, 2}) != 0 || !same(0, output, 0, expected))) {
+		fprintf(stderr, "limits: program is lost by wrong limits\n");
+		failed = 1;
+	}
+	free(output);
+	output = NULL;
+	if (!failed && (cvm_ctx_limits(ctx, 1024, 1) != 0 || cvm_ctx_run(ctx, &output, (int32_t[]){1, 2}) == 0)) {
+		fprintf(stderr, "limits: stack of 1 value does not overflow\n");
+		failed = 1;
+	}
+	free(output);
+	output = NULL;
+	if (!failed && (cvm_ctx_limits(ctx, 1024, 1024) != 0 || cvm_ctx_run(ctx, &output, (int32_t[]){1, 2}) != 0 || !same(0, output, 0, expected))) {
+		fprintf(stderr, "limits: program is lost by limits\n");
+		failed = 1;
+	}
+	free(output);
+
+	free(code);
+	cvm_ctx_free(ctx);
+	return failed;
+}
+
+// container of -g build loaded from file runs and has symbols,
+// changed file is refused, missing file gives 2, empty file is loaded
+static int check_load_file(void) {
+	int32_t expected[] = {2, 6, 2};
+	char filename[] = "/tmp/cvm-load-XXXXXX";
+	int32_t *output;
+	uint8_t *code;
+	size_t codelen;
+	cvm_ctx_t *ctx;
+	int failed;
+
+	ctx = cvm_ctx_new();
+	if (ctx == NULL || compile_stream(TEST_MAIN, 0, 1, &code, &codelen) != 0) {
+		fprintf(stderr, "load file: code is not compiled\n");
+		cvm_ctx_free(ctx);
+		return 1;
+	}
+
+	failed = 0;
+	output = NULL;
+	if (write_file(filename, code, codelen) != 0) {
+		fprintf(stderr, "load file: file is not written\n");
+		failed = 1;
+	} else {
+		if (cvm_ctx_load_file(ctx, filename) != 0 ||
+			cvm_ctx_run(ctx, &output, (int32_t[]){1, 2}) != 0 ||
+			!same(0, output, 0, expected) || cvm_ctx_symbol(ctx, "start") != 0) {
+			fprintf(stderr, "load file: program of file fails\n");
+			failed = 1;
+		}
+		free(output);
+		output = NULL;
+		unlink(filename);
+	}
+
+	code[codelen-1] ^= 0x10;
+	if (!failed && (write_file(filename, code, codelen) != 0 ||
+		cvm_ctx_load_file(ctx, filename) == 0)) {
+		fprintf(stderr, "load file: changed file is loaded\n");
+		failed = 1;
+	}
+	unlink(filename);
+
+	if (cvm_ctx_load_file(ctx, filename) != 2) {
+		fprintf(stderr, "load file: missing file is loaded\n");
+		failed = 1;
+	}
+
+	if (!failed && (write_file(filename, code, 0) != 0 ||
+		cvm_ctx_load_file(ctx, filename) != 0 ||
+		cvm_ctx_run(ctx, &output, (int32_t[]){1, 2}) != 0)) {
+		fprintf(stderr, "load file: empty file is not loaded\n");
+		failed = 1;
+	}
+	free(output);
+	unlink(filename);
+
+	free(code);
+	cvm_ctx_free(ctx);
+	return failed;
+}
+
+// write data to new temporary file of template filename
+static int write_file(char *filename, uint8_t *data, size_t size) {
+	int fd, failed;
+
+	strcpy(filename + strlen(filename) - 6, "XXXXXX");
+	fd = mkstemp(filename);
+	if (fd < 0) {
+		return 1;
+	}
+	failed = (write(fd, data, size) != (ssize_t)size);
+	close(fd);
+	return failed;
+}
+
+#ifdef CVM_KERNEL_PROFILE
+// profile of program with call: result as of cvm_ctx_run, instructions
+// by opcode, by byte and by frame as many as of cvm_ctx_run_for,
+// events of trace are balanced calls in order of time
+static int check_profile(const char *filename) {
+	cvm_profile_t profile, trace;
+	uint64_t insns, execs, addrs, frames;
+	int32_t *output, *expected;
+	int32_t stack[4];
+	int32_t depth;
+	char *source;
+	cvm_ctx_t *ctx;
+	int failed;
+
+	source = read_source(filename);
+	if (source == NULL || load_code(&ctx, source, CVM_KERNEL_SMEMORY, 0) != 0) {
+		fprintf(stderr, "profile: %s is not loaded\n", filename);
+		free(source);
+		return 1;
+	}
+	free(source);
+
+	failed = 0;
+	output = NULL;
+	expected = NULL;
+	memset(&profile, 0, sizeof(profile));
+	memset(&trace, 0, sizeof(trace));
+	if (cvm_ctx_run(ctx, &expected, (int32_t[]){1, 2}) != 0 ||
+		cvm_ctx_profile(ctx, &profile, &output, (int32_t[]){1, 2}) != 0 ||
+		!same(0, output, 0, expected) || profile.events != NULL) {
+		fprintf(stderr, "profile: result differs from cvm_ctx_run\n");
+		failed = 1;
+	}
+	free(output);
+	output = NULL;
+
+	insns = execs = addrs = frames = 0;
+	for (int i = 0; !failed && i < 256; ++i) {
+		insns += profile.insns[i];
+		execs += profile.execs[i];
+	}
+	for (int32_t i = 0; !failed && i <= profile.size; ++i) {
+		addrs += profile.addrs[i];
+	}
+	for (int32_t i = 0; !failed && i < profile.nframes; ++i) {
+		frames += profile.frames[i].count;
+	}
+	// program stops by max of instructions one before its end
+	if (!failed && (insns == 0 || execs > insns || addrs != insns || frames != insns ||
+		cvm_ctx_run_for(ctx, &output, (int32_t[]){1, 2}, (int64_t)insns-1) != CVM_YIELD ||
+		cvm_ctx_run_for(ctx, &output, (int32_t[]){1, 2}, (int64_t)insns) != 0)) {
+		fprintf(stderr, "profile: %llu instructions by opcode, %llu by byte, %llu by frame\n",
+			(unsigned long long)insns, (unsigned long long)addrs, (unsigned long long)frames);
+		failed = 1;
+	}
+	free(output);
+	output = NULL;
+	if (!failed && (profile.nframes != 2 || profile.frames[0].child != 1 || profile.frames[1].parent != 0)) {
+		fprintf(stderr, "profile: call is not a frame\n");
+		failed = 1;
+	}
+
+	if (!failed && (cvm_ctx_trace(ctx, &trace, &output, (int32_t[]){1, 2}) != 0 ||
+		!same(0, output, 0, expected) || trace.nevents != 4 || trace.events[0].addr != 0)) {
+		fprintf(stderr, "profile: trace has not 4 events of program and call\n");
+		failed = 1;
+	}
+	depth = 0;
+	for (int32_t i = 0; !failed && i < trace.nevents; ++i) {
+		cvm_event_t *event = &trace.events[i];
+		if (i > 0 && event->time < trace.events[i-1].time) {
+			failed = 1;
+		} else if (event->enter && depth < COUNT(stack)) {
+			stack[depth++] = event->addr;
+		} else if (event->enter || depth == 0 || stack[--depth] != event->addr) {
+			failed = 1;
+		}
+		if (failed || (depth == 0 && i+1 < trace.nevents)) {
+			fprintf(stderr, "profile: event %d of trace is out of order\n", i);
+			failed = 1;
+		}
+	}
+	free(output);
+
+	cvm_profile_free(&profile);
+	cvm_profile_free(&trace);
+	free(expected);
+	cvm_ctx_free(ctx);
+	return failed;
+}
+#endif
+
+// load code and run it with argument 2 and result expected
+static int load_run(cvm_ctx_t *ctx, uint8_t *code, size_t codelen, int32_t *expected) {
+	int32_t *output;
+	int retcode;
+
+	output = NULL;
+	retcode = cvm_ctx_load(ctx, code, (int32_t)codelen);
+	if (retcode == 0) {
+		retcode = cvm_ctx_run(ctx, &output, (int32_t[]){1, 2});
+	}
+	retcode = (retcode != 0 || !same(0, output, 0, expected));
+	free(output);
+	return retcode;
+}
+
+// C code of test as function test_aot_n
+static int write_aot(FILE *output, test_t *test, int32_t n) {
+	int retcode;
+
+	fprintf(output, "#define %s test_aot_%d\n#define run test_run_%d\n", CVM_AOT_SYMBOL, n, n);
+	retcode = cvm_ctx_aot(test->ctx, output);
+	fprintf(output, "#undef %s\n#undef run\n#undef SMEMORY\n#undef CMUSED\n#undef ADDRESS\n\n", CVM_AOT_SYMBOL);
+
+	if (retcode != 0) {
+		fprintf(stderr, "%s: cvm_ctx_aot fails\n", test->name);
+	}
+	return retcode != 0;
+}
+
+// results of function test_aot_n of shared object
+static int run_aot(void *handle, test_t *test, int32_t n) {
+	char symbol[64];
+	test_aot_t run;
+	int32_t *output;
+	int retcode;
+
+	snprintf(symbol, sizeof(symbol), "test_aot_%d", n);
+	*(void**)&run = dlsym(handle, symbol);
+	if (run == NULL) {
+		fprintf(stderr, "%s: no %s\n", test->name, symbol);
+		return 1;
+	}
+
+	for (int32_t i = 0; i < COUNT(test_inputs); ++i) {
+		output = NULL;
+		retcode = run(&output, test_inputs[i]);
+		print_result(test, i, retcode, output);
+		if (retcode == 0) {
+			free(output);
+		}
+	}
+
+	return 0;
+}
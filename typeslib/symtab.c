@@ -0,0 +1,175 @@
+#include "symtab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK 4096
+
+// keys are copied into blocks of arena, block is
+// allocated only when previous block is full
+typedef struct arena_t {
+	struct arena_t *next;
+	size_t size;
+	size_t used;
+	char data[];
+} arena_t;
+
+// entry with key == NULL is free
+typedef struct symentry_t {
+	const char *key;
+	unsigned int hash;
+	int len;
+	int value;
+} symentry_t;
+
+// open addressing with linear probing,
+// cap is power of 2 and table is at most 3/4 full
+typedef struct symtab_t {
+	int size;
+	int cap;
+	symentry_t *table;
+	arena_t *arena;
+} symtab_t;
+
+static unsigned int strhash(const char *s, int len);
+static symentry_t *symtab_find(symtab_t *st, const char *key, int len, unsigned int hash);
+static int symtab_grow(symtab_t *st);
+static char *arena_copy(symtab_t *st, const char *key, int len);
+
+extern symtab_t *symtab_new(int size) {
+	symtab_t *st = (symtab_t*)malloc(sizeof(symtab_t));
+	if (st == NULL) {
+		return NULL;
+	}
+	st->size = 0;
+	st->cap = 16;
+	while (st->cap < size) {
+		st->cap *= 2;
+	}
+	st->table = (symentry_t*)calloc(st->cap, sizeof(symentry_t));
+	st->arena = NULL;
+	if (st->table == NULL) {
+		free(st);
+		return NULL;
+	}
+	return st;
+}
+
+extern void symtab_free(symtab_t *st) {
+	arena_t *next;
+	while (st->arena != NULL) {
+		next = st->arena->next;
+		free(st->arena);
+		st->arena = next;
+	}
+	free(st->table);
+	free(st);
+}
+
+extern int symtab_size(symtab_t *st) {
+	return st->size;
+}
+
+extern int *symtab_get(symtab_t *st, const char *key, int len) {
+	symentry_t *entry = symtab_find(st, key, len, strhash(key, len));
+	if (entry->key == NULL) {
+		return NULL;
+	}
+	return &entry->value;
+}
+
+extern int symtab_set(symtab_t *st, const char *key, int len, int value) {
+	unsigned int hash = strhash(key, len);
+	symentry_t *entry = symtab_find(st, key, len, hash);
+	if (entry->key != NULL) {
+		entry->value = value;
+		return 0;
+	}
+	if ((st->size+1) * 4 > st->cap * 3) {
+		if (symtab_grow(st) != 0) {
+			return 1;
+		}
+		entry = symtab_find(st, key, len, hash);
+	}
+	entry->key = arena_copy(st, key, len);
+	if (entry->key == NULL) {
+		return 2;
+	}
+	entry->hash = hash;
+	entry->len = len;
+	entry->value = value;
+	st->size += 1;
+	return 0;
+}
+
+// entry of key or free entry where key must be placed
+static symentry_t *symtab_find(symtab_t *st, const char *key, int len, unsigned int hash) {
+	unsigned int mask = st->cap - 1;
+	symentry_t *entry;
+	for (unsigned int i = hash & mask; ; i = (i + 1) & mask) {
+		entry = &st->table[i];
+		if (entry->key == NULL) {
+			return entry;
+		}
+		if (entry->hash == hash && entry->len == len && memcmp(entry->key, key, len) == 0) {
+			return entry;
+		}
+	}
+}
+
+// double capacity, cached hashes are used to move entries
+static int symtab_grow(symtab_t *st) {
+	symentry_t *old = st->table;
+	int oldcap = st->cap;
+	unsigned int mask;
+	unsigned int j;
+	st->table = (symentry_t*)calloc(oldcap * 2, sizeof(symentry_t));
+	if (st->table == NULL) {
+		st->table = old;
+		return 1;
+	}
+	st->cap = oldcap * 2;
+	mask = st->cap - 1;
+	for (int i = 0; i < oldcap; ++i) {
+		if (old[i].key == NULL) {
+			continue;
+		}
+		for (j = old[i].hash & mask; st->table[j].key != NULL; j = (j + 1) & mask) {
+			// next entry
+		}
+		st->table[j] = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+static char *arena_copy(symtab_t *st, const char *key, int len) {
+	arena_t *block = st->arena;
+	size_t size;
+	char *ptr;
+	if (block == NULL || block->size - block->used < (size_t)len + 1) {
+		size = ((size_t)len + 1 > ARENA_BLOCK) ? (size_t)len + 1 : ARENA_BLOCK;
+		block = (arena_t*)malloc(sizeof(arena_t) + size);
+		if (block == NULL) {
+			return NULL;
+		}
+		block->next = st->arena;
+		block->size = size;
+		block->used = 0;
+		st->arena = block;
+	}
+	ptr = block->data + block->used;
+	memcpy(ptr, key, len);
+	ptr[len] = '\0';
+	block->used += (size_t)len + 1;
+	return ptr;
+}
+
+// FNV-1a
+static unsigned int strhash(const char *s, int len) {
+	unsigned int hashval = 2166136261u;
+	for (int i = 0; i < len; ++i) {
+		hashval = (hashval ^ (unsigned char)s[i]) * 16777619u;
+	}
+	return hashval;
+}
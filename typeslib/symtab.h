@@ -0,0 +1,13 @@
+#ifndef EXTCLIB_TYPE_SYMTAB_H_
+#define EXTCLIB_TYPE_SYMTAB_H_
+
+typedef struct symtab_t symtab_t;
+
+extern symtab_t *symtab_new(int size);
+extern void symtab_free(symtab_t *st);
+extern int symtab_size(symtab_t *st);
+
+extern int *symtab_get(symtab_t *st, const char *key, int len);
+extern int symtab_set(symtab_t *st, const char *key, int len, int value);
+
+#endif /* EXTCLIB_TYPE_SYMTAB_H_ */